@@ -0,0 +1,96 @@
+#include <cstdlib>
+#include <new>
+#include "BufferPool.h"
+
+/// blocks smaller than this are rounded up to it, there's no point in caching tiny blocks separately.
+static const size_t MIN_BLOCK_SIZE = 4096;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BufferPool& BufferPool::instance()
+{
+	static BufferPool pool(512 * 1024 * 1024); // magic statics are thread safe in c++11
+	return pool;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BufferPool::BufferPool(size_t maxCachedBytes) :
+	_cachedBytes(0),
+	_maxCachedBytes(maxCachedBytes)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BufferPool::~BufferPool()
+{
+	trim();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Sizes are rounded up to a quarter of their power of two: at most 25% are wasted while images
+/// of similar, but not equal size share the same class.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t BufferPool::sizeClass(size_t bytes)
+{
+	if (bytes <= MIN_BLOCK_SIZE)
+		return MIN_BLOCK_SIZE;
+
+	size_t power = MIN_BLOCK_SIZE;
+	while (power < bytes / 2)
+		power *= 2;
+
+	size_t step = power / 4;
+	return (bytes + step - 1) / step * step;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void* BufferPool::acquire(size_t bytes)
+{
+	size_t size = sizeClass(bytes);
+	{
+		QMutexLocker lock(&_mutex);
+		std::map<size_t, std::vector<void*> >::iterator it = _free.find(size);
+		if (it != _free.end() and not it->second.empty())
+		{
+			void* block = it->second.back();
+			it->second.pop_back();
+			_cachedBytes -= size;
+			return block;
+		}
+	}
+
+	void* block = malloc(size);
+	if (not block)
+		throw std::bad_alloc();
+	return block;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferPool::release(void* buffer, size_t bytes)
+{
+	size_t size = sizeClass(bytes);
+	{
+		QMutexLocker lock(&_mutex);
+		if (_cachedBytes + size <= _maxCachedBytes)
+		{
+			_free[size].push_back(buffer);
+			_cachedBytes += size;
+			return;
+		}
+	}
+	free(buffer);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferPool::trim()
+{
+	QMutexLocker lock(&_mutex);
+	for (std::map<size_t, std::vector<void*> >::iterator it = _free.begin(); it != _free.end(); ++it)
+	{
+		for (size_t i = 0; i < it->second.size(); i++)
+			free(it->second[i]);
+	}
+	_free.clear();
+	_cachedBytes = 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <QMutex>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/**
+ * Process wide cache of big memory blocks, grouped by size class. Heightmap buffers which are freed
+ * are kept here and handed out again to the next image of the same size class, so rasterizing,
+ * dilating and rotating many images does not go through malloc/free and fresh page faults every time.
+ */
+class BufferPool
+{
+public:
+
+	static BufferPool&	instance();
+
+	void*		acquire(size_t bytes);
+	void		release(void* buffer, size_t bytes);
+	void		trim(); /// frees all cached blocks.
+	size_t		cachedBytes() const { return _cachedBytes; }
+
+private:
+
+	BufferPool(size_t maxCachedBytes);
+	~BufferPool();
+	BufferPool(const BufferPool& other);
+	BufferPool& operator=(const BufferPool& other);
+
+	static size_t	sizeClass(size_t bytes);
+
+	std::map<size_t, std::vector<void*> >	_free; /// cached blocks by size class
+	size_t		_cachedBytes;		/// sum of all cached blocks
+	size_t		_maxCachedBytes;	/// blocks are freed instead of cached above this limit
+	QMutex		_mutex;
+};
+
+/// array smart pointer which takes its memory from the BufferPool. Movable, but not copyable.
+template<class T>
+class PooledArray
+{
+public:
+
+	inline PooledArray() : _data(0), _size(0) {}
+	inline explicit PooledArray(size_t size) :
+		_data(size ? (T*)BufferPool::instance().acquire(size * sizeof(T)) : 0), _size(size) {}
+	inline PooledArray(PooledArray&& other) : _data(other._data), _size(other._size)
+	{
+		other._data = 0;
+		other._size = 0;
+	}
+	inline ~PooledArray() { reset(); }
+
+	inline PooledArray& operator=(PooledArray&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			_data = other._data;
+			_size = other._size;
+			other._data = 0;
+			other._size = 0;
+		}
+		return *this;
+	}
+
+	inline void reset()
+	{
+		if (_data)
+			BufferPool::instance().release(_data, _size * sizeof(T));
+		_data = 0;
+		_size = 0;
+	}
+
+	inline T*		get() { return _data; }
+	inline const T*	get() const { return _data; }
+	inline size_t	size() const { return _size; }
+	inline T&		operator[](size_t i) { return _data[i]; }
+	inline const T&	operator[](size_t i) const { return _data[i]; }
+
+private:
+
+	PooledArray(const PooledArray& other);
+	PooledArray& operator=(const PooledArray& other);
+
+	T*		_data;
+	size_t	_size;
+};
@@ -0,0 +1,92 @@
+#include <charconv>
+#include "BufferedWriter.h"
+#include "Exception.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BufferedWriter::BufferedWriter(const QString& filename, size_t bufferSize) :
+	_file(filename),
+	_capacity(bufferSize),
+	_written(0)
+{
+	if (not _file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		THROW(IOException, QString("Unable to open file \'%1\' for writing: %2").arg(filename, _file.errorString()));
+	reserve(_capacity);
+
+	Compression::Codec codec = Compression::codecOf(filename);
+	if (codec != Compression::None)
+		_compressor.reset(new Compressor(codec));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BufferedWriter::~BufferedWriter()
+{
+	_file.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferedWriter::flush()
+{
+	if (not _data.empty())
+		write(false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferedWriter::write(bool finish)
+{
+	const std::vector<char>* out = &_data;
+	if (_compressor)
+	{
+		_compressed.clear();
+		_compressor->compress(_data.data(), _data.size(), finish, _compressed);
+		out = &_compressed;
+	}
+
+	if (not out->empty() and _file.write(out->data(), out->size()) != (qint64)out->size())
+		THROW(IOException, QString("Unable to write to \'%1\': %2").arg(_file.fileName(), _file.errorString()));
+	_written += _data.size();
+	_data.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferedWriter::close()
+{
+	if (_compressor)
+		write(true); // ends the compressed stream, even if nothing is buffered
+	else
+		flush();
+	if (not _file.flush())
+		THROW(IOException, QString("Unable to write to \'%1\': %2").arg(_file.fileName(), _file.errorString()));
+	_file.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ByteBuffer::put(float value)
+{
+	char text[32];
+	std::to_chars_result result = std::to_chars(text, text + sizeof(text), value, std::chars_format::general, 6);
+	put(text, result.ptr - text);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ByteBuffer::putExact(float value)
+{
+	char text[32];
+	std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+	put(text, result.ptr - text);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ByteBuffer::put(unsigned value)
+{
+	char text[16];
+	std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+	put(text, result.ptr - text);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void BufferedWriter::discard()
+{
+	_data.clear();
+	_file.close();
+	_file.remove();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <QFile>
+#include <QString>
+#include <QtEndian>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include "Compression.h"
+
+/**
+ * Growing block of output bytes. Numbers can be appended as text (formatted with std::to_chars) or as
+ * little endian binary values. Blocks can be formatted on several threads and written in order later.
+ */
+class ByteBuffer
+{
+public:
+
+	inline const char*	data() const { return _data.data(); }
+	inline size_t		size() const { return _data.size(); }
+	inline void			clear() { _data.clear(); }
+	inline void			reserve(size_t size) { _data.reserve(size); }
+
+	inline void	put(const char* data, size_t size) { _data.insert(_data.end(), data, data + size); }
+	inline void	put(const char* text) { put(text, strlen(text)); }
+	inline void	put(char c) { _data.push_back(c); }
+	void		put(float value);		/// like printf("%g"), which is what QTextStream writes by default.
+	void		putExact(float value);	/// shortest text which reads back as the same float.
+	void		put(unsigned value);
+
+	/// appends value in little endian byte order.
+	template<class T>
+	inline void	putLE(T value)
+	{
+		value = qToLittleEndian(value);
+		put((const char*)&value, sizeof(value));
+	}
+
+	inline void	putLE(float value)
+	{
+		quint32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		putLE(bits);
+	}
+
+protected:
+
+	std::vector<char>	_data;
+};
+
+/**
+ * Writes a file through a big ByteBuffer, so the file only sees a few large writes. Errors throw an
+ * IOException. close() has to be called to write the rest of the buffer, the destructor only closes
+ * the file. Files ending in .gz or .zst are compressed buffer by buffer.
+ */
+class BufferedWriter : public ByteBuffer
+{
+public:
+
+	BufferedWriter(const QString& filename, size_t bufferSize = 8 << 20);
+	~BufferedWriter();
+
+	void		close();
+	void		flush(); /// hands the buffer to the file, or to the compressor.
+	void		discard(); /// drops the buffer, closes and removes the file.
+	quint64		pos() const { return _written + size(); } /// number of bytes put so far, before compression.
+
+	/// appends a block which was formatted elsewhere, the buffer is flushed when it is full.
+	inline void	put(const ByteBuffer& block)
+	{
+		ByteBuffer::put(block.data(), block.size());
+		flushIfFull();
+	}
+
+	inline void	flushIfFull()
+	{
+		if (size() >= _capacity)
+			flush();
+	}
+
+	using ByteBuffer::put;
+
+private:
+
+	BufferedWriter(const BufferedWriter& other);
+	BufferedWriter& operator=(const BufferedWriter& other);
+
+	void		write(bool finish);
+
+	QFile		_file;
+	size_t		_capacity;
+	quint64		_written; /// bytes handed to the file, or to the compressor
+	std::unique_ptr<Compressor>	_compressor; /// null if the file is not compressed
+	std::vector<char>			_compressed;
+};
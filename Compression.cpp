@@ -0,0 +1,334 @@
+#include <QFile>
+#include <zlib.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include "config.h"
+#include "Compression.h"
+#include "Exception.h"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Compression::Codec Compression::codecOf(const QString& filename)
+{
+	if (filename.endsWith(".gz", Qt::CaseInsensitive))
+		return Gzip;
+	if (filename.endsWith(".zst", Qt::CaseInsensitive))
+		return Zstd;
+	return None;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QString Compression::withoutCodec(const QString& filename)
+{
+	switch (codecOf(filename))
+	{
+		case Gzip:	return filename.left(filename.length() - 3);
+		case Zstd:	return filename.left(filename.length() - 4);
+		default:	return filename;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Compressor::Compressor(Compression::Codec codec) :
+	_codec(codec),
+	_stream(0)
+{
+	if (codec == Compression::Gzip)
+	{
+		z_stream* stream = new z_stream;
+		memset(stream, 0, sizeof(*stream));
+		// 16 more window bits ask zlib for a gzip header and trailer
+		if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			delete stream;
+			THROW(IOException, QString("unable to initialize zlib"));
+		}
+		_stream = stream;
+	}
+	else if (codec == Compression::Zstd)
+	{
+		#ifdef HAVE_ZSTD
+		_stream = ZSTD_createCCtx();
+		if (not _stream)
+			THROW(IOException, QString("unable to initialize zstd"));
+		#else
+		THROW(IOException, QString("zstd support was not compiled in"));
+		#endif
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Compressor::~Compressor()
+{
+	if (_codec == Compression::Gzip)
+	{
+		deflateEnd((z_stream*)_stream);
+		delete (z_stream*)_stream;
+	}
+	#ifdef HAVE_ZSTD
+	else if (_codec == Compression::Zstd)
+		ZSTD_freeCCtx((ZSTD_CCtx*)_stream);
+	#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Compressor::compress(const char* data, size_t size, bool finish, std::vector<char>& out)
+{
+	const size_t OUTPUT_STEP = 1 << 18;
+
+	if (_codec == Compression::Gzip)
+	{
+		z_stream* stream = (z_stream*)_stream;
+		stream->next_in = (Bytef*)data;
+		stream->avail_in = size;
+		int result;
+		do
+		{
+			size_t used = out.size();
+			out.resize(used + OUTPUT_STEP);
+			stream->next_out = (Bytef*)out.data() + used;
+			stream->avail_out = OUTPUT_STEP;
+			result = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+			out.resize(used + OUTPUT_STEP - stream->avail_out);
+			if (result == Z_STREAM_ERROR)
+				THROW(IOException, QString("zlib failed to compress"));
+		}
+		while (stream->avail_in > 0 or stream->avail_out == 0 or (finish and result != Z_STREAM_END));
+		return;
+	}
+
+	#ifdef HAVE_ZSTD
+	if (_codec == Compression::Zstd)
+	{
+		ZSTD_inBuffer input = { data, size, 0 };
+		size_t remaining;
+		do
+		{
+			size_t used = out.size();
+			out.resize(used + ZSTD_CStreamOutSize());
+			ZSTD_outBuffer output = { out.data() + used, ZSTD_CStreamOutSize(), 0 };
+			remaining = ZSTD_compressStream2((ZSTD_CCtx*)_stream, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+			out.resize(used + output.pos);
+			if (ZSTD_isError(remaining))
+				THROW(IOException, QString("zstd failed to compress: %1").arg(ZSTD_getErrorName(remaining)));
+		}
+		while (finish ? remaining != 0 : input.pos < input.size);
+		return;
+	}
+	#endif
+
+	out.insert(out.end(), data, data + size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Decompressor::Decompressor(const QString& filename, Compression::Codec codec, const QByteArray& bytes, size_t blockSize, unsigned maxBlocks) :
+	_filename(filename),
+	_codec(codec),
+	_bytes(bytes),
+	_blockSize(blockSize),
+	_maxBlocks(maxBlocks),
+	_done(false),
+	_stopped(false)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Decompressor::~Decompressor()
+{
+	{
+		QMutexLocker lock(&_mutex);
+		_stopped = true;
+		_changed.wakeAll();
+	}
+	wait();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Decompressor::pop(std::vector<char>& block)
+{
+	QMutexLocker lock(&_mutex);
+	while (_blocks.empty() and not _done)
+		_changed.wait(&_mutex);
+
+	if (not _error.isEmpty())
+		THROW(IOException, _error);
+	if (_blocks.empty())
+		return false;
+
+	block.swap(_blocks.front());
+	_blocks.pop_front();
+	_changed.wakeAll();
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Decompressor::push(std::vector<char>& block)
+{
+	QMutexLocker lock(&_mutex);
+	while (_blocks.size() >= _maxBlocks and not _stopped)
+		_changed.wait(&_mutex);
+	if (_stopped)
+		return false;
+
+	_blocks.push_back(std::vector<char>());
+	_blocks.back().swap(block);
+	_changed.wakeAll();
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Decompressor::run()
+{
+	try
+	{
+		QFile file(_filename);
+		qint64 size = _bytes.size();
+		const char* data = _bytes.constData();
+		if (_bytes.isEmpty())
+		{
+			if (not file.open(QIODevice::ReadOnly))
+				THROW(IOException, QString("Unable to open file \'%1\' for reading: %2").arg(_filename, file.errorString()));
+
+			size = file.size();
+			data = size > 0 ? (const char*)file.map(0, size) : 0;
+			if (size > 0 and not data)
+				THROW(IOException, QString("Unable to map file \'%1\': %2").arg(_filename, file.errorString()));
+		}
+
+		if (_codec == Compression::Gzip)
+			inflateGzip(data, size);
+		else
+			decompressZstd(data, size);
+	}
+	catch (const std::exception& ex)
+	{
+		QMutexLocker lock(&_mutex);
+		_error = QString::fromUtf8(ex.what());
+	}
+
+	QMutexLocker lock(&_mutex);
+	_done = true;
+	_changed.wakeAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// zlib detects the gzip header itself (32 more window bits). A file may hold several gzip members
+/// one after another, which decompress to the concatenation of their contents. zlib counts its input
+/// in 32 bits, larger files are handed to it in slices.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Decompressor::inflateGzip(const char* data, size_t size)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, MAX_WBITS + 32) != Z_OK)
+		THROW(IOException, QString("unable to initialize zlib"));
+
+	stream.next_in = (Bytef*)data;
+	size_t rest = size; /// input which is not handed to zlib yet
+	std::vector<char> block(_blockSize);
+	size_t filled = 0;
+	QString error;
+	for (;;)
+	{
+		if (stream.avail_in == 0 and rest > 0)
+		{
+			stream.avail_in = std::min<size_t>(rest, UINT_MAX);
+			rest -= stream.avail_in;
+		}
+		stream.next_out = (Bytef*)block.data() + filled;
+		stream.avail_out = _blockSize - filled;
+		int result = inflate(&stream, Z_NO_FLUSH);
+		filled = _blockSize - stream.avail_out;
+
+		if (result == Z_STREAM_END)
+		{
+			if (stream.avail_in == 0 and rest == 0)
+				break;
+			inflateReset(&stream);
+		}
+		else if (result == Z_BUF_ERROR and stream.avail_in == 0 and rest == 0)
+		{
+			error = QString("\'%1\' is truncated").arg(_filename);
+			break;
+		}
+		else if (result != Z_OK and result != Z_BUF_ERROR)
+		{
+			error = QString("\'%1\' is not a valid gzip file: %2").arg(_filename, stream.msg ? stream.msg : "unknown error");
+			break;
+		}
+
+		if (filled == _blockSize)
+		{
+			if (not push(block))
+				break;
+			block.resize(_blockSize);
+			filled = 0;
+		}
+	}
+	inflateEnd(&stream);
+
+	if (not error.isEmpty())
+		THROW(IOException, error);
+	block.resize(filled);
+	if (filled)
+		push(block);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Decompressor::decompressZstd(const char* data, size_t size)
+{
+	#ifdef HAVE_ZSTD
+	ZSTD_DCtx* context = ZSTD_createDCtx();
+	if (not context)
+		THROW(IOException, QString("unable to initialize zstd"));
+
+	ZSTD_inBuffer input = { data, size, 0 };
+	std::vector<char> block(_blockSize);
+	size_t filled = 0, result = 0;
+	bool stopped = false;
+	QString error;
+	for (;;)
+	{
+		ZSTD_outBuffer output = { block.data() + filled, _blockSize - filled, 0 };
+		result = ZSTD_decompressStream(context, &output, &input);
+		if (ZSTD_isError(result))
+		{
+			error = QString("\'%1\' is not a valid zstd file: %2").arg(_filename, ZSTD_getErrorName(result));
+			break;
+		}
+		filled += output.pos;
+
+		if (filled == _blockSize)
+		{
+			if (not push(block))
+			{
+				stopped = true;
+				break;
+			}
+			block.resize(_blockSize);
+			filled = 0;
+		}
+		else if (input.pos == input.size)
+			break; // all input is used and the output was not full, so nothing is pending
+	}
+	ZSTD_freeDCtx(context);
+
+	if (error.isEmpty() and not stopped and result != 0)
+		error = QString("\'%1\' is truncated").arg(_filename);
+	if (not error.isEmpty())
+		THROW(IOException, error);
+	block.resize(filled);
+	if (filled and not stopped)
+		push(block);
+	#else
+	Q_UNUSED(data);
+	Q_UNUSED(size);
+	THROW(IOException, QString("\'%1\': zstd support was not compiled in").arg(_filename));
+	#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <vector>
+
+/// compressed mesh files, the codec is chosen by the last extension: ".gz" is gzip, ".zst" is zstd.
+class Compression
+{
+public:
+
+	enum Codec { None, Gzip, Zstd };
+
+	static Codec	codecOf(const QString& filename);
+	static QString	withoutCodec(const QString& filename); /// "part.off.gz" -> "part.off"
+};
+
+/**
+ * Streaming compressor, BufferedWriter sends its blocks through one of these for .gz and .zst files.
+ * zstd is only available if qmake found libzstd (HAVE_ZSTD).
+ */
+class Compressor
+{
+public:
+
+	Compressor(Compression::Codec codec);
+	~Compressor();
+
+	/// compresses size bytes and appends the output to out. finish ends the stream.
+	void	compress(const char* data, size_t size, bool finish, std::vector<char>& out);
+
+private:
+
+	Compressor(const Compressor& other);
+	Compressor& operator=(const Compressor& other);
+
+	Compression::Codec	_codec;
+	void*				_stream; /// z_stream or ZSTD_CCtx
+};
+
+/**
+ * Decompresses a file on its own thread into a bounded queue of blocks, so the parser works on one
+ * block while the next one is inflated, and the decompressed file is never in memory as a whole.
+ * The thread waits while maxBlocks blocks are queued. Errors of the thread are thrown by pop().
+ * bytes are the compressed file if it was read already, else the file is mapped.
+ */
+class Decompressor : public QThread
+{
+public:
+
+	Decompressor(const QString& filename, Compression::Codec codec, const QByteArray& bytes = QByteArray(), size_t blockSize = 4 << 20, unsigned maxBlocks = 4);
+	~Decompressor(); /// stops the thread, even if the stream was not read to the end.
+
+	bool	pop(std::vector<char>& block); /// waits for the next block, false at the end of the stream.
+
+protected:
+
+	void	run();
+
+private:
+
+	bool	push(std::vector<char>& block); /// false if the reader is gone.
+	void	inflateGzip(const char* data, size_t size);
+	void	decompressZstd(const char* data, size_t size);
+
+	QString			_filename;
+	Compression::Codec	_codec;
+	QByteArray		_bytes;
+	size_t			_blockSize;
+	unsigned		_maxBlocks;
+
+	std::deque<std::vector<char> >	_blocks;
+	bool			_done;		/// the thread has pushed its last block
+	bool			_stopped;	/// the reader does not want more blocks
+	QString			_error;		/// what went wrong in the thread, empty if nothing
+	QMutex			_mutex;
+	QWaitCondition	_changed;	/// a block was pushed or popped, or the stream ended
+};
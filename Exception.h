@@ -66,6 +66,21 @@ struct MeshException : public BaseException
 	}
 };
 
+struct IOException : public BaseException
+{
+	IOException(QString msg, const char* funcname, const char* filename, unsigned line) : BaseException(msg,funcname, filename, line) {}
+
+	void raise() const
+	{
+		throw *this;
+	}
+
+	IOException* clone() const
+	{
+		return new IOException(*this);
+	}
+};
+
 #ifdef __GNUC__
 #define THROW(ex, S) throw ex((S), __PRETTY_FUNCTION__, __FILE__, __LINE__)
 #else
@@ -0,0 +1,284 @@
+#include <QFile>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+#include "FileReader.h"
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// threads of the fallback reader, enough to keep a disk queue or a network share busy.
+static const unsigned READER_THREADS = 8;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+FileReader::FileReader(const std::vector<QString>& filenames, unsigned maxInFlight, qint64 maxFileSize) :
+	_filenames(filenames),
+	_maxInFlight(std::max(maxInFlight, 1u)),
+	_maxFileSize(maxFileSize),
+	_states(filenames.size(), Queued),
+	_bytes(filenames.size()),
+	_next(0),
+	_inFlight(0),
+	_stopped(false)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+FileReader::~FileReader()
+{
+	{
+		QMutexLocker lock(&_mutex);
+		_stopped = true;
+		_changed.wakeAll();
+	}
+	wait();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A queued file which the reader gets to without waiting for a slot is waited for. Anything further
+/// ahead is marked taken, so the reader skips it and the caller reads it while the reader catches up.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool FileReader::take(size_t index, QByteArray& bytes)
+{
+	QMutexLocker lock(&_mutex);
+	if (index >= _states.size())
+		return false;
+
+	while (_states[index] == Queued and not _stopped and index - _next < _maxInFlight - _inFlight)
+		_changed.wait(&_mutex);
+	while (_states[index] == Reading)
+		_changed.wait(&_mutex);
+
+	if (_states[index] == Taken)
+		return false;
+	if (_states[index] == Queued)
+	{
+		_states[index] = Taken;
+		return false;
+	}
+
+	bytes = _bytes[index];
+	_bytes[index] = QByteArray();
+	_states[index] = Taken;
+	_inFlight--;
+	_changed.wakeAll();
+	return not bytes.isEmpty();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void FileReader::run()
+{
+	#ifdef HAVE_LIBURING
+	if (readWithUring())
+		return;
+	#endif
+	readWithThreads();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool FileReader::claim(size_t& index, bool wait)
+{
+	QMutexLocker lock(&_mutex);
+	for (;;)
+	{
+		while (_next < _states.size() and _states[_next] != Queued)
+			_next++; // taken by the caller before the reader got to it
+		if (_stopped or _next == _states.size())
+			return false;
+		if (_inFlight < _maxInFlight)
+			break;
+		if (not wait)
+			return false;
+		_changed.wait(&_mutex);
+	}
+
+	index = _next++;
+	_states[index] = Reading;
+	_inFlight++;
+	_changed.wakeAll();
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void FileReader::finish(size_t index, const QByteArray& bytes)
+{
+	QMutexLocker lock(&_mutex);
+	_bytes[index] = bytes;
+	_states[index] = Done;
+	_changed.wakeAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool FileReader::isStopped()
+{
+	QMutexLocker lock(&_mutex);
+	return _stopped;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QByteArray FileReader::readFile(const QString& filename) const
+{
+	QFile file(filename);
+	if (not file.open(QIODevice::ReadOnly))
+		return QByteArray();
+	qint64 size = file.size();
+	if (size <= 0 or size > _maxFileSize)
+		return QByteArray();
+
+	QByteArray bytes = file.readAll();
+	return bytes.size() == size ? bytes : QByteArray();
+}
+
+#ifdef HAVE_LIBURING
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Every file in flight has one request with the kernel at a time: open, then statx for the size,
+/// then reads until the buffer is full. New files are opened whenever slots are free, the requests
+/// of all files go out with one submit per round and the completions are collected together. A
+/// failed request ends the file without bytes, the caller then gets the error from its own read. So
+/// does a request which finds no free submission entry even after the queued ones were submitted.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool FileReader::readWithUring()
+{
+	io_uring ring;
+	if (io_uring_queue_init(_maxInFlight + 1, &ring, 0) < 0) // one more for the timeout of old kernels
+		return false;
+
+	auto nextSqe = [&ring]()
+	{
+		io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+		if (not sqe and io_uring_submit(&ring) >= 0)
+			sqe = io_uring_get_sqe(&ring);
+		return sqe;
+	};
+
+	/// a file in flight.
+	struct Request
+	{
+		QByteArray		path;
+		int				fd;
+		struct statx	status;
+		QByteArray		bytes;
+		qint64			done;
+	};
+	std::vector<Request> requests(_filenames.size());
+	unsigned pending = 0;
+	size_t index;
+	for (;;)
+	{
+		// only waits for a slot if there is nothing to collect
+		while (claim(index, pending == 0))
+		{
+			Request& request = requests[index];
+			request.path = QFile::encodeName(_filenames[index]);
+			request.fd = -1;
+			io_uring_sqe* sqe = nextSqe();
+			if (not sqe)
+			{
+				finish(index, QByteArray());
+				continue;
+			}
+			io_uring_prep_openat(sqe, AT_FDCWD, request.path.constData(), O_RDONLY | O_CLOEXEC, 0);
+			io_uring_sqe_set_data(sqe, (void*)index);
+			pending++;
+		}
+		if (pending == 0)
+			break; // all files are done or the reader stops
+
+		io_uring_submit(&ring);
+		io_uring_cqe* cqe;
+		__kernel_timespec timeout = { 0, 10 * 1000 * 1000 }; // slots freed by take() are filled after at most 10 ms
+		if (io_uring_wait_cqe_timeout(&ring, &cqe, &timeout) < 0)
+			continue;
+
+		do
+		{
+			index = (size_t)io_uring_cqe_get_data(cqe);
+			int result = cqe->res;
+			io_uring_cqe_seen(&ring, cqe);
+			pending--;
+
+			Request& request = requests[index];
+			io_uring_sqe* sqe = 0;
+			bool complete = false;
+			if (result >= 0 and isStopped())
+			{
+				if (request.fd < 0)
+					close(result); // an open which completed after the stop
+			}
+			else if (result >= 0)
+			{
+				if (request.fd < 0)
+				{
+					request.fd = result;
+					sqe = nextSqe();
+					if (sqe)
+						io_uring_prep_statx(sqe, request.fd, "", AT_EMPTY_PATH, STATX_SIZE, &request.status);
+				}
+				else if (request.bytes.isNull())
+				{
+					qint64 size = request.status.stx_size;
+					if (size > 0 and size <= _maxFileSize)
+					{
+						request.bytes = QByteArray(size, Qt::Uninitialized);
+						request.done = 0;
+						sqe = nextSqe();
+						if (sqe)
+							io_uring_prep_read(sqe, request.fd, request.bytes.data(), size, 0);
+					}
+				}
+				else if (result > 0) // short reads continue where they stopped, 0 is a file which shrank
+				{
+					request.done += result;
+					complete = request.done == request.bytes.size();
+					if (not complete)
+					{
+						sqe = nextSqe();
+						if (sqe)
+							io_uring_prep_read(sqe, request.fd, request.bytes.data() + request.done, request.bytes.size() - request.done, request.done);
+					}
+				}
+			}
+
+			if (sqe)
+			{
+				io_uring_sqe_set_data(sqe, (void*)index);
+				pending++;
+			}
+			else
+			{
+				if (request.fd >= 0)
+					close(request.fd);
+				finish(index, complete ? request.bytes : QByteArray());
+				request = Request();
+			}
+		}
+		while (io_uring_peek_cqe(&ring, &cqe) == 0);
+	}
+
+	io_uring_queue_exit(&ring);
+	return true;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void FileReader::readWithThreads()
+{
+	QThreadPool pool; // not the global pool, blocked reads would hold up the rasterization
+	pool.setMaxThreadCount(std::min(_maxInFlight, READER_THREADS));
+	size_t index;
+	while (claim(index, true))
+	{
+		QtConcurrent::run(&pool, [this, index]()
+		{
+			finish(index, isStopped() ? QByteArray() : readFile(_filenames[index]));
+		});
+	}
+	pool.waitForDone();
+}
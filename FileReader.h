@@ -0,0 +1,66 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+
+/**
+ * Reads a list of files ahead of the workers which parse them, so a worker finds the bytes of its
+ * file in memory instead of waiting for a slow disk or network share. The files are read in list
+ * order on their own thread and at most maxInFlight of them are being read or wait to be taken.
+ *
+ * With liburing (HAVE_LIBURING) the open, size and read requests of all files in flight go to the
+ * kernel in batches through one io_uring. Without it, or where the kernel refuses io_uring, a small
+ * pool of threads reads the files with blocking calls.
+ *
+ * Files larger than maxFileSize are not read, mapping them is cheaper. A file which is not read,
+ * because it is too large, could not be read or was asked for before its turn, is left to the
+ * caller, which opens it and reports the errors as usual. The reader has to be start()ed before
+ * the first take().
+ */
+class FileReader : public QThread
+{
+public:
+
+	FileReader(const std::vector<QString>& filenames, unsigned maxInFlight = 64, qint64 maxFileSize = 16 << 20);
+	~FileReader(); /// stops the thread, files which were not taken are dropped.
+
+	/// waits for the file at index and hands out its bytes, false if the caller has to read it itself.
+	/// Every file can be taken once, files which are never taken keep their slot.
+	bool	take(size_t index, QByteArray& bytes);
+
+protected:
+
+	void	run();
+
+private:
+
+	enum State
+	{
+		Queued,		/// not looked at yet
+		Reading,
+		Done,		/// read or given up, waits to be taken
+		Taken
+	};
+
+	bool		claim(size_t& index, bool wait); /// the next queued file and a slot for it, false at the end, on stop or if !wait and no slot is free.
+	void		finish(size_t index, const QByteArray& bytes);
+	bool		isStopped();
+	QByteArray	readFile(const QString& filename) const; /// blocking, empty if the file is not read
+	bool		readWithUring(); /// false if io_uring is not available
+	void		readWithThreads();
+
+	std::vector<QString>	_filenames;
+	unsigned				_maxInFlight;
+	qint64					_maxFileSize;
+
+	std::vector<State>		_states;
+	std::vector<QByteArray>	_bytes;
+	size_t					_next;		/// first file which may still be queued
+	unsigned				_inFlight;	/// files being read or done
+	bool					_stopped;
+	QMutex					_mutex;
+	QWaitCondition			_changed;	/// a file was claimed, finished or taken, or the reader stops
+};
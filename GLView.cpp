@@ -94,7 +94,7 @@ void GLView::setNode(const Node *node)
 	_single = true;
 	_node = node;
 	_cam.setToIdentity();
-    QVector3D geom = node->getMesh()->getGeometry();
+    QVector3D geom = node->getGeometry();
 	QVector3D pos = node->getPos() + QVector3D(geom.x() / 2, geom.y() / 2, geom.z() * 2);
     _cam.translate(pos);
 	_lightPos = QVector4D(pos, 1.);
@@ -215,7 +215,7 @@ void GLView::paintGL()
 	if (_single)
 	{
         glMultMatrixf(_node->getTransform().constData());
-        _node->getMesh()->draw(_useLighting);
+        _node->draw(_useLighting);
 	}
 	else
 	{
@@ -226,12 +226,12 @@ void GLView::paintGL()
 			QVector3D nodePos = node->getPos();
 
 			glPushMatrix();
-            min = vecmin(min, nodePos + node->getMesh()->getMin());
-            max = vecmax(max, nodePos + node->getMesh()->getMax());
+            min = vecmin(min, nodePos + node->getMin());
+            max = vecmax(max, nodePos + node->getMax());
 
             glMultMatrixf(node->getTransform().constData());
 
-            _nodes->getNode(i)->getMesh()->draw(_useLighting);
+            node->draw(_useLighting);
 			glPopMatrix();
 		}
 
@@ -278,7 +278,7 @@ void GLView::mouseMoveEvent(QMouseEvent *event)
         if(_single)
         {
             origin = _node->getPos();
-            geometry = _node->getMesh()->getGeometry();
+            geometry = _node->getGeometry();
         }
         else
         {
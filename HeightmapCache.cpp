@@ -0,0 +1,343 @@
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include "config.h"
+#include "HeightmapCache.h"
+#include "BufferedWriter.h"
+
+namespace
+{
+	const char		MAGIC[8] = { 'Q', 'M', 'P', 'H', 'M', 'A', 'P', 0 };
+	const quint32	FORMAT_VERSION = 4;
+	const quint32	BYTE_ORDER_MARK = 0x01020304;
+
+	/// the fixed part of an entry file, followed by the top and the bottom image.
+	struct EntryHeader
+	{
+		char	magic[8];
+		quint32	version;
+		quint32	byteOrder;	/// entries are written in the byte order of the machine which uses them
+		float	min[3];
+		float	max[3];
+		double	volume;
+		quint32	fullyTriangulated;
+		quint64	numVertices;
+		quint64	numTriangles;
+	};
+
+	/// the fixed part of an image, followed by its row starts, its spans and the heights of its set pixels.
+	struct ImageHeader
+	{
+		quint32	width;
+		quint32	height;
+		float	pixelSize;
+		float	minColor;
+		float	maxColor;
+		qint32	bounds[4];		/// x, y, width, height
+		quint32	numSpans;
+		quint64	numSetPixels;
+	};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+HeightmapCache& HeightmapCache::instance()
+{
+	static HeightmapCache cache; // magic statics are thread safe in c++11
+	return cache;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+HeightmapCache::HeightmapCache() :
+	_enabled(false),
+	_maxBytes(0),
+	_bytes(0)
+{
+	QSettings settings(APP_VENDOR, APP_NAME);
+	_maxBytes = settings.value("heightmap_cache_size", 2048).toULongLong() << 20;
+	QString location = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	if (not settings.value("heightmap_cache", true).toBool() or location.isEmpty())
+		return;
+
+	_directory = location + "/heightmaps";
+	if (not QDir().mkpath(_directory))
+		return;
+
+	_enabled = true;
+	QFileInfoList entries = QDir(_directory).entryInfoList(QStringList("*.hmap"), QDir::Files);
+	for (int i = 0; i < entries.size(); i++)
+		_bytes += entries[i].size();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QString HeightmapCache::fileOf(const QByteArray& key) const
+{
+	return _directory + "/" + QString::fromLatin1(key.constData()) + ".hmap";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QByteArray HeightmapCache::contentHash(const QString& filename)
+{
+	QFile file(filename);
+	if (not file.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	qint64 size = file.size();
+	const char* data = size > 0 ? (const char*)file.map(0, size) : 0;
+	if (size > 0 and not data)
+		return QByteArray();
+	return contentHash(data, size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QByteArray HeightmapCache::contentHash(const char* data, qint64 size)
+{
+	const qint64 PIECE_SIZE = 1 << 30; // addData() takes an int
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	for (qint64 pos = 0; pos < size; pos += PIECE_SIZE)
+		hash.addData(data + pos, std::min(PIECE_SIZE, size - pos));
+	return hash.result();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QByteArray HeightmapCache::key(const QByteArray& contentHash, QVector3D scale, unsigned dilation, float pixelSize, unsigned proxyLevel)
+{
+	float values[4] = { scale.x(), scale.y(), scale.z(), pixelSize };
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(contentHash);
+	hash.addData((const char*)values, sizeof(values));
+	hash.addData((const char*)&dilation, sizeof(dilation));
+	hash.addData((const char*)&proxyLevel, sizeof(proxyLevel));
+	hash.addData((const char*)&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+	return hash.result().toHex();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void HeightmapCache::writeImage(ByteBuffer& out, const Image& image)
+{
+	const std::vector<Image::Span>& spans = image._spans;
+	ImageHeader header;
+	memset(&header, 0, sizeof(header));
+	header.width = image.getWidth();
+	header.height = image.getHeight();
+	header.pixelSize = image.getPixelSize();
+	header.minColor = image.minColor();
+	header.maxColor = image.maxColor();
+	QRect bounds = image.getBounds();
+	header.bounds[0] = bounds.x();
+	header.bounds[1] = bounds.y();
+	header.bounds[2] = bounds.width();
+	header.bounds[3] = bounds.height();
+	header.numSpans = spans.size();
+	for (const Image::Span& span : spans)
+		header.numSetPixels += span.end - span.begin;
+
+	out.put((const char*)&header, sizeof(header));
+	out.put((const char*)image._rowSpans.data(), image._rowSpans.size() * sizeof(quint32));
+	out.put((const char*)spans.data(), spans.size() * sizeof(Image::Span));
+	for (quint32 y = 0; y < header.height; y++)
+		for (const Image::Span* span = image.spansBegin(y); span != image.spansEnd(y); ++span)
+			out.put((const char*)&image._data[image.index(span->begin, y)], (span->end - span->begin) * sizeof(Image::ColorType));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads an image behind pos and moves pos past it. Returns 0 if the image is broken, then the entry
+/// is dropped.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image* HeightmapCache::readImage(const char*& pos, const char* end, const QString& name)
+{
+	ImageHeader header;
+	if ((size_t)(end - pos) < sizeof(header))
+		return 0;
+	memcpy(&header, pos, sizeof(header));
+	pos += sizeof(header);
+
+	size_t tables = (header.height + 1ull) * sizeof(quint32) + (size_t)header.numSpans * sizeof(Image::Span);
+	if (header.width == 0 or header.height == 0 or not (header.pixelSize > 0.f) or
+		header.bounds[0] < 0 or header.bounds[1] < 0 or header.bounds[2] < 0 or header.bounds[3] < 0 or
+		(qint64)header.bounds[0] + header.bounds[2] > header.width or (qint64)header.bounds[1] + header.bounds[3] > header.height or
+		header.numSetPixels > (quint64)header.width * header.height or
+		(size_t)(end - pos) < tables or (size_t)(end - pos) - tables < header.numSetPixels * sizeof(Image::ColorType))
+		return 0;
+
+	std::unique_ptr<Image> image(new Image(header.width, header.height));
+	image->_pixelSize = header.pixelSize;
+	image->_minColor = header.minColor;
+	image->_maxColor = header.maxColor;
+	image->_bounds = QRect(header.bounds[0], header.bounds[1], header.bounds[2], header.bounds[3]);
+	image->_name = name;
+	std::vector<quint32>& rowSpans = image->_rowSpans;
+	std::vector<Image::Span>& spans = image->_spans;
+	rowSpans.resize(header.height + 1);
+	memcpy(rowSpans.data(), pos, rowSpans.size() * sizeof(quint32));
+	pos += rowSpans.size() * sizeof(quint32);
+	spans.resize(header.numSpans);
+	memcpy(spans.data(), pos, spans.size() * sizeof(Image::Span));
+	pos += spans.size() * sizeof(Image::Span);
+
+	// the tables come from a file, so they are checked before any pixel is written.
+	if (rowSpans[0] != 0 or rowSpans[header.height] != header.numSpans)
+		return 0;
+	for (quint32 y = 0; y < header.height; y++)
+		if (rowSpans[y] > rowSpans[y + 1])
+			return 0;
+	quint64 numSetPixels = 0;
+	for (const Image::Span& span : spans)
+	{
+		if (span.begin >= span.end or span.end > header.width)
+			return 0;
+		numSetPixels += span.end - span.begin;
+	}
+	if (numSetPixels != header.numSetPixels)
+		return 0;
+
+	for (quint32 y = 0; y < header.height; y++)
+	{
+		for (quint32 s = rowSpans[y]; s < rowSpans[y + 1]; s++)
+		{
+			size_t first = image->index(spans[s].begin, y), length = spans[s].end - spans[s].begin;
+			memset(&image->_alpha[first], 1, length);
+			memcpy(&image->_data[first], pos, length * sizeof(Image::ColorType));
+			pos += length * sizeof(Image::ColorType);
+		}
+	}
+	return image.release();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool HeightmapCache::load(const QByteArray& key, const QString& meshName, Entry& entry)
+{
+	if (not _enabled)
+		return false;
+
+	QFile file(fileOf(key));
+	if (not file.open(QIODevice::ReadOnly))
+		return false;
+	qint64 size = file.size();
+	const char* begin = size > 0 ? (const char*)file.map(0, size) : 0;
+	if (not begin)
+		return false;
+
+	const char* pos = begin;
+	const char* end = begin + size;
+	EntryHeader header;
+	bool good = (size_t)size >= sizeof(header);
+	if (good)
+	{
+		memcpy(&header, pos, sizeof(header));
+		pos += sizeof(header);
+		good = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 and header.version == FORMAT_VERSION and header.byteOrder == BYTE_ORDER_MARK;
+	}
+
+	Image* images[2] = { 0, 0 };
+	const char* suffixes[2] = { "_top", "_bottom" };
+	for (unsigned i = 0; i < 2 and good; i++)
+	{
+		images[i] = readImage(pos, end, meshName + suffixes[i]);
+		good = images[i] != 0;
+	}
+	entry.top.reset(images[0]);
+	entry.bottom.reset(images[1]);
+
+	if (not good or pos != end)
+	{
+		// a broken or outdated entry is removed, the caller rasterizes and stores the images again.
+		entry.top.reset();
+		entry.bottom.reset();
+		file.close();
+		if (QFile::remove(fileOf(key)))
+		{
+			QMutexLocker lock(&_mutex);
+			_bytes -= std::min<quint64>(_bytes, size);
+		}
+		return false;
+	}
+
+	entry.min = QVector3D(header.min[0], header.min[1], header.min[2]);
+	entry.max = QVector3D(header.max[0], header.max[1], header.max[2]);
+	entry.volume = header.volume;
+	entry.fullyTriangulated = header.fullyTriangulated != 0;
+	entry.numVertices = header.numVertices;
+	entry.numTriangles = header.numTriangles;
+
+	// the modification time is the time of the last use, eviction removes the oldest entries first.
+	file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void HeightmapCache::store(const QByteArray& key, const Image& top, const Image& bottom, QVector3D min, QVector3D max, double volume, bool fullyTriangulated,
+						   size_t numVertices, size_t numTriangles)
+{
+	if (not _enabled)
+		return;
+
+	EntryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = FORMAT_VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	for (unsigned c = 0; c < 3; c++)
+	{
+		header.min[c] = min[c];
+		header.max[c] = max[c];
+	}
+	header.volume = volume;
+	header.fullyTriangulated = fullyTriangulated;
+	header.numVertices = numVertices;
+	header.numTriangles = numTriangles;
+
+	ByteBuffer out;
+	out.put((const char*)&header, sizeof(header));
+	writeImage(out, top);
+	writeImage(out, bottom);
+
+	// QSaveFile writes to a temporary file and renames it, other threads and processes never see half an entry.
+	// The cache only saves time, so an entry which can not be written is skipped.
+	QFileInfo replaced(fileOf(key)); // an entry written meanwhile, e.g. by another node of the same mesh
+	quint64 replacedSize = replaced.exists() ? replaced.size() : 0;
+	QSaveFile file(fileOf(key));
+	if (not file.open(QIODevice::WriteOnly) or file.write(out.data(), out.size()) != (qint64)out.size() or not file.commit())
+		return;
+
+	bool full;
+	{
+		QMutexLocker lock(&_mutex);
+		_bytes -= std::min(_bytes, replacedSize);
+		_bytes += out.size();
+		full = _bytes > _maxBytes;
+	}
+	if (full)
+		evict(_maxBytes / 10 * 9); // some room is made, so not every store evicts
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The directory is scanned again, so entries written or removed by other processes are counted
+/// correctly afterwards.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void HeightmapCache::evict(quint64 maxBytes)
+{
+	if (not _enabled)
+		return;
+
+	QMutexLocker lock(&_mutex);
+	QFileInfoList entries = QDir(_directory).entryInfoList(QStringList("*.hmap"), QDir::Files, QDir::Time | QDir::Reversed);
+	quint64 bytes = 0;
+	for (int i = 0; i < entries.size(); i++)
+		bytes += entries[i].size();
+
+	for (int i = 0; i < entries.size() and bytes > maxBytes; i++)
+		if (QFile::remove(entries[i].filePath()))
+			bytes -= entries[i].size();
+	_bytes = bytes;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector3D>
+#include <memory>
+#include "Image.h"
+
+class ByteBuffer;
+
+/**
+ * Persistent cache of the top and bottom heightmaps of meshes, so parts which come back from job to
+ * job are not rasterized and dilated again. Every entry is a file in the cache location of the
+ * application, named after a key which hashes the content of the mesh file together with everything
+ * the heightmaps depend on: the scale of the mesh, the dilation, the pixel size and the level of
+ * detail they were rendered from. An entry holds the spans of set pixels and their heights for both
+ * images, the bounding box of the scaled mesh, the volume between the images, whether the mesh file
+ * had polygons other than triangles and the counts of the loaded mesh, so a hit needs nothing from
+ * the mesh file but its hash.
+ * Hits are read from a memory mapping. The least recently used entries are removed when the cache
+ * grows beyond its size limit.
+ *
+ * The settings "heightmap_cache" (on by default) and "heightmap_cache_size" (in MB) control the cache.
+ */
+class HeightmapCache
+{
+public:
+
+	/// the images and the numbers the cache keeps for one key.
+	struct Entry
+	{
+		std::unique_ptr<Image>	top;
+		std::unique_ptr<Image>	bottom;
+		QVector3D	min;	/// bounding box of the scaled mesh
+		QVector3D	max;
+		double		volume;	/// top->diffSum(*bottom)
+		bool		fullyTriangulated; /// Mesh::wasFullyTriangulated() of the mesh file
+		size_t		numVertices;	/// of the mesh loaded from the file
+		size_t		numTriangles;
+	};
+
+	static HeightmapCache&	instance();
+
+	/// hash of the bytes of a mesh file, empty if the file can not be read.
+	static QByteArray		contentHash(const QString& filename);
+	static QByteArray		contentHash(const char* data, qint64 size); /// of bytes which were read already
+	static QByteArray		key(const QByteArray& contentHash, QVector3D scale, unsigned dilation, float pixelSize, unsigned proxyLevel); /// proxyLevel: the level of detail the images are rendered from
+
+	inline bool	isEnabled() const { return _enabled; }
+	bool		load(const QByteArray& key, const QString& meshName, Entry& entry); /// false on a miss
+	void		store(const QByteArray& key, const Image& top, const Image& bottom, QVector3D min, QVector3D max, double volume, bool fullyTriangulated,
+					  size_t numVertices, size_t numTriangles);
+	void		evict(quint64 maxBytes); /// removes least recently used entries until at most maxBytes are left.
+
+private:
+
+	HeightmapCache();
+	HeightmapCache(const HeightmapCache& other);
+	HeightmapCache& operator=(const HeightmapCache& other);
+
+	QString		fileOf(const QByteArray& key) const;
+	static void		writeImage(ByteBuffer& out, const Image& image);
+	static Image*	readImage(const char*& pos, const char* end, const QString& name); /// 0 if the image is broken
+
+	QString		_directory;
+	bool		_enabled;
+	quint64		_maxBytes;	/// limit of the size of all entries
+	quint64		_bytes;		/// size of all entries, as far as this process knows
+	QMutex		_mutex;		/// guards _bytes and eviction
+};
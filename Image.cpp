@@ -1,10 +1,12 @@
 #include <QDebug>
+#include <QColor>
 #include <cassert>
 #include <cstring>
 #include <memory>
 #include <algorithm>
 #include <iostream>
 #include "Image.h"
+#include "ImageKernels.h"
 #include "util.h"
 #include "Exception.h"
 using namespace std;
@@ -15,13 +17,16 @@ Image::Image(const Image& other) :
 	_height(other._height),
 	_minColor(other._minColor),
 	_maxColor(other._maxColor),
-	_name(other._name + "_copy")
-
+	_name(other._name + "_copy"),
+	_pixelSize(other._pixelSize),
+	_spans(other._spans),
+	_rowSpans(other._rowSpans),
+	_bounds(other._bounds)
 {
-	_data = new ColorType[_width * _height];
-	_alpha = new unsigned char[_width * _height];
-	memcpy(_data, other._data, _width * _height * sizeof(ColorType));
-	memcpy(_alpha, other._alpha, _width * _height * sizeof(unsigned char));
+	_data = PooledArray<ColorType>(numPixels());
+	_alpha = PooledArray<unsigned char>(numPixels());
+	memcpy(_data.get(), other._data.get(), numPixels() * sizeof(ColorType));
+	memcpy(_alpha.get(), other._alpha.get(), numPixels() * sizeof(unsigned char));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -29,62 +34,102 @@ Image::Image(quint32 width, quint32 height) :
 	_width(width),
 	_height(height),
 	_minColor(INFINITY),
-	_maxColor(-INFINITY)
+	_maxColor(-INFINITY),
+	_pixelSize(1.),
+	_rowSpans(height + 1, 0)
 {	
 	if (width == 0 or height == 0)
 		THROW(ImageException, "bad geometry");
 
-    _data = new ColorType[width * height];
-	_alpha = new unsigned char[width * height];
-	memset(_alpha, 0, width * height);
+	_data = PooledArray<ColorType>(numPixels());
+	_alpha = PooledArray<unsigned char>(numPixels());
+	memset(_alpha.get(), 0, numPixels());
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Image::Image(const Mesh& mesh, Mode mode, unsigned dilationValue) :
+///
+/// Evaluates the expression row by row, views without alpha count as fully set.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image::Image(const RegionExpression& expression) :
+	_width(expression.getWidth()),
+	_height(expression.getHeight()),
 	_minColor(INFINITY),
-	_maxColor(-INFINITY)
+	_maxColor(-INFINITY),
+	_pixelSize(1.)
 {
+	if (_width == 0 or _height == 0)
+		THROW(ImageException, "bad geometry");
+
+	_data = PooledArray<ColorType>(numPixels());
+	_alpha = PooledArray<unsigned char>(numPixels());
+
+	const ImageRegion& left = expression.left();
+	const ImageRegion& right = expression.right();
+	if (left._parent)
+		_pixelSize = left._parent->getPixelSize();
+
+	std::vector<unsigned char> allSet(_width, 1);
+	for (quint32 y = 0; y < _height; y++)
+	{
+		const unsigned char* leftAlpha = left.alphaRow(y);
+		const unsigned char* rightAlpha = right.alphaRow(y);
+		ImageKernels::combine(left.row(y), leftAlpha ? leftAlpha : &allSet[0], right.row(y), rightAlpha ? rightAlpha : &allSet[0],
+							  expression.sign(), &_data[index(0, y)], &_alpha[index(0, y)], _width);
+	}
+
+	recalcMinMax();
+	rebuildSpans();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Rasterizes the mesh with pixels of pixelSize x pixelSize mesh units. The heights are not quantized,
+/// they stay in mesh units.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image::Image(const Mesh& mesh, Mode mode, unsigned dilationValue, float pixelSize) :
+	_minColor(INFINITY),
+	_maxColor(-INFINITY),
+	_pixelSize(pixelSize)
+{
+	if (not (pixelSize > 0.))
+		THROW(ImageException, QString("bad pixel size %1").arg(pixelSize));
+
 	QVector3D geometry = mesh.getGeometry();
-	_width = geometry.x();
-	_height = geometry.y();
+	_width = geometry.x() / pixelSize;
+	_height = geometry.y() / pixelSize;
 	_name = mesh.getName();
 
-	if (geometry.x() < 1. or geometry.y() < 1. or geometry.z() < 1.)
+	if (_width < 1 or _height < 1 or geometry.z() < 1.)
 	{
-		THROW(ImageException, QString("mesh \"%1\" is too small, its dimensions are: (%2, %3, %4), scale it up.").arg(mesh.getName(),
+		THROW(ImageException, QString("mesh \"%1\" is too small, its dimensions are: (%2, %3, %4), scale it up or use smaller pixels.").arg(mesh.getName(),
 						QString::number(geometry.x()), QString::number(geometry.y()), QString::number(geometry.z())));
 	}
 
-	size_t numPixels = _width * _height;
-	_data = new ColorType[numPixels];
-	_alpha = new unsigned char[numPixels];
-	memset(_alpha, 0, numPixels);
+	// mesh space to pixel space, z is kept in mesh units.
+	QVector3D toPixels(1. / pixelSize, 1. / pixelSize, 1.);
+	unsigned radius = dilationRadius(dilationValue, pixelSize);
+
+	_data = PooledArray<ColorType>(numPixels());
+	_alpha = PooledArray<unsigned char>(numPixels());
+	memset(_alpha.get(), 0, numPixels());
 
     switch (mode)
     {
 		case Top:
 			_name += "_top";
-			for (Mesh::Iterator it = mesh.vertexIterator(); it.is_good(); it.next())
-			{
-				Triangle tri = it.get();
-				drawTriangle(tri.vertex[0] - mesh.getMin(),
-							 tri.vertex[1] - mesh.getMin(),
-							 tri.vertex[2] - mesh.getMin(),
-							 Image::x_greater_y);
-			}
-			dilate(dilationValue, Image::x_greater_y);
+			drawMesh(mesh, toPixels, Image::x_greater_y);
+			rebuildSpans();
+			dilate(radius, dilationValue, Image::x_greater_y);
 			break;
 
 		case Bottom:
 			_name += "_bottom";
-			for (Mesh::Iterator it = mesh.vertexIterator(); it.is_good(); it.next())
-			{
-				Triangle tri = it.get();
-				drawTriangle(tri.vertex[0] - mesh.getMin(), tri.vertex[1] - mesh.getMin(), tri.vertex[2] - mesh.getMin(),
-						 Image::x_less_than_y);
-			}
+			drawMesh(mesh, toPixels, Image::x_less_than_y);
 			assert(fabs(_minColor) < 1.);
-			dilate(dilationValue, Image::x_less_than_y);
+			rebuildSpans();
+			dilate(radius, dilationValue, Image::x_less_than_y);
 			break;
 
 		default:
@@ -92,37 +137,89 @@ Image::Image(const Mesh& mesh, Mode mode, unsigned dilationValue) :
     }		
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-Image::~Image()
-{
-	delete [] _data;
-	delete [] _alpha;
-}
-
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Image::clear()
 {	
-	memset(_alpha, 0, _height * _width);
+	memset(_alpha.get(), 0, numPixels());
 	_minColor = INFINITY;
 	_maxColor = -INFINITY;
+	_spans.clear();
+	_rowSpans.assign(_height + 1, 0);
+	_bounds = QRect();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Image::setAllPixelsTo(ColorType value)
 {
 	_maxColor = _minColor = value;
-	size_t numPixels = _height * _width;
-	for (unsigned i = 0; i < numPixels; i++)
-		_data[i] = value;
+	ImageKernels::fill(_data.get(), numPixels(), value);
+	memset(_alpha.get(), 1, numPixels());
 
-	memset(_alpha, 1, numPixels);
+	// every row is a single span covering the whole width
+	_spans.resize(_height);
+	_rowSpans.resize(_height + 1);
+	for (quint32 y = 0; y < _height; y++)
+	{
+		Span span = {0, _width};
+		_spans[y] = span;
+		_rowSpans[y] = y;
+	}
+	_rowSpans[_height] = _height;
+	_bounds = QRect(0, 0, _width, _height);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Collects the runs of set pixels of every row and the alpha bounding box. Must be called after
+/// the image was modified pixel by pixel (drawTriangle(), setPixel()), the bulk operations keep
+/// the spans up to date by themselves.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Image::rebuildSpans()
+{
+	_spans.clear();
+	_rowSpans.resize(_height + 1);
+
+	quint32 min_x = _width, max_x = 0, min_y = _height, max_y = 0;
+	for (quint32 y = 0; y < _height; y++)
+	{
+		_rowSpans[y] = _spans.size();
+		const unsigned char* row = &_alpha[index(0, y)];
+		quint32 x = 0;
+		while (x < _width)
+		{
+			if (not row[x])
+			{
+				x++;
+				continue;
+			}
+
+			Span span;
+			span.begin = x;
+			while (x < _width and row[x])
+				x++;
+			span.end = x;
+			_spans.push_back(span);
+
+			min_x = std::min(min_x, span.begin);
+			max_x = std::max(max_x, span.end);
+			min_y = std::min(min_y, y);
+			max_y = std::max(max_y, y);
+		}
+	}
+	_rowSpans[_height] = _spans.size();
+
+	if (_spans.empty())
+		_bounds = QRect();
+	else
+		_bounds = QRect(min_x, min_y, max_x - min_x, max_y - min_y + 1);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Image::setPixel(quint32 x, quint32 y, ColorType color)
 {
 	assert(x < _width and y < _height);
-	quint32 idx = y * _width + x;
+	size_t idx = index(x, y);
 	_data[idx] = color;
 	_alpha[idx] = 1;
 	_minColor = std::min(_minColor, color);
@@ -134,29 +231,24 @@ QImage Image::toQImage() const
 {	
 	assert(_maxColor >= _minColor);
     QImage image(_width, _height, QImage::Format_RGB888);
+	image.fill(QColor(59, 110, 165));
 
 	float colorStep = 0;
 	if(_maxColor != _minColor)
 		colorStep = 255. / (_maxColor - _minColor);
 
-    for (unsigned x = 0; x < _width; x++)
-    {
-        for (unsigned y = 0; y < _height; y++)
-        {
-			unsigned idx = y * _width + x;
-			unsigned rgbColor;
-			if (_alpha[idx])
+	for (int y = _bounds.top(); y <= _bounds.bottom(); y++)
+	{
+		for (const Span* span = spansBegin(y); span != spansEnd(y); ++span)
+		{
+			for (quint32 x = span->begin; x < span->end; x++)
 			{
-				int color8 = (_data[idx] - _minColor) * colorStep;
+				int color8 = (_data[index(x, y)] - _minColor) * colorStep;
 				assert(color8 >= 0 and color8 < 256);
-				rgbColor =  (color8 << 16) | (color8 << 8) | color8;
+				image.setPixel(x, y, (color8 << 16) | (color8 << 8) | color8);
 			}
-			else
-				rgbColor = (59U << 16) | (110U << 8) | (165U);
-
-            image.setPixel(x, y, rgbColor);
-        }
-    }
+		}
+	}
 
     return image;
 }
@@ -173,23 +265,39 @@ bool Image::x_greater_y(ColorType imageZ, ColorType newZ)
     return imageZ > newZ;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned Image::dilationRadius(unsigned dilationValue, float pixelSize)
+{
+	return (unsigned)(dilationValue / pixelSize + 0.5);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Image::insertAt(quint32 x, quint32 y, quint32 z, const Image &other)
+{
+	insertAt(x, y, z, other.region());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Image::insertAt(quint32 x, quint32 y, quint32 z, const ImageRegion& other)
 {
 	if ((x + other.getWidth() > _width) or (y + other.getHeight() > _height))
 		THROW(ImageException, "images overlap");
 
-	for (quint32 other_y = 0; other_y < other.getHeight(); other_y++)
+	bool newPixels = false;
+	QRect bounds = other.getBounds();
+	for (int other_y = bounds.top(); other_y <= bounds.bottom(); other_y++)
 	{
-		for (quint32 other_x = 0; other_x < other.getWidth(); other_x++)
+		const ColorType* src = other.row(other_y);
+		other.forEachSpan(other_y, [&](quint32 begin, quint32 end)
 		{
-			if (other.hasPixelAt(other_x, other_y))
-			{
-				ColorType other_z = other.at(other_x, other_y);
-				setPixel(x + other_x, y + other_y, z + other_z);
-			}
-		}
+			size_t idx = index(x + begin, y + other_y);
+			newPixels |= ImageKernels::maxMerge(&_data[idx], &_alpha[idx], src + begin, end - begin, z, _minColor, _maxColor);
+		});
 	}
+
+	// the base image is usually covered completely, so the spans only change on the first inserts.
+	if (newPixels)
+		rebuildSpans();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -198,46 +306,53 @@ Image::offset_info Image::findMinZDistanceAt(quint32 current_x, quint32 current_
 	if ((current_x + bottom->getWidth() > _width) or (current_y + bottom->getHeight() > _height))
 		THROW(ImageException, "images overlap");
 
+	return findMinZDistance(select(current_x, current_y, bottom->getWidth(), bottom->getHeight()), bottom->region(), threshold);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Smallest distance between the set pixels of bottom and the base view below them. Only the spans of
+/// the bottom view are visited, empty corners and holes are skipped. With ENABLE_EARLY_TERMINATION the
+/// search stops at the first span whose minimum is below threshold.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image::offset_info Image::findMinZDistance(const ImageRegion& base, const ImageRegion& bottom, ColorType threshold)
+{
+	assert(base.getWidth() == bottom.getWidth() and base.getHeight() == bottom.getHeight());
+
 	Image::ColorType min_z = INFINITY;
 	quint32 min_x = 0;
 	quint32 min_y = 0;
 	bool early_rejection = false;
 
-	// TODO : use SSE
-	for (quint32 y = 0; y < bottom->getHeight(); y++)
+	QRect bounds = bottom.getBounds();
+	for (quint32 y = bounds.top(); (int)y <= bounds.bottom() and not early_rejection; y++)
 	{
-		for (quint32 x = 0; x < bottom->getWidth(); x++)
+		const ColorType* bottomRow = bottom.row(y);
+		const ColorType* baseRow = base.row(y);
+		bottom.forEachSpan(y, [&](quint32 begin, quint32 end)
 		{
-			//if (hasPixelAt(current_x + x, current_y + y) and // base image has pixels everywhere
-			if(bottom->hasPixelAt(x, y))
-			{
-				Image::ColorType z_diff = bottom->at(x, y) - at(current_x + x, current_y + y);
-
-				#ifdef ENABLE_EARLY_TERMINATION
-				if (z_diff < threshold)
-				{
-					early_rejection = true;
-					min_z = z_diff;
-					min_x = x;
-					min_y = y;
-					goto out;
-				}
-				#endif
+			if (early_rejection)
+				return;
 
-				if (z_diff < min_z)
-				{
-					min_z = z_diff;
-					min_x = x;
-					min_y = y;
-				}
+			size_t idx = ImageKernels::minDiff(bottomRow + begin, baseRow + begin, end - begin, min_z);
+			if (idx != end - begin)
+			{
+				min_x = begin + idx;
+				min_y = y;
 			}
-		}
+
+			#ifdef ENABLE_EARLY_TERMINATION
+			if (min_z < threshold)
+				early_rejection = true;
+			#else
+			Q_UNUSED(threshold);
+			#endif
+		});
 	}
 
 	assert(min_z != INFINITY && "impossible since at least base image has minimum height everywhere." );
 
-out:	
-
 	offset_info info = {min_x, min_y, min_z, early_rejection};
 	return info;
 }
@@ -247,15 +362,7 @@ void Image::recalcMinMax()
 {
 	_minColor = INFINITY;
 	_maxColor = -INFINITY;
-
-	for (quint32 i = 0; i < (_width * _height); i++)
-	{
-		if (_alpha[i])
-		{
-			_minColor = std::min(_minColor, _data[i]);
-			_maxColor = std::max(_maxColor, _data[i]);
-		}
-	}
+	ImageKernels::minMax(_data.get(), _alpha.get(), numPixels(), _minColor, _maxColor);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -266,36 +373,41 @@ static inline bool circlePredicate(int x, int y, unsigned radius2)
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-void Image::dilate(int dilationValue, bool (&compare)(ColorType, ColorType))
+///
+/// Grows the image by a circle of radius pixels, the grown pixels are raised (or lowered for the
+/// bottom image) by height mesh units.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Image::dilate(unsigned radius, ColorType height, bool (&compare)(ColorType, ColorType))
 {
-	if (dilationValue == 0)
+	if (radius == 0)
 		return;
 
-	//Image newImage(dilationValue * 2 + _width, dilationValue * 2 + _height, clearColor);
-	Image newImage(dilationValue * 2 + _width, dilationValue * 2 + _height);
-	unsigned dilation2 = dilationValue * dilationValue;
+	// the buffers of the temporary image come from the BufferPool and the old ones go back to it.
+	Image newImage(radius * 2 + _width, radius * 2 + _height);
+	unsigned dilation2 = radius * radius;
 
-	for (quint32 x = 0; x < _width; x++)
+	for (quint32 y = 0; y < _height; y++)
 	{
-		for (quint32 y = 0; y < _height; y++)
-		{			
-			if (hasPixelAt(x, y))
+		for (const Span* span = spansBegin(y); span != spansEnd(y); ++span)
+		{
+			for (quint32 x = span->begin; x < span->end; x++)
 			{
 				ColorType color = at(x, y);
 				ColorType newColor;
 				if (compare == x_greater_y)
-					newColor = color + dilationValue;
+					newColor = color + height;
 				else if (compare == x_less_than_y)
-					newColor = color - dilationValue;
+					newColor = color - height;
 				else
 					THROW(ImageException, "unknown compare func.");
 
-				for (int dil_y = -(int)dilationValue; dil_y < (int)dilationValue; dil_y++)
+				for (int dil_y = -(int)radius; dil_y < (int)radius; dil_y++)
 				{
-					for (int dil_x = -(int)dilationValue; dil_x < (int)dilationValue; dil_x++)
+					for (int dil_x = -(int)radius; dil_x < (int)radius; dil_x++)
 					{
-						int new_x = (int)x + (int)dilationValue + dil_x;
-						int new_y = (int)y + (int)dilationValue + dil_y;
+						int new_x = (int)x + (int)radius + dil_x;
+						int new_y = (int)y + (int)radius + dil_y;
 						if (	circlePredicate(dil_x, dil_y, dilation2) and // inside a circle
 								(not newImage.hasPixelAt(new_x, new_y) or // no pixel at this place
 								 compare(newColor, newImage.at(new_x, new_y)))) // new pixel is better
@@ -314,59 +426,25 @@ void Image::dilate(int dilationValue, bool (&compare)(ColorType, ColorType))
 	_height = newImage._height;
 	_minColor = newImage._minColor;
 	_maxColor = newImage._maxColor;
+	rebuildSpans();
 }
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Image* Image::clockwizeRotate90(unsigned times) const
+Image Image::clockwizeRotate90(unsigned times) const
 {
 	times = times % 4;
 	if (times == 0)
-		return new Image(*this);
+		return Image(*this);
 
+	Image new_image = ((times == 2) ? Image(_width, _height) :  Image(_height, _width));
+	new_image._pixelSize = _pixelSize;
+	new_image._minColor = _minColor;
+	new_image._maxColor = _maxColor;
 
-	Image* new_image = ((times == 2) ? new Image(_width, _height) :  new Image(_height, _width));
-	auto_ptr<Image> guard(new_image);
-
-	std::function<void (quint32, quint32, ColorType)> mapper;
-	switch(times)
-	{
-		case 1:
-			mapper = [new_image](quint32 x, quint32 y, ColorType value)
-			{
-				new_image->setPixel((new_image->_width - 1) - y, x, value);
-			};
-			break;
-
-		case 2:
-			mapper = [new_image](quint32 x, quint32 y, ColorType value)
-			{
-				new_image->setPixel((new_image->_width - 1) - x, (new_image->_height - 1) - y, value);
-			};
-			break;
-
-		case 3:
-			mapper = [new_image](quint32 x, quint32 y, ColorType value)
-			{
-				new_image->setPixel(y, (new_image->_height - 1) - x, value);
-			};
-			break;
-
-		default:
-			assert(0 && "should not happen");
-	}
-
-
-	for (quint32 y = 0; y < _height; y++)
-	{
-		for (quint32 x = 0; x < _width; x++)
-		{
-			if (hasPixelAt(x, y))
-				mapper(x, y, at(x, y));
-		}
-	}
-
-	guard.release();
+	ImageKernels::rotate90(_data.get(), new_image._data.get(), _width, _height, times);
+	ImageKernels::rotate90(_alpha.get(), new_image._alpha.get(), _width, _height, times);
+	new_image.rebuildSpans();
 
 	return new_image;
 }
@@ -374,14 +452,16 @@ Image* Image::clockwizeRotate90(unsigned times) const
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Image::flipHorizontal()
 {
+	std::vector<ColorType> row(_width);
+	std::vector<unsigned char> alphaRow(_width);
 	for (unsigned y = 0; y < _height; y++)
 	{
-		for (unsigned x = 0; x < (_width / 2); x++)
-		{
-			std::swap(_data[y * _width + x], _data[y * _width + (_width - x - 1)]);
-			std::swap(_alpha[y * _width + x], _alpha[y * _width + (_width - x - 1)]);
-		}
+		ImageKernels::reverseCopy(&_data[index(0, y)], &row[0], _width);
+		ImageKernels::reverseCopy(&_alpha[index(0, y)], &alphaRow[0], _width);
+		memcpy(&_data[index(0, y)], &row[0], _width * sizeof(ColorType));
+		memcpy(&_alpha[index(0, y)], &alphaRow[0], _width);
 	}
+	rebuildSpans();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -389,11 +469,26 @@ void Image::flipVertical()
 {
 	for (unsigned y = 0; y < (_height / 2); y++)
 	{
-		for (unsigned x = 0; x < _width; x++)
-		{
-			std::swap(_data[y * _width + x], _data[(_height - y - 1) * _width + x]);
-			std::swap(_alpha[y * _width + x], _alpha[(_height - y - 1) * _width + x]);
-		}
+		std::swap_ranges(&_data[index(0, y)], &_data[index(0, y)] + _width, &_data[index(0, _height - y - 1)]);
+		std::swap_ranges(&_alpha[index(0, y)], &_alpha[index(0, y)] + _width, &_alpha[index(0, _height - y - 1)]);
+	}
+	rebuildSpans();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Rasterizes all triangles of mesh, moved to its minimum and scaled by toPixels. The triangles are
+/// fetched in batches, which are transformed to pixel space in one go.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Image::drawMesh(const Mesh& mesh, QVector3D toPixels, bool (&compare)(ColorType, ColorType))
+{
+	TriangleBatch batch;
+	for (size_t first = 0; mesh.gatherTriangles(first, batch) > 0; first += batch.count)
+	{
+		batch.transform(mesh.getMin(), toPixels);
+		for (unsigned i = 0; i < batch.count; i++)
+			drawTriangle(batch.vertex(i, 0), batch.vertex(i, 1), batch.vertex(i, 2), compare);
 	}
 }
 
@@ -511,71 +606,106 @@ void Image::drawTriangle(QVector3D fa, QVector3D fb, QVector3D fc, bool (&compar
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Image* Image::operator -(const ImageRegion& other)
+RegionExpression Image::operator -(const ImageRegion& other) const
 {
-	assert(_width == other.getWidth());
-	assert(_height == other.getHeight());
+	return region() - other;
+}
 
-	Image* img = new Image(_width, _height);
-	size_t numPixels = _width * _height;
-	memcpy(img->_data, _data, numPixels * sizeof(_data[0]));
-	memcpy(img->_alpha, _alpha, numPixels * sizeof(_alpha[0]));
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image::ColorType Image::diffSum(const Image &other) const
+{
+	return region().diffSum(other.region());
+}
 
-	for (quint32 y = 0; y < _height; y++)
-	{
-		for (quint32 x = 0; x < _width; x++)
-		{
-			Image::ColorType color = other.at(x, y);
-			img->_minColor = std::min(img->_minColor, color);
-			img->_maxColor = std::min(img->_maxColor, color);
-			img->_data[y * _width + x] -= color;
-		}
-	}
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+ImageRegion	Image::select(quint32 x, quint32 y, quint32 width, quint32 height) const
+{
+	assert(x + width <= _width and y + height <= _height);
+	ImageRegion region(&_data[index(x, y)], &_alpha[index(x, y)], _width, width, height);
+	region._parent = this;
+	region._x = x;
+	region._y = y;
+	return region;
+}
 
-	return img;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+ImageRegion Image::region() const
+{
+	return select(0, 0, _width, _height);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Image::ColorType Image::diffSum(const Image &other) const
+ImageRegion::ImageRegion(const ColorType* data, const unsigned char* alpha, size_t stride, quint32 width, quint32 height) :
+	_data(data),
+	_alpha(alpha),
+	_stride(stride),
+	_width(width),
+	_height(height),
+	_parent(0),
+	_x(0),
+	_y(0)
 {
-	double result = 0;
-	for (quint32 y = 0; y < _height; y++)
-	{
-		for (quint32 x = 0; x < _width; x++)
-		{
-			if (hasPixelAt(x, y) and other.hasPixelAt(x, y))
-				result += at(x, y) - other.at(x, y);
-		}
-	}
-	return result;
+	assert(width <= stride);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-ImageRegion	Image::select(quint32 x, quint32 y, quint32 width, quint32 height)
+ImageRegion ImageRegion::select(quint32 x, quint32 y, quint32 width, quint32 height) const
 {
-	assert(x < width and y < height and width <= _width and height <= _height);
-	return ImageRegion(this, x, y, width, height);
+	assert(x + width <= _width and y + height <= _height);
+	ImageRegion region(row(y) + x, _alpha ? alphaRow(y) + x : 0, _stride, width, height);
+	region._parent = _parent;
+	region._x = _x + x;
+	region._y = _y + y;
+	return region;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-ImageRegion::ImageRegion(const Image* parent, quint32 x, quint32 y, quint32 width, quint32 height) :
-	_parent(parent), _x(x), _y(y), _width(width), _height(height)
+QRect ImageRegion::getBounds() const
 {
+	QRect view(0, 0, _width, _height);
+	if (not _parent)
+		return view;
+	return _parent->getBounds().translated(-(int)_x, -(int)_y).intersected(view);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Image* ImageRegion::operator +(const Image* other)
+///
+/// Sum of the differences to other over the set pixels of this view, pixels which are not set in
+/// other are skipped.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+ImageRegion::ColorType ImageRegion::diffSum(const ImageRegion& other) const
 {
-	Image* img = new Image(_width, _height);
-	for (unsigned y = 0; y < _height; y++)
+	assert(_width == other.getWidth() and _height == other.getHeight());
+
+	double result = 0;
+	QRect bounds = getBounds();
+	for (int y = bounds.top(); y <= bounds.bottom(); y++)
 	{
-		for (unsigned x = 0; x < _width; x++)
+		const ColorType* a = row(y);
+		const ColorType* b = other.row(y);
+		const unsigned char* bAlpha = other.alphaRow(y);
+		forEachSpan(y, [&](quint32 begin, quint32 end)
 		{
-			Image::ColorType color = other->at(x, y);
-			img->_minColor = std::min(img->_minColor, color);
-			img->_maxColor = std::min(img->_maxColor, color);
-			img->setPixel(x, y, _parent->at(_x + x, _y + y) + color);
-		}
+			if (bAlpha)
+				result += ImageKernels::diffSum(a + begin, b + begin, bAlpha + begin, end - begin);
+			else
+				result += ImageKernels::diffSum(a + begin, b + begin, end - begin);
+		});
 	}
-	return img;
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+RegionExpression ImageRegion::operator +(const ImageRegion& other) const
+{
+	assert(_width == other.getWidth() and _height == other.getHeight());
+	return RegionExpression(*this, other, 1.f);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+RegionExpression ImageRegion::operator -(const ImageRegion& other) const
+{
+	assert(_width == other.getWidth() and _height == other.getHeight());
+	return RegionExpression(*this, other, -1.f);
 }
@@ -1,9 +1,13 @@
 #pragma once
 #include <QImage>
+#include <QRect>
 #include "Mesh.h"
+#include "BufferPool.h"
 #include <vector>
+#include <algorithm>
 
 class ImageRegion;
+class RegionExpression;
 class Image
 {    
 
@@ -18,13 +22,23 @@ public:
 
 	typedef float ColorType;
 
+	/// a run of set pixels [begin, end) inside a single row.
+	struct Span
+	{
+		quint32 begin;
+		quint32 end;
+	};
+
 	static bool x_less_than_y(ColorType imageZ, ColorType newZ);
 	static bool x_greater_y(ColorType imageZ, ColorType newZ);
+	static unsigned dilationRadius(unsigned dilationValue, float pixelSize); /// dilation in pixels.
 
 	Image(const Image& other);
-	Image(const Mesh &mesh, Mode mode, unsigned dilationValue = 0);
+	Image(Image&& other) = default;
+	Image& operator=(Image&& other) = default;
+	Image(const Mesh &mesh, Mode mode, unsigned dilationValue = 0, float pixelSize = 1.);
 	Image(quint32 width, quint32 height);	
-	~Image();
+	Image(const RegionExpression& expression); /// evaluates a lazy region sum or difference.
 
 	void				clear();
 	void				setAllPixelsTo(ColorType value);
@@ -32,13 +46,19 @@ public:
 	inline quint32		getWidth() const { return _width; }
 	inline quint32		getHeight() const { return _height; }	
 	inline QString		getName() const { return _name; }
-	inline ColorType	at(quint32 x, quint32 y) const { return _data[y * _width + x]; }
+	inline float		getPixelSize() const { return _pixelSize; } /// edge of a pixel in mesh units.
+	inline ColorType	at(quint32 x, quint32 y) const { return _data[index(x, y)]; }
 	inline ColorType	maxColor() const { return _maxColor; }
 	inline ColorType	minColor() const { return _minColor; }
-	inline bool			hasPixelAt(quint32 x, quint32 y) const { return _alpha[y * _width + x]; }
+	inline bool			hasPixelAt(quint32 x, quint32 y) const { return _alpha[index(x, y)]; }
 	inline bool			pixelIsInside(long x, long y) const { return (x >= 0) and (x < (int)_width) and (y >= 0) and (y < (int)_height); }
+	inline QRect		getBounds() const { return _bounds; } /// tight bounding box of all set pixels.
+	inline const Span*	spansBegin(quint32 y) const { return _spans.data() + _rowSpans[y]; }
+	inline const Span*	spansEnd(quint32 y) const { return _spans.data() + _rowSpans[y + 1]; }
+	void				rebuildSpans();
 	QImage				toQImage() const;
 	void				insertAt(quint32 x, quint32 y, quint32 z, const Image& other);
+	void				insertAt(quint32 x, quint32 y, quint32 z, const ImageRegion& other);
 	ColorType			diffSum(const Image& other) const;
 
 	struct offset_info
@@ -50,48 +70,155 @@ public:
 	};
 
 	offset_info		findMinZDistanceAt(quint32 current_x, quint32 current_y, const Image *bottom, ColorType threshold) const;
+	static offset_info findMinZDistance(const ImageRegion& base, const ImageRegion& bottom, ColorType threshold);
 	void			recalcMinMax();
 	void			drawTriangle(QVector3D fa, QVector3D fb, QVector3D fc, bool (&compare)(ColorType, ColorType));
-	void			dilate(int dilationValue, bool (&compare)(ColorType, ColorType));
-	Image*			clockwizeRotate90(unsigned times = 1) const;
+	void			drawMesh(const Mesh& mesh, QVector3D toPixels, bool (&compare)(ColorType, ColorType));
+	void			dilate(unsigned radius, ColorType height, bool (&compare)(ColorType, ColorType));
+	Image			clockwizeRotate90(unsigned times = 1) const;
 	void			flipHorizontal();
 	void			flipVertical();
 
-	ImageRegion		select(quint32 x, quint32 y, quint32 width, quint32 height);
-	Image*			operator-(const ImageRegion& imgregion);
+	ImageRegion		select(quint32 x, quint32 y, quint32 width, quint32 height) const;
+	ImageRegion		region() const; /// view of the whole image.
+	RegionExpression operator-(const ImageRegion& imgregion) const;
 
 private:
 
-	float*				_data;		/// raw pixel data
-	unsigned char*		_alpha;		/// an array that denotes if a pixel was set.
+	/// 64 bit offset of the pixel (x, y), big build boxes overflow 32 bit.
+	inline size_t		index(quint32 x, quint32 y) const { return (size_t)y * _width + x; }
+	inline size_t		numPixels() const { return (size_t)_width * _height; }
+
+	PooledArray<ColorType>		_data;	/// raw pixel data
+	PooledArray<unsigned char>	_alpha;	/// an array that denotes if a pixel was set.
 	quint32				_width;		/// image width
 	quint32				_height;	/// image height
 	float				_minColor;	/// miminum color of this image
 	float				_maxColor;	/// maximum color of this image
 	QString				_name;		/// image name
+	float				_pixelSize;	/// edge of a pixel in mesh units.
+	std::vector<Span>	_spans;		/// runs of set pixels, row after row.
+	std::vector<quint32> _rowSpans;	/// spans of row y are _spans[_rowSpans[y]] .. _spans[_rowSpans[y + 1]]
+	QRect				_bounds;	/// alpha bounding box, empty if no pixel is set.
 
 	friend class ImageRegion;
+	friend class HeightmapCache;
 };
 
+/**
+ * Non-owning, strided view of a rectangle of pixels. A view is as cheap to copy as a pointer, the pixels
+ * stay owned by the Image or base image tile it was taken from, which must outlive the view.
+ *	@param data: first pixel of the view.
+ *	@param alpha: alpha of the first pixel, 0 if all pixels of the view are set.
+ *	@param stride: distance between two rows in pixels.
+ */
 class ImageRegion
 {
 public:
 	friend class Image;
 
-	Image* operator+(const Image* other);
+	typedef Image::ColorType ColorType;
+
+	ImageRegion(const ColorType* data, const unsigned char* alpha, size_t stride, quint32 width, quint32 height);
 
-	unsigned x() const { return _x; }
-	unsigned y() const { return _y; }
-	unsigned getWidth() const { return _width; }
-	unsigned getHeight() const { return _height; }
-	Image::ColorType at(quint32 x, quint32 y) const { return _parent->at(x, y); }
+	inline quint32		x() const { return _x; } /// offset of the view inside of its image.
+	inline quint32		y() const { return _y; }
+	inline quint32		getWidth() const { return _width; }
+	inline quint32		getHeight() const { return _height; }
+	inline size_t		getStride() const { return _stride; }
+	inline const ColorType*		row(quint32 y) const { return _data + y * _stride; }
+	inline const unsigned char*	alphaRow(quint32 y) const { return _alpha ? _alpha + y * _stride : 0; }
+	inline ColorType	at(quint32 x, quint32 y) const { return row(y)[x]; }
+	inline bool			hasPixelAt(quint32 x, quint32 y) const { return not _alpha or alphaRow(y)[x]; }
+	QRect				getBounds() const; /// bounding box of the set pixels in view coordinates.
+	ImageRegion			select(quint32 x, quint32 y, quint32 width, quint32 height) const;
+	ColorType			diffSum(const ImageRegion& other) const;
+
+	/// calls f(begin, end) for every run of set pixels in row y of the view.
+	template<class F>
+	void forEachSpan(quint32 y, F f) const;
+
+	RegionExpression	operator+(const ImageRegion& other) const;
+	RegionExpression	operator-(const ImageRegion& other) const;
 
 private:
 
+	const ColorType*		_data;
+	const unsigned char*	_alpha;
+	size_t					_stride;
+	quint32					_width;
+	quint32					_height;
+	const Image*			_parent;	/// image whose spans are used, 0 for views of raw buffers.
+	quint32					_x, _y;		/// offset of the view inside of _parent.
+};
+
+/**
+ * Sum or difference of two equally sized regions. Nothing is computed until the expression is stored
+ * into an Image, pixels which are not set count as 0.
+ */
+class RegionExpression
+{
+public:
 
-	const Image* _parent;
-	unsigned _x, _y, _width, _height;
+	inline RegionExpression(const ImageRegion& left, const ImageRegion& right, float sign) :
+		_left(left), _right(right), _sign(sign) {}
 
-	ImageRegion(const Image* parent, quint32 x, quint32 y, quint32 width, quint32 height);
+	inline const ImageRegion&	left() const { return _left; }
+	inline const ImageRegion&	right() const { return _right; }
+	inline float				sign() const { return _sign; } /// 1 for a sum, -1 for a difference.
+	inline quint32				getWidth() const { return _left.getWidth(); }
+	inline quint32				getHeight() const { return _left.getHeight(); }
+
+	inline Image::ColorType at(quint32 x, quint32 y) const
+	{
+		return (_left.hasPixelAt(x, y) ? _left.at(x, y) : 0.f) + _sign * (_right.hasPixelAt(x, y) ? _right.at(x, y) : 0.f);
+	}
+
+private:
+
+	ImageRegion	_left;
+	ImageRegion	_right;
+	float		_sign;
 };
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Views of an Image use its spans, which have to be up to date. Views of raw buffers scan the alpha
+/// row, or report the whole row if they have no alpha.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class F>
+void ImageRegion::forEachSpan(quint32 y, F f) const
+{
+	if (_parent)
+	{
+		quint32 end_x = _x + _width;
+		for (const Image::Span* span = _parent->spansBegin(_y + y); span != _parent->spansEnd(_y + y); ++span)
+		{
+			quint32 begin = std::max(span->begin, _x);
+			quint32 end = std::min(span->end, end_x);
+			if (begin < end)
+				f(begin - _x, end - _x);
+		}
+	}
+	else if (_alpha)
+	{
+		const unsigned char* alpha = alphaRow(y);
+		quint32 x = 0;
+		while (x < _width)
+		{
+			if (not alpha[x])
+			{
+				x++;
+				continue;
+			}
+			quint32 begin = x;
+			while (x < _width and alpha[x])
+				x++;
+			f(begin, x);
+		}
+	}
+	else
+		f(0, _width);
+}
+
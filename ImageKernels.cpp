@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include "ImageKernels.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// edge of the square blocks the rotations work on, 32 x 32 floats fit well into L1.
+static const size_t ROTATE_BLOCK = 32;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// index of the pixel (x, y) of a width x height image after rotating it by times * 90 degrees.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline size_t rotatedIndex(size_t x, size_t y, size_t width, size_t height, unsigned times)
+{
+	switch (times)
+	{
+		case 1: return x * height + (height - 1 - y);
+		case 2: return (height - 1 - y) * width + (width - 1 - x);
+		case 3: return (width - 1 - x) * height + y;
+		default: return y * width + x;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+static void rotateNaive(const T* src, T* dst, size_t width, size_t height, unsigned times)
+{
+	for (size_t y = 0; y < height; y++)
+		for (size_t x = 0; x < width; x++)
+			dst[rotatedIndex(x, y, width, height, times)] = src[y * width + x];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+static void rotateBlocked(const T* src, T* dst, size_t width, size_t height, unsigned times)
+{
+	for (size_t by = 0; by < height; by += ROTATE_BLOCK)
+	{
+		size_t ey = std::min(by + ROTATE_BLOCK, height);
+		for (size_t bx = 0; bx < width; bx += ROTATE_BLOCK)
+		{
+			size_t ex = std::min(bx + ROTATE_BLOCK, width);
+			for (size_t y = by; y < ey; y++)
+				for (size_t x = bx; x < ex; x++)
+					dst[rotatedIndex(x, y, width, height, times)] = src[y * width + x];
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// scalar reference implementations
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::fill(float* dst, size_t n, float value)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = value;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool ImageKernels::scalar::maxMerge(float* dst, unsigned char* dstAlpha, const float* src, size_t n, float z, float& minValue, float& maxValue)
+{
+	bool newPixels = false;
+	for (size_t i = 0; i < n; i++)
+	{
+		float color = src[i] + z;
+		if (dstAlpha[i])
+			color = std::max(color, dst[i]);
+		else
+			newPixels = true;
+
+		dst[i] = color;
+		dstAlpha[i] = 1;
+		minValue = std::min(minValue, color);
+		maxValue = std::max(maxValue, color);
+	}
+	return newPixels;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::minMax(const float* data, const unsigned char* alpha, size_t n, float& minValue, float& maxValue)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (alpha[i])
+		{
+			minValue = std::min(minValue, data[i]);
+			maxValue = std::max(maxValue, data[i]);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+double ImageKernels::scalar::diffSum(const float* a, const float* b, const unsigned char* bAlpha, size_t n)
+{
+	double result = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (bAlpha[i])
+			result += a[i] - b[i];
+	}
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+double ImageKernels::scalar::diffSum(const float* a, const float* b, size_t n)
+{
+	double result = 0;
+	for (size_t i = 0; i < n; i++)
+		result += a[i] - b[i];
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t ImageKernels::scalar::minDiff(const float* a, const float* b, size_t n, float& minValue)
+{
+	size_t result = n;
+	for (size_t i = 0; i < n; i++)
+	{
+		float diff = a[i] - b[i];
+		if (diff < minValue)
+		{
+			minValue = diff;
+			result = i;
+		}
+	}
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::combine(const float* a, const unsigned char* aAlpha, const float* b, const unsigned char* bAlpha,
+								   float sign, float* dst, unsigned char* dstAlpha, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		dst[i] = (aAlpha[i] ? a[i] : 0.f) + sign * (bAlpha[i] ? b[i] : 0.f);
+		dstAlpha[i] = aAlpha[i] or bAlpha[i];
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::reverseCopy(const float* src, float* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = src[n - 1 - i];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::reverseCopy(const unsigned char* src, unsigned char* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = src[n - 1 - i];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::rotate90(const float* src, float* dst, size_t width, size_t height, unsigned times)
+{
+	rotateNaive(src, dst, width, height, times % 4);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::scalar::rotate90(const unsigned char* src, unsigned char* dst, size_t width, size_t height, unsigned times)
+{
+	rotateNaive(src, dst, width, height, times % 4);
+}
+
+#ifdef __SSE2__
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE implementations
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// all bits set in the lanes whose alpha byte is not zero.
+static inline __m128 alphaMask(const unsigned char* alpha)
+{
+	int bytes;
+	memcpy(&bytes, alpha, sizeof(bytes));
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+	return _mm_castsi128_ps(_mm_cmpgt_epi32(v, zero));
+}
+
+/// mask ? a : b
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 reversed(__m128 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static inline float horizontalMin(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMax(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::fill(float* dst, size_t n, float value)
+{
+	__m128 v = _mm_set1_ps(value);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, v);
+	scalar::fill(dst + i, n - i, value);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool ImageKernels::maxMerge(float* dst, unsigned char* dstAlpha, const float* src, size_t n, float z, float& minValue, float& maxValue)
+{
+	__m128 vz = _mm_set1_ps(z);
+	__m128 vmin = _mm_set1_ps(minValue);
+	__m128 vmax = _mm_set1_ps(maxValue);
+	int allSet = 0xF;
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 color = _mm_add_ps(_mm_loadu_ps(src + i), vz);
+		__m128 set = alphaMask(dstAlpha + i);
+		color = select(set, _mm_max_ps(_mm_loadu_ps(dst + i), color), color);
+		allSet &= _mm_movemask_ps(set);
+		_mm_storeu_ps(dst + i, color);
+		vmin = _mm_min_ps(vmin, color);
+		vmax = _mm_max_ps(vmax, color);
+	}
+	memset(dstAlpha, 1, i);
+
+	minValue = horizontalMin(vmin);
+	maxValue = horizontalMax(vmax);
+	bool tailNewPixels = scalar::maxMerge(dst + i, dstAlpha + i, src + i, n - i, z, minValue, maxValue);
+	return (allSet != 0xF) or tailNewPixels;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::minMax(const float* data, const unsigned char* alpha, size_t n, float& minValue, float& maxValue)
+{
+	__m128 vmin = _mm_set1_ps(minValue);
+	__m128 vmax = _mm_set1_ps(maxValue);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(data + i);
+		__m128 set = alphaMask(alpha + i);
+		vmin = _mm_min_ps(vmin, select(set, v, vmin));
+		vmax = _mm_max_ps(vmax, select(set, v, vmax));
+	}
+
+	minValue = horizontalMin(vmin);
+	maxValue = horizontalMax(vmax);
+	scalar::minMax(data + i, alpha + i, n - i, minValue, maxValue);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+double ImageKernels::diffSum(const float* a, const float* b, const unsigned char* bAlpha, size_t n)
+{
+	// the differences are computed in float like the scalar version, but summed up in double.
+	__m128d sumLow = _mm_setzero_pd();
+	__m128d sumHigh = _mm_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 diff = _mm_and_ps(alphaMask(bAlpha + i), _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sumLow = _mm_add_pd(sumLow, _mm_cvtps_pd(diff));
+		sumHigh = _mm_add_pd(sumHigh, _mm_cvtps_pd(_mm_movehl_ps(diff, diff)));
+	}
+
+	double sums[2];
+	_mm_storeu_pd(sums, _mm_add_pd(sumLow, sumHigh));
+	return sums[0] + sums[1] + scalar::diffSum(a + i, b + i, bAlpha + i, n - i);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+double ImageKernels::diffSum(const float* a, const float* b, size_t n)
+{
+	__m128d sumLow = _mm_setzero_pd();
+	__m128d sumHigh = _mm_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		sumLow = _mm_add_pd(sumLow, _mm_cvtps_pd(diff));
+		sumHigh = _mm_add_pd(sumHigh, _mm_cvtps_pd(_mm_movehl_ps(diff, diff)));
+	}
+
+	double sums[2];
+	_mm_storeu_pd(sums, _mm_add_pd(sumLow, sumHigh));
+	return sums[0] + sums[1] + scalar::diffSum(a + i, b + i, n - i);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Every lane keeps its own minimum and the index where it first occured. Since the lanes see their
+/// indices in increasing order, the smallest value with the smallest index among the lanes is the first
+/// occurence of the minimum, exactly like in the scalar version.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t ImageKernels::minDiff(const float* a, const float* b, size_t n, float& minValue)
+{
+	assert(n < 0x7FFFFFFF);
+	__m128 vmin = _mm_set1_ps(minValue);
+	__m128i vidx = _mm_set1_epi32(-1);
+	__m128i curr = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i four = _mm_set1_epi32(4);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		__m128 less = _mm_cmplt_ps(diff, vmin);
+		vmin = select(less, diff, vmin);
+		vidx = _mm_castps_si128(select(less, _mm_castsi128_ps(curr), _mm_castsi128_ps(vidx)));
+		curr = _mm_add_epi32(curr, four);
+	}
+
+	float values[4];
+	int indices[4];
+	_mm_storeu_ps(values, vmin);
+	_mm_storeu_si128((__m128i*)indices, vidx);
+
+	size_t result = n;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		// lanes without an index never went below the initial minValue.
+		if (indices[lane] < 0)
+			continue;
+		if (values[lane] < minValue or (values[lane] == minValue and (size_t)indices[lane] < result))
+		{
+			minValue = values[lane];
+			result = indices[lane];
+		}
+	}
+
+	size_t tail = scalar::minDiff(a + i, b + i, n - i, minValue);
+	return (tail != n - i) ? i + tail : result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::combine(const float* a, const unsigned char* aAlpha, const float* b, const unsigned char* bAlpha,
+						   float sign, float* dst, unsigned char* dstAlpha, size_t n)
+{
+	__m128 vsign = _mm_set1_ps(sign);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 va = _mm_and_ps(alphaMask(aAlpha + i), _mm_loadu_ps(a + i));
+		__m128 vb = _mm_and_ps(alphaMask(bAlpha + i), _mm_loadu_ps(b + i));
+		_mm_storeu_ps(dst + i, _mm_add_ps(va, _mm_mul_ps(vsign, vb)));
+		for (size_t j = i; j < i + 4; j++)
+			dstAlpha[j] = aAlpha[j] or bAlpha[j];
+	}
+	scalar::combine(a + i, aAlpha + i, b + i, bAlpha + i, sign, dst + i, dstAlpha + i, n - i);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::reverseCopy(const float* src, float* dst, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + n - 4 - i, reversed(_mm_loadu_ps(src + i)));
+
+	for (; i < n; i++)
+		dst[n - 1 - i] = src[i];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::reverseCopy(const unsigned char* src, unsigned char* dst, size_t n)
+{
+	std::reverse_copy(src, src + n, dst);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Rotation by 90 or 270 degrees is a transposition with reversed rows or columns. The image is
+/// processed in ROTATE_BLOCK sized blocks, each block in 4x4 tiles which are transposed in registers.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::rotate90(const float* src, float* dst, size_t width, size_t height, unsigned times)
+{
+	times %= 4;
+	if (times == 0)
+	{
+		memcpy(dst, src, width * height * sizeof(float));
+		return;
+	}
+	else if (times == 2)
+	{
+		reverseCopy(src, dst, width * height);
+		return;
+	}
+
+	for (size_t by = 0; by < height; by += ROTATE_BLOCK)
+	{
+		size_t ey = std::min(by + ROTATE_BLOCK, height);
+		for (size_t bx = 0; bx < width; bx += ROTATE_BLOCK)
+		{
+			size_t ex = std::min(bx + ROTATE_BLOCK, width);
+			size_t y = by;
+			for (; y + 4 <= ey; y += 4)
+			{
+				size_t x = bx;
+				for (; x + 4 <= ex; x += 4)
+				{
+					const float* s = src + y * width + x;
+					__m128 r0 = _mm_loadu_ps(s);
+					__m128 r1 = _mm_loadu_ps(s + width);
+					__m128 r2 = _mm_loadu_ps(s + 2 * width);
+					__m128 r3 = _mm_loadu_ps(s + 3 * width);
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3); // r<j> holds the column x + j of the rows y .. y + 3
+
+					if (times == 1)
+					{
+						// column x + j becomes row x + j, row y + i becomes column height - 1 - (y + i)
+						float* d = dst + x * height + (height - 4 - y);
+						_mm_storeu_ps(d, reversed(r0));
+						_mm_storeu_ps(d + height, reversed(r1));
+						_mm_storeu_ps(d + 2 * height, reversed(r2));
+						_mm_storeu_ps(d + 3 * height, reversed(r3));
+					}
+					else
+					{
+						// column x + j becomes row width - 1 - (x + j), row y + i becomes column y + i
+						float* d = dst + (width - 1 - x) * height + y;
+						_mm_storeu_ps(d, r0);
+						_mm_storeu_ps(d - height, r1);
+						_mm_storeu_ps(d - 2 * height, r2);
+						_mm_storeu_ps(d - 3 * height, r3);
+					}
+				}
+
+				for (; x < ex; x++)
+					for (size_t i = 0; i < 4; i++)
+						dst[rotatedIndex(x, y + i, width, height, times)] = src[(y + i) * width + x];
+			}
+
+			for (; y < ey; y++)
+				for (size_t x = bx; x < ex; x++)
+					dst[rotatedIndex(x, y, width, height, times)] = src[y * width + x];
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ImageKernels::rotate90(const unsigned char* src, unsigned char* dst, size_t width, size_t height, unsigned times)
+{
+	times %= 4;
+	if (times == 0)
+		memcpy(dst, src, width * height);
+	else if (times == 2)
+		reverseCopy(src, dst, width * height);
+	else
+		rotateBlocked(src, dst, width, height, times);
+}
+
+#else // no SSE2, the scalar versions are used.
+
+void ImageKernels::fill(float* dst, size_t n, float value) { scalar::fill(dst, n, value); }
+bool ImageKernels::maxMerge(float* dst, unsigned char* dstAlpha, const float* src, size_t n, float z, float& minValue, float& maxValue) { return scalar::maxMerge(dst, dstAlpha, src, n, z, minValue, maxValue); }
+void ImageKernels::minMax(const float* data, const unsigned char* alpha, size_t n, float& minValue, float& maxValue) { scalar::minMax(data, alpha, n, minValue, maxValue); }
+double ImageKernels::diffSum(const float* a, const float* b, const unsigned char* bAlpha, size_t n) { return scalar::diffSum(a, b, bAlpha, n); }
+double ImageKernels::diffSum(const float* a, const float* b, size_t n) { return scalar::diffSum(a, b, n); }
+size_t ImageKernels::minDiff(const float* a, const float* b, size_t n, float& minValue) { return scalar::minDiff(a, b, n, minValue); }
+void ImageKernels::combine(const float* a, const unsigned char* aAlpha, const float* b, const unsigned char* bAlpha,
+						   float sign, float* dst, unsigned char* dstAlpha, size_t n) { scalar::combine(a, aAlpha, b, bAlpha, sign, dst, dstAlpha, n); }
+void ImageKernels::reverseCopy(const float* src, float* dst, size_t n) { std::reverse_copy(src, src + n, dst); }
+void ImageKernels::reverseCopy(const unsigned char* src, unsigned char* dst, size_t n) { std::reverse_copy(src, src + n, dst); }
+void ImageKernels::rotate90(const float* src, float* dst, size_t width, size_t height, unsigned times) { rotateBlocked(src, dst, width, height, times % 4); }
+void ImageKernels::rotate90(const unsigned char* src, unsigned char* dst, size_t width, size_t height, unsigned times) { rotateBlocked(src, dst, width, height, times % 4); }
+
+#endif
+
+#ifdef ENABLE_TESTS
+#include <QDebug>
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// compares the optimized kernels against the scalar reference implementations.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void test_image_kernels()
+{
+	const size_t width = 67, height = 41, n = width * height;
+	std::vector<float> data(n), other(n);
+	std::vector<unsigned char> alpha(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		data[i] = (rand() % 20000) / 100.f - 100.f;
+		other[i] = (rand() % 20000) / 100.f - 100.f;
+		alpha[i] = rand() & 1;
+	}
+
+	float min1 = INFINITY, max1 = -INFINITY, min2 = INFINITY, max2 = -INFINITY;
+	ImageKernels::minMax(&data[0], &alpha[0], n, min1, max1);
+	ImageKernels::scalar::minMax(&data[0], &alpha[0], n, min2, max2);
+	assert(min1 == min2 and max1 == max2);
+
+	double sum1 = ImageKernels::diffSum(&data[0], &other[0], &alpha[0], n);
+	double sum2 = ImageKernels::scalar::diffSum(&data[0], &other[0], &alpha[0], n);
+	assert(fabs(sum1 - sum2) < 1e-3 * (1. + fabs(sum2)));
+	sum1 = ImageKernels::diffSum(&data[0], &other[0], n);
+	sum2 = ImageKernels::scalar::diffSum(&data[0], &other[0], n);
+	assert(fabs(sum1 - sum2) < 1e-3 * (1. + fabs(sum2)));
+
+	for (size_t length = 0; length < 40; length++)
+	{
+		float minValue1 = 50.f, minValue2 = 50.f;
+		size_t idx1 = ImageKernels::minDiff(&data[length], &other[0], length * 3, minValue1);
+		size_t idx2 = ImageKernels::scalar::minDiff(&data[length], &other[0], length * 3, minValue2);
+		assert(idx1 == idx2 and minValue1 == minValue2);
+	}
+
+	std::vector<float> combined1(n), combined2(n);
+	std::vector<unsigned char> otherAlpha(alpha.rbegin(), alpha.rend()), combinedAlpha1(n), combinedAlpha2(n);
+	ImageKernels::combine(&data[0], &alpha[0], &other[0], &otherAlpha[0], -1.f, &combined1[0], &combinedAlpha1[0], n);
+	ImageKernels::scalar::combine(&data[0], &alpha[0], &other[0], &otherAlpha[0], -1.f, &combined2[0], &combinedAlpha2[0], n);
+	assert(combined1 == combined2 and combinedAlpha1 == combinedAlpha2);
+
+	std::vector<float> merged1(other), merged2(other);
+	std::vector<unsigned char> mergedAlpha1(alpha), mergedAlpha2(alpha);
+	min1 = min2 = INFINITY;
+	max1 = max2 = -INFINITY;
+	bool new1 = ImageKernels::maxMerge(&merged1[0], &mergedAlpha1[0], &data[0], n, 3.f, min1, max1);
+	bool new2 = ImageKernels::scalar::maxMerge(&merged2[0], &mergedAlpha2[0], &data[0], n, 3.f, min2, max2);
+	assert(new1 == new2 and min1 == min2 and max1 == max2);
+	assert(merged1 == merged2 and mergedAlpha1 == mergedAlpha2);
+
+	for (unsigned times = 0; times < 4; times++)
+	{
+		std::vector<float> rot1(n), rot2(n);
+		std::vector<unsigned char> rotAlpha1(n), rotAlpha2(n);
+		ImageKernels::rotate90(&data[0], &rot1[0], width, height, times);
+		ImageKernels::scalar::rotate90(&data[0], &rot2[0], width, height, times);
+		ImageKernels::rotate90(&alpha[0], &rotAlpha1[0], width, height, times);
+		ImageKernels::scalar::rotate90(&alpha[0], &rotAlpha2[0], width, height, times);
+		assert(rot1 == rot2 and rotAlpha1 == rotAlpha2);
+	}
+
+	std::vector<float> rev1(n), rev2(n), filled1(n), filled2(n);
+	ImageKernels::reverseCopy(&data[0], &rev1[0], n);
+	ImageKernels::scalar::reverseCopy(&data[0], &rev2[0], n);
+	ImageKernels::fill(&filled1[0], n, 42.f);
+	ImageKernels::scalar::fill(&filled2[0], n, 42.f);
+	assert(rev1 == rev2 and filled1 == filled2);
+
+	qDebug() << "image kernels: all tests passed";
+}
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include "config.h"
+
+/**
+ * Inner loops of the Image primitives working on plain pixel and alpha arrays. The SSE versions are
+ * used when the compiler targets SSE2, the scalar reference versions in ImageKernels::scalar are the
+ * fallback and the baseline for test_image_kernels().
+ */
+namespace ImageKernels
+{
+	/// sets n pixels to value.
+	void	fill(float* dst, size_t n, float value);
+
+	/// dst[i] = max(dst[i], src[i] + z) for pixels that are set in dstAlpha, src[i] + z for the others.
+	/// All n alpha values become set. Returns true if any pixel was not set before, min/max are lowered/raised
+	/// to the written values.
+	bool	maxMerge(float* dst, unsigned char* dstAlpha, const float* src, size_t n, float z, float& minValue, float& maxValue);
+
+	/// minimum and maximum of the pixels which are set in alpha, min/max are only lowered/raised.
+	void	minMax(const float* data, const unsigned char* alpha, size_t n, float& minValue, float& maxValue);
+
+	/// sum of a[i] - b[i] over the pixels which are set in bAlpha.
+	double	diffSum(const float* a, const float* b, const unsigned char* bAlpha, size_t n);
+
+	/// sum of a[i] - b[i] over all n pixels.
+	double	diffSum(const float* a, const float* b, size_t n);
+
+	/// lowers minValue to the smallest a[i] - b[i]. Returns the first index at which the new minimum
+	/// occurs, or n if no difference was smaller than minValue.
+	size_t	minDiff(const float* a, const float* b, size_t n, float& minValue);
+
+	/// dst[i] = a[i] + sign * b[i], where pixels which are not set count as 0, dstAlpha[i] = aAlpha[i] or bAlpha[i].
+	void	combine(const float* a, const unsigned char* aAlpha, const float* b, const unsigned char* bAlpha,
+					float sign, float* dst, unsigned char* dstAlpha, size_t n);
+
+	/// dst[i] = src[n - 1 - i], src and dst must not overlap.
+	void	reverseCopy(const float* src, float* dst, size_t n);
+	void	reverseCopy(const unsigned char* src, unsigned char* dst, size_t n);
+
+	/// rotates a width x height image clockwize by times * 90 degrees into dst. src and dst must not overlap.
+	void	rotate90(const float* src, float* dst, size_t width, size_t height, unsigned times);
+	void	rotate90(const unsigned char* src, unsigned char* dst, size_t width, size_t height, unsigned times);
+
+	namespace scalar
+	{
+		void	fill(float* dst, size_t n, float value);
+		bool	maxMerge(float* dst, unsigned char* dstAlpha, const float* src, size_t n, float z, float& minValue, float& maxValue);
+		void	minMax(const float* data, const unsigned char* alpha, size_t n, float& minValue, float& maxValue);
+		double	diffSum(const float* a, const float* b, const unsigned char* bAlpha, size_t n);
+		double	diffSum(const float* a, const float* b, size_t n);
+		size_t	minDiff(const float* a, const float* b, size_t n, float& minValue);
+		void	combine(const float* a, const unsigned char* aAlpha, const float* b, const unsigned char* bAlpha,
+						float sign, float* dst, unsigned char* dstAlpha, size_t n);
+		void	reverseCopy(const float* src, float* dst, size_t n);
+		void	reverseCopy(const unsigned char* src, unsigned char* dst, size_t n);
+		void	rotate90(const float* src, float* dst, size_t width, size_t height, unsigned times);
+		void	rotate90(const unsigned char* src, unsigned char* dst, size_t width, size_t height, unsigned times);
+	}
+}
+
+#ifdef ENABLE_TESTS
+void test_image_kernels();
+#endif
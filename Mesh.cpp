@@ -3,21 +3,28 @@
 #include <QFile>
 #include <QTextStream>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cassert>
 #include <map>
 #include <vector>
+#include <unordered_map>
 #include "config.h"
 #include "Mesh.h"
 #include "Exception.h"
 #include "util.h"
+#include "TextParser.h"
+#include "MeshExporter.h"
+#include "MeshInput.h"
+#include "MeshSimplifier.h"
+#include "TaskPool.h"
 #include <QSettings>
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Mesh::Mesh() :
-	_normals(0)
+	_verticesOnly(false)
 {
-	// constructor is private, no need to initialize anything here
+	// constructor is private, no need to initialize anything else here
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -41,225 +48,797 @@ Mesh* Mesh::random(unsigned max_vertices)
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Mesh::Mesh(const Mesh& other) :
-	_vertices(other._vertices.size()),
-	_normals(0),
-	_triangleIndices(other._triangleIndices.size()),
+	_vertices(other._vertices),
+	_normals(other._normals),
+	_triangleIndices(other._triangleIndices),
+	_shortIndices(other._shortIndices),
 	_min(other._min),
 	_max(other._max),
 	_name(other._name),
 	_filename(other._filename),
-	_fullyTriangulated(other._fullyTriangulated)
+	_fullyTriangulated(other._fullyTriangulated),
+	_verticesOnly(other._verticesOnly),
+	_lods(other._lods)
 {
-	memcpy(&_vertices[0], &other._vertices[0], _vertices.size() * sizeof(_vertices[0]));
-	if (other._normals)
-	{
-		_normals = new QVector3D[_vertices.size()];
-		memcpy(_normals, other._normals, _vertices.size() * sizeof(QVector3D));
-	}
-	memcpy(&_triangleIndices[0], &other._triangleIndices[0], _triangleIndices.size() * sizeof(_triangleIndices[0]));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Mesh::Mesh(const char* off_filename) :
-	_normals(0),
+Mesh::Mesh(std::vector<QVector3D>&& vertices, std::vector<unsigned>&& indices, const QString& name) :
+	_vertices(std::move(vertices)),
+	_triangleIndices(std::move(indices)),
+	_name(name),
+	_fullyTriangulated(true),
+	_verticesOnly(false)
+{
+	recalcMinMax();
+	compactIndices();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Mesh::Mesh(const char* filename, const QByteArray& bytes) :
 	_min(INFINITY, INFINITY, INFINITY),
 	_max(-INFINITY, -INFINITY, -INFINITY),
-	_fullyTriangulated(true)
+	_fullyTriangulated(true),
+	_verticesOnly(false)
 {    
-	_filename = off_filename;
+	_filename = filename;
+	_name = nameOf(_filename);
 
-    {
-        QStringList sl = _filename.split('/');
-        _name = sl.at(sl.size() - 1).split(".").at(0);
-    }
+	parse(bytes);
 
-    QFile file(_filename);
-    if (not file.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-		THROW(MeshException, QString("Unable to open file \'%1\' for reading.").arg(file.errorString()));
+	QSettings settings(APP_VENDOR, APP_NAME);
+	float tolerance = qvariant_cast<float>(settings.value("weld_tolerance", -1.)); // negative: no welding
+	if (tolerance >= 0.f)
+		weld(tolerance);
+	compactIndices();
+}
 
-    }
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QString Mesh::nameOf(const QString& filename)
+{
+	QStringList sl = filename.split('/');
+	return sl.at(sl.size() - 1).split(".").at(0);
+}
 
-    QTextStream in(&file);
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads the vertices of a mesh file and nothing else, which takes a fraction of the time of loading
+/// it. The box is the one the loaded mesh has, unless welding drops vertices. Throws like the
+/// constructor on broken files.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::scanBounds(const char* filename, QVector3D& min, QVector3D& max, const QByteArray& bytes)
+{
+	Mesh mesh;
+	mesh._filename = filename;
+	mesh._min = QVector3D(INFINITY, INFINITY, INFINITY);
+	mesh._max = QVector3D(-INFINITY, -INFINITY, -INFINITY);
+	mesh._fullyTriangulated = true;
+	mesh._verticesOnly = true;
+	mesh.parse(bytes);
+	min = mesh._min;
+	max = mesh._max;
+}
 
-    int lineNumber = 0;
-    QString line;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parse(const QByteArray& bytes)
+{
+	// plain files are mapped and parsed in place, compressed ones are decompressed block by block.
+	MeshInput input(_filename, bytes);
+	QString format = Compression::withoutCodec(_filename);
+	if (format.endsWith(".stl", Qt::CaseInsensitive))
+		parseStl(input);
+	else if (format.endsWith(".ply", Qt::CaseInsensitive))
+		parsePly(input);
+	else if (format.endsWith(".obj", Qt::CaseInsensitive))
+		parseObj(input);
+	else
+		parseOff(input);
+}
 
-    do
-    {
-        line = in.readLine();
-        lineNumber++;
-    }
-    while (not line.isEmpty() and line.at(0) == '#');
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads the OFF header and hands the rest of the file to parseOffBody(), which sizes the arrays
+/// from the counts in the header. Only complete lines are looked at until the input is finished, a
+/// header which is cut by the end of the window is read again after the next block arrived.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseOff(MeshInput& input)
+{
+	input.fill();
+	for (;;)
+	{
+		bool complete = input.finished();
+		TextParser in(input.begin(), complete ? input.end() : input.linesEnd());
+		in.skipEmptyLines();
 
+		// is signature correct?
+		if (not in.startsWith("OFF") and not in.startsWith("off"))
+		{
+			if (not complete)
+			{
+				input.fill();
+				continue;
+			}
+			THROW(MeshException, QString("\'%1\'' is not an OFF file ").arg(_filename));
+		}
+		in.skipWord();
 
-    // is signature correct?
-    line.truncate(3);
-    if(line.isNull() or (line != "OFF" and line != "off"))
-		THROW(MeshException, QString("\'%1\'' is not an OFF file ").arg(off_filename));
-    lineNumber++;
+		// the counts usually have a line on their own, but may follow the signature.
+		if (in.atLineEnd())
+			in.skipEmptyLines();
 
-    // skip comments
-    do
-    {
-        line = in.readLine();
-        lineNumber++;
-    }
-    while(not line.isNull() and line.at(0) == '#');
-    QStringList lst = line.split(' ');
+		// get vertex_count face_count edge_count
+		size_t vertex_count, face_count;
+		if (not in.read(vertex_count) or not in.read(face_count))
+		{
+			if (not complete)
+			{
+				input.fill();
+				continue;
+			}
+			THROW(MeshException, QString("in %1:%2 failed to read vertex and face count.").arg(_filename, QString::number(in.line())));
+		}
+		in.nextLine();
 
-    // get vertex_count face_count edge_count
-	size_t vertex_count = lst.at(0).toULong(), face_count = lst.at(1).toULong();//, edge_count = lst.at(2).toULong();
+		input.consume(in.pos());
+		VertexColumns columns = { 3, { 0, 1, 2 }, { -1, -1, -1 } };
+		parseOffBody(input, in.line(), vertex_count, _verticesOnly ? 0 : face_count, columns);
+		return;
+	}
+}
 
-    resetMinMax();
+namespace
+{
+	/// a newline aligned piece of the vertex and face section of an OFF file.
+	struct OffChunk
+	{
+		const char*		begin;
+		const char*		end;
+		size_t			firstLine;		/// line number of begin
+		size_t			firstRecord;	/// number of vertex and face lines before begin
+		size_t			numLines;
+		size_t			numRecords;
+		std::vector<unsigned> triangles; /// fan triangulated faces of this chunk
+		size_t			firstTriangleIndex; /// position of triangles in the final index array
+		QVector3D		min;
+		QVector3D		max;
+		bool			fullyTriangulated;
+		QString			error;			/// first error in this chunk, empty if there was none
+	};
+}
 
-    // process vertices
-    for (size_t i = 0; i < vertex_count and not in.atEnd(); i++)
-    {
-        lineNumber++;
-        float coord[3];
-        in >> coord[0] >> coord[1] >> coord[2];
-        if (in.status() != QTextStream::Ok)
-			THROW(MeshException, QString(" in %1:%1 failed to read coordinate.").arg(off_filename, QString::number(lineNumber)));
-		_vertices.push_back(QVector3D(coord[0], coord[1], coord[2]));
-    }
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads one face and appends its fan triangulation to triangles. Returns false and sets error if
+/// the face is broken.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool parseOffFace(TextParser& in, size_t vertex_count, std::vector<unsigned>& triangles, bool& fullyTriangulated, QString& error)
+{
+	unsigned poly_type;
+	if (not in.read(poly_type))
+	{
+		error = "failed to read number of vertices.";
+		return false;
+	}
+	if (poly_type < 3)
+	{
+		error = "polygon has less than 3 vertices.";
+		return false;
+	}
+	if (poly_type != 3)
+		fullyTriangulated = false;
 
-    // process faces
-    for(size_t i = 0; i < face_count and not in.atEnd(); i++)
-    {
-        unsigned firstIndex, lastIndex;
-        int poly_type;
-        in >> poly_type;
-        if (in.status() == QTextStream::Ok)
-        {
-            if(poly_type != 3)
-				_fullyTriangulated = false;
-
-            unsigned vertexIndex;
-            for(int i = 0; i < poly_type; i++)
-            {
-                lastIndex = vertexIndex;
-                in >> vertexIndex;
-                if (in.status() == QTextStream::Ok)
-				{
-                    if (i == 0)
-                        firstIndex = vertexIndex;
-                    else if (i > 2) // this triangulation should work for convex polygons
-                    {
-                        _triangleIndices.push_back(firstIndex);
-                        _triangleIndices.push_back(lastIndex);
-                    }
-
-					_min = vecmin(_min, _vertices[vertexIndex]);
-					_max = vecmax(_max, _vertices[vertexIndex]);
-					_triangleIndices.push_back(vertexIndex);
-				}
-                else
-					THROW(MeshException, QString("in %1:%2 polygon is not a Triangle.").arg(off_filename, QString::number(lineNumber)));
-            }			
-        }
-        else
-			THROW(MeshException, QString("in %1:%2 failed to read number of vertices.").arg(off_filename, QString::number(lineNumber)));
-
-        lineNumber++;
-    }
-    file.close();
+	unsigned firstIndex = 0, lastIndex = 0;
+	for (unsigned j = 0; j < poly_type; j++)
+	{
+		unsigned vertexIndex;
+		if (not in.read(vertexIndex))
+		{
+			error = "failed to read vertex index.";
+			return false;
+		}
+		if (vertexIndex >= vertex_count)
+		{
+			error = QString("vertex index %1 is out of range.").arg(QString::number(vertexIndex));
+			return false;
+		}
+
+		if (j == 0)
+			firstIndex = vertexIndex;
+		else if (j >= 2) // this triangulation should work for convex polygons
+		{
+			triangles.push_back(firstIndex);
+			triangles.push_back(lastIndex);
+			triangles.push_back(vertexIndex);
+		}
+		lastIndex = vertexIndex;
+	}
+	return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Mesh::~Mesh()
+///
+/// Parses the vertex and face lines of an OFF file, window by window. A mapped file is a single
+/// window, a compressed one is parsed while the next block is decompressed. The counts of the header
+/// are not trusted with memory: a mapped or read file is rejected if they need more lines than its
+/// bytes can hold, and the vertex array grows with the records which really arrived. ASCII PLY files
+/// have the same layout, columns tells where coordinates and normals are.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseOffBody(MeshInput& input, size_t firstLine, size_t vertex_count, size_t face_count, const VertexColumns& columns)
 {
-	if (_normals)
-		delete [] _normals;
+	assert(columns.count <= VertexColumns::MAX_COUNT);
+	if (not input.isStream())
+	{
+		size_t maxRecords = (input.end() - input.begin() + 1) / 2; // a record is a character and a newline at least
+		if (vertex_count > maxRecords or face_count > maxRecords - vertex_count)
+			THROW(MeshException, QString("in %1 the header promises %2 vertices and %3 faces, more than the file can hold.").arg(_filename,
+									QString::number(vertex_count), QString::number(face_count)));
+	}
+
+	size_t line = firstLine, record = 0;
+	while (record < vertex_count + face_count and (input.fill() or input.begin() != input.end())) // trailing lines are not read
+	{
+		const char* stop = input.linesEnd();
+		parseOffRecords(input.begin(), stop, line, record, vertex_count, face_count, columns);
+		input.consume(stop);
+	}
+
+	if (record < vertex_count + face_count)
+		THROW(MeshException, QString("in %1:%2 unexpected end of file, %3 vertices and faces are missing.").arg(_filename,
+								QString::number(line), QString::number(vertex_count + face_count - record)));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-void Mesh::add(const Mesh& other, const QVector3D offset)
+///
+/// Parses the records in [begin, end) in parallel, line and record are those of begin and are moved
+/// behind end. The text is split into newline aligned chunks. A first pass counts the vertex and
+/// face lines ("records") of every chunk, a prefix sum over the counts tells each chunk which records
+/// it holds. The second pass writes the vertices straight to their final place and collects the
+/// triangles and the bounding box per chunk. The triangles are then appended in chunk order, the
+/// boxes are merged.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseOffRecords(const char* begin, const char* end, size_t& line, size_t& record, size_t vertex_count, size_t face_count, const VertexColumns& columns)
 {
-	_filename.clear();
+	if (begin == end or record >= vertex_count + face_count)
+		return; // trailing lines are ignored
+	bool readNormals = columns.normal[0] >= 0;
 
-	size_t oldVertSize = _vertices.size();
-	_vertices.resize(oldVertSize + other._vertices.size());
-	for (unsigned i = 0; i < other._vertices.size(); i++)
-		_vertices[oldVertSize + i] = other._vertices[i] + offset;
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+	size_t max_chunks = TaskPool::instance().numThreads() * 4;
+	max_chunks = std::max<size_t>(1, std::min<size_t>(max_chunks, (end - begin) / MIN_CHUNK_SIZE));
 
-	if (_normals)
+	std::vector<const char*> bounds = TextParser::splitLines(begin, end, max_chunks);
+	std::vector<OffChunk> chunks(std::max<size_t>(1, bounds.size()) - 1);
+	for (size_t i = 0; i < chunks.size(); i++)
 	{
-		QVector3D* old_normals = _normals;
-		_normals = new QVector3D[_vertices.size()];
-		memcpy(_normals, old_normals, oldVertSize * sizeof(QVector3D));
-		if (other._normals)
-			memcpy(&_normals[oldVertSize], other._normals, other._vertices.size() * sizeof(QVector3D));
-		else
-			memset(&_normals[oldVertSize], 0, other._vertices.size() * sizeof(QVector3D));
-		delete [] old_normals;
+		chunks[i].begin = bounds[i];
+		chunks[i].end = bounds[i + 1];
 	}
 
-	size_t oldTriSize = _triangleIndices.size();
-	_triangleIndices.resize(oldTriSize + other._triangleIndices.size());
-	for (unsigned i = 0; i < other._triangleIndices.size(); i++)
-		_triangleIndices[oldTriSize + i] = other._triangleIndices[i] + oldVertSize; // adjusting the indices.
+	// pass 1: count the lines and records of every chunk
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		OffChunk& chunk = chunks[i];
+		TextParser in(chunk.begin, chunk.end, 0);
+		chunk.numRecords = 0;
+		while (not in.atEnd())
+		{
+			if (not in.atLineEnd())
+				chunk.numRecords++;
+			in.nextLine();
+		}
+		chunk.numLines = in.line();
+	});
 
-	_min = vecmin(_min, other._min);
-	_max = vecmax(_max, other._max);
-	_name = QString("%1+%2").arg(_name).arg(other._name);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].firstRecord = record;
+		chunks[i].firstLine = line;
+		record += chunks[i].numRecords;
+		line += chunks[i].numLines;
+	}
+	if (_vertices.size() < std::min(record, vertex_count))
+	{
+		_vertices.resize(std::min(record, vertex_count));
+		if (readNormals)
+			_normals.resize(_vertices.size());
+	}
+
+	// pass 2: parse the records, vertices go straight to their final place.
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		OffChunk& chunk = chunks[i];
+		chunk.min = QVector3D(INFINITY, INFINITY, INFINITY);
+		chunk.max = QVector3D(-INFINITY, -INFINITY, -INFINITY);
+		chunk.fullyTriangulated = true;
+
+		TextParser in(chunk.begin, chunk.end, chunk.firstLine);
+		size_t current = chunk.firstRecord;
+		for (; not in.atEnd() and current < vertex_count + face_count; in.nextLine())
+		{
+			if (in.atLineEnd())
+				continue;
+
+			if (current < vertex_count)
+			{
+				float value[VertexColumns::MAX_COUNT];
+				unsigned n = 0;
+				while (n < columns.count and in.read(value[n]))
+					n++;
+				if (n < columns.count)
+				{
+					chunk.error = QString("in %1:%2 failed to read coordinate.").arg(_filename, QString::number(in.line()));
+					break;
+				}
+
+				QVector3D vertex(value[columns.position[0]], value[columns.position[1]], value[columns.position[2]]);
+				chunk.min = vecmin(chunk.min, vertex);
+				chunk.max = vecmax(chunk.max, vertex);
+				_vertices[current] = vertex; // vertex colors and other extras are ignored
+				if (readNormals)
+					_normals[current] = QVector3D(value[columns.normal[0]], value[columns.normal[1]], value[columns.normal[2]]);
+			}
+			else
+			{
+				QString error;
+				if (not parseOffFace(in, vertex_count, chunk.triangles, chunk.fullyTriangulated, error))
+				{
+					chunk.error = QString("in %1:%2 %3").arg(_filename, QString::number(in.line()), error);
+					break;
+				}
+			}
+			current++;
+		}
+	});
+
+	// the first error in the file is reported, like a serial parser would do.
+	size_t numIndices = _triangleIndices.size();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		if (not chunks[i].error.isEmpty())
+			THROW(MeshException, chunks[i].error);
+
+		chunks[i].firstTriangleIndex = numIndices;
+		numIndices += chunks[i].triangles.size();
+		_min = vecmin(_min, chunks[i].min);
+		_max = vecmax(_max, chunks[i].max);
+		_fullyTriangulated = _fullyTriangulated and chunks[i].fullyTriangulated;
+	}
+
+	// pass 3: append the triangles
+	_triangleIndices.resize(numIndices);
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		if (not chunks[i].triangles.empty())
+			memcpy(&_triangleIndices[chunks[i].firstTriangleIndex], chunks[i].triangles.data(), chunks[i].triangles.size() * sizeof(unsigned));
+	});
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-void Mesh::save(QString filename)
+///
+/// Bit pattern of a corner, -0 is stored as 0 so both weld together.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
 {
-	QFile file(filename);
-	if (not file.open(QIODevice::WriteOnly | QIODevice::Text))
+	struct CornerKey
 	{
-		THROW(MeshException, QString("Unable to open file \'%1\' for writing.").arg(file.errorString()));
-		return;
-	}	
+		quint32 bits[3];
+
+		inline CornerKey(const QVector3D& v)
+		{
+			for (unsigned i = 0; i < 3; i++)
+			{
+				float f = v[i] == 0.f ? 0.f : v[i];
+				memcpy(&bits[i], &f, sizeof(f));
+			}
+		}
 
-	if (filename.endsWith(".off") or filename.endsWith(".OFF"))
+		inline bool operator==(const CornerKey& other) const
+		{
+			return bits[0] == other.bits[0] and bits[1] == other.bits[1] and bits[2] == other.bits[2];
+		}
+
+		inline quint64 hash() const
+		{
+			quint64 h = bits[0] * 0x9E3779B97F4A7C15ULL;
+			h = (h ^ bits[1]) * 0xC2B2AE3D27D4EB4FULL;
+			h = (h ^ bits[2]) * 0x165667B19E3779F9ULL;
+			return h ^ (h >> 29);
+		}
+	};
+
+	struct CornerKeyHash
 	{
-		QTextStream out(&file);
-		out << "OFF\n";
-		out << _vertices.size() << ' ' << (_triangleIndices.size() / 3) << " 0\n";
+		inline size_t operator()(const CornerKey& key) const { return key.hash(); }
+	};
+}
 
-		for (unsigned i = 0; i < _vertices.size(); i++)
-			out << _vertices[i].x() << ' ' <<  _vertices[i].y() << ' ' <<  _vertices[i].z() << '\n';
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Builds _vertices and _triangleIndices from a triangle soup, corners with exactly the same coordinates
+/// become one vertex. The corners are scattered into shards by their hash and each shard is welded by
+/// its own thread, every corner learns the first corner it is equal to. A final pass numbers the
+/// vertices in the order of their first appearance, so the result does not depend on the thread count.
+/// The bounding box is reduced from the corners. The scatter works on fixed blocks of corners, not on
+/// thread numbers, so it does not matter which threads of the pool take part.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::weldCorners(const std::vector<QVector3D>& corners)
+{
+	const size_t SHARD_BITS = 6;
+	const size_t NUM_SHARDS = 1 << SHARD_BITS;
+	size_t numCorners = corners.size();
+	if (numCorners % Triangle::NUM_VERTICES)
+		THROW(MeshException, QString("%1: incomplete triangle.").arg(_filename));
+	if (_verticesOnly)
+	{
+		for (const QVector3D& corner : corners)
+		{
+			_min = vecmin(_min, corner);
+			_max = vecmax(_max, corner);
+		}
+		return;
+	}
 
-		for (unsigned i = 0; i < _triangleIndices.size(); i += 3)
-			out << "3 " << _triangleIndices[i] << ' ' << _triangleIndices[i + 1] << ' ' <<  _triangleIndices[i + 2] << '\n';
+	size_t numBlocks = std::max<size_t>(1, std::min<size_t>(TaskPool::instance().numThreads(), numCorners / NUM_SHARDS));
 
+	// pass 1: hash the corners, count them per block and shard and reduce the bounding box.
+	std::vector<quint8> shardOf(numCorners);
+	std::vector<size_t> counts(numBlocks * NUM_SHARDS, 0);
+	std::vector<QVector3D> mins(numBlocks, QVector3D(INFINITY, INFINITY, INFINITY)), maxs(numBlocks, QVector3D(-INFINITY, -INFINITY, -INFINITY));
+	TaskPool::instance().parallelFor(0, numBlocks, [&](size_t block)
+	{
+		size_t begin = numCorners * block / numBlocks, end = numCorners * (block + 1) / numBlocks;
+		for (size_t i = begin; i < end; i++)
+		{
+			shardOf[i] = CornerKey(corners[i]).hash() >> (64 - SHARD_BITS);
+			counts[block * NUM_SHARDS + shardOf[i]]++;
+			mins[block] = vecmin(mins[block], corners[i]);
+			maxs[block] = vecmax(maxs[block], corners[i]);
+		}
+	});
+
+	// the corners of a shard are laid out block after block, which keeps them in increasing order.
+	std::vector<size_t> shardBegin(NUM_SHARDS + 1, 0), offsets(numBlocks * NUM_SHARDS);
+	size_t offset = 0;
+	for (size_t shard = 0; shard < NUM_SHARDS; shard++)
+	{
+		shardBegin[shard] = offset;
+		for (size_t block = 0; block < numBlocks; block++)
+		{
+			offsets[block * NUM_SHARDS + shard] = offset;
+			offset += counts[block * NUM_SHARDS + shard];
+		}
 	}
-	else if (filename.endsWith(".stl") or filename.endsWith(".STL"))
+	shardBegin[NUM_SHARDS] = offset;
+	for (size_t block = 0; block < numBlocks; block++)
 	{
-		if (not _normals)
-			buildNormals();
+		_min = vecmin(_min, mins[block]);
+		_max = vecmax(_max, maxs[block]);
+	}
 
-		QString name = _name.isEmpty() ? "NamelessSolid" : _name;
-		QTextStream out(&file);
-		out.setRealNumberNotation(QTextStream::ScientificNotation);
-		out << "solid " << name << '\n';
-		for (unsigned i = 0; i < _triangleIndices.size(); i += 3)
+	std::vector<unsigned> sorted(numCorners);
+	TaskPool::instance().parallelFor(0, numBlocks, [&](size_t block)
+	{
+		size_t begin = numCorners * block / numBlocks, end = numCorners * (block + 1) / numBlocks;
+		size_t* blockOffsets = &offsets[block * NUM_SHARDS];
+		for (size_t i = begin; i < end; i++)
+			sorted[blockOffsets[shardOf[i]]++] = i;
+	});
+
+	// pass 2: weld every shard on its own, first[i] becomes the first corner equal to corner i.
+	std::vector<unsigned> first(numCorners);
+	TaskPool::instance().parallelFor(0, NUM_SHARDS, [&](size_t shard)
+	{
+		std::unordered_map<CornerKey, unsigned, CornerKeyHash> unique;
+		unique.reserve(shardBegin[shard + 1] - shardBegin[shard]);
+		for (size_t i = shardBegin[shard]; i < shardBegin[shard + 1]; i++)
 		{
-			const unsigned* indices = &_triangleIndices[i];
-			QVector3D normal = (_normals[indices[0]] + _normals[indices[1]] + _normals[indices[2]]).normalized();
-			out << "facet normal " << normal.x() << ' ' << normal.y() << ' ' << normal.z() << '\n';
-			out << "outer loop\n";
+			unsigned corner = sorted[i];
+			first[corner] = unique.insert(std::make_pair(CornerKey(corners[corner]), corner)).first->second;
+		}
+	});
 
-			for (unsigned j = 0; j < 3; j++)
-			{
-				QVector3D vertex = _vertices[indices[j]];
-				out << "vertex " << vertex.x() << ' ' << vertex.y() << ' ' << vertex.z() << '\n';
+	// pass 3: number the vertices by first appearance. first[i] <= i, so its number is already known.
+	std::vector<unsigned>().swap(sorted);
+	_vertices.clear();
+	_triangleIndices.resize(numCorners);
+	for (size_t i = 0; i < numCorners; i++)
+	{
+		if (first[i] == i)
+		{
+			_triangleIndices[i] = _vertices.size();
+			_vertices.push_back(corners[i]);
+		}
+		else
+			_triangleIndices[i] = _triangleIndices[first[i]];
+	}
+}
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Cell of the welding grid which a vertex falls into: the bit pattern of its coordinates for exact
+/// welding, else its coordinates divided by the tolerance and rounded down.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+	struct CellKey
+	{
+		qint64 cell[3];
+
+		inline CellKey(const QVector3D& v, float tolerance)
+		{
+			if (tolerance > 0.f)
+			{
+				const double LIMIT = 1e18; // far away and non finite coordinates share the outermost cells
+				for (unsigned i = 0; i < 3; i++)
+				{
+					double c = std::floor(v[i] / (double)tolerance);
+					cell[i] = c > LIMIT ? (qint64)LIMIT : c > -LIMIT ? (qint64)c : (qint64)-LIMIT;
+				}
 			}
+			else
+			{
+				CornerKey key(v);
+				for (unsigned i = 0; i < 3; i++)
+					cell[i] = key.bits[i];
+			}
+		}
+
+		inline CellKey moved(int dx, int dy, int dz) const
+		{
+			CellKey key(*this);
+			key.cell[0] += dx;
+			key.cell[1] += dy;
+			key.cell[2] += dz;
+			return key;
+		}
+
+		inline bool operator==(const CellKey& other) const
+		{
+			return cell[0] == other.cell[0] and cell[1] == other.cell[1] and cell[2] == other.cell[2];
+		}
 
-			out << "endloop\n"
-				   "endfacet\n";
+		inline quint64 hash() const
+		{
+			quint64 h = cell[0] * 0x9E3779B97F4A7C15ULL;
+			h = (h ^ (quint64)cell[1]) * 0xC2B2AE3D27D4EB4FULL;
+			h = (h ^ (quint64)cell[2]) * 0x165667B19E3779F9ULL;
+			return h ^ (h >> 29);
 		}
-		out << "endsolid " << name << '\n';
+	};
+
+	struct CellKeyHash
+	{
+		inline size_t operator()(const CellKey& key) const { return key.hash(); }
+	};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Every vertex is merged into the first vertex which is at most tolerance away from it. The vertices
+/// are hashed into grid cells as large as the tolerance, the cells are scattered into shards by their
+/// hash and every shard builds its cell map on its own thread. Then every vertex searches its cell and
+/// the 26 around it in parallel. The vertices are renumbered by first appearance, so the result does
+/// not depend on the thread count. Triangles which lose a corner are removed.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::weld(float tolerance)
+{
+	const size_t SHARD_BITS = 6;
+	const size_t NUM_SHARDS = 1 << SHARD_BITS;
+	const unsigned NONE = ~0u;
+	long numVerts = _vertices.size();
+	if (numVerts == 0)
+		return;
+	widenIndices();
+	_lods.clear();
+
+	// pass 1: find the cells and count them per shard, then lay out the vertices shard after shard in increasing order.
+	std::vector<CellKey> cells(numVerts, CellKey(QVector3D(), 0.f));
+	std::vector<quint8> shardOf(numVerts);
+	TaskPool::instance().parallelFor(0, numVerts, [&](size_t i)
+	{
+		cells[i] = CellKey(_vertices[i], tolerance);
+		shardOf[i] = cells[i].hash() >> (64 - SHARD_BITS);
+	}, TaskPool::ELEMENT_GRAIN);
+
+	std::vector<size_t> shardBegin(NUM_SHARDS + 1, 0);
+	for (long i = 0; i < numVerts; i++)
+		shardBegin[shardOf[i] + 1]++;
+	for (size_t shard = 0; shard < NUM_SHARDS; shard++)
+		shardBegin[shard + 1] += shardBegin[shard];
+	std::vector<size_t> offsets(shardBegin.begin(), shardBegin.end() - 1);
+	std::vector<unsigned> sorted(numVerts);
+	for (long i = 0; i < numVerts; i++)
+		sorted[offsets[shardOf[i]]++] = i;
+
+	// pass 2: every shard maps its cells to their smallest vertex, next[] chains the others in increasing order.
+	std::vector<std::unordered_map<CellKey, unsigned, CellKeyHash>> cellMaps(NUM_SHARDS);
+	std::vector<unsigned> next(numVerts, NONE);
+	TaskPool::instance().parallelFor(0, NUM_SHARDS, [&](size_t shard)
+	{
+		std::unordered_map<CellKey, unsigned, CellKeyHash>& cellMap = cellMaps[shard];
+		cellMap.reserve(shardBegin[shard + 1] - shardBegin[shard]);
+		for (size_t i = shardBegin[shard + 1]; i-- > shardBegin[shard]; )
+		{
+			unsigned vertex = sorted[i];
+			unsigned& head = cellMap.insert(std::make_pair(cells[vertex], NONE)).first->second;
+			next[vertex] = head;
+			head = vertex;
+		}
+	});
+	std::vector<unsigned>().swap(sorted);
+
+	// pass 3: first[i] becomes the first vertex within tolerance of vertex i, at most i itself.
+	float tolerance2 = tolerance > 0.f ? tolerance * tolerance : 0.f;
+	int reach = tolerance > 0.f ? 1 : 0;
+	std::vector<unsigned> first(numVerts);
+	TaskPool::instance().parallelFor(0, numVerts, [&](size_t i)
+	{
+		unsigned best = i;
+		for (int dx = -reach; dx <= reach; dx++)
+			for (int dy = -reach; dy <= reach; dy++)
+				for (int dz = -reach; dz <= reach; dz++)
+				{
+					CellKey key = cells[i].moved(dx, dy, dz);
+					const std::unordered_map<CellKey, unsigned, CellKeyHash>& cellMap = cellMaps[key.hash() >> (64 - SHARD_BITS)];
+					std::unordered_map<CellKey, unsigned, CellKeyHash>::const_iterator it = cellMap.find(key);
+					if (it == cellMap.end())
+						continue;
+					for (unsigned j = it->second; j < best; j = next[j]) // NONE ends the chain too
+					{
+						if ((_vertices[j] - _vertices[i]).lengthSquared() <= tolerance2)
+						{
+							best = j;
+							break;
+						}
+					}
+				}
+		first[i] = best;
+	}, TaskPool::ELEMENT_GRAIN);
+	std::vector<CellKey>().swap(cells);
+
+	// pass 4: number the vertices by first appearance. first[i] <= i, so its number is already known.
+	std::vector<unsigned> number(numVerts);
+	size_t kept = 0;
+	for (long i = 0; i < numVerts; i++)
+	{
+		if (first[i] == (unsigned)i)
+		{
+			number[i] = kept;
+			_vertices[kept] = _vertices[i];
+			if (hasNormals())
+				_normals[kept] = _normals[i];
+			kept++;
+		}
+		else
+			number[i] = number[first[i]];
 	}
-	else
-		THROW(MeshException, QString("unknown mesh extension in \'%s.\'").arg(filename));
+	_vertices.resize(kept);
+	if (hasNormals())
+		_normals.resize(kept);
+
+	size_t numCorners = _triangleIndices.size(), keptCorners = 0;
+	for (size_t i = 0; i < numCorners; i += Triangle::NUM_VERTICES)
+	{
+		unsigned a = number[_triangleIndices[i]], b = number[_triangleIndices[i + 1]], c = number[_triangleIndices[i + 2]];
+		if (a == b or b == c or a == c)
+			continue;
+		_triangleIndices[keptCorners++] = a;
+		_triangleIndices[keptCorners++] = b;
+		_triangleIndices[keptCorners++] = c;
+	}
+	_triangleIndices.resize(keptCorners);
+	recalcMinMax();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::compactIndices()
+{
+	if (hasShortIndices() or _vertices.size() > (1u << 16))
+		return;
+	_shortIndices.assign(_triangleIndices.begin(), _triangleIndices.end());
+	std::vector<unsigned>().swap(_triangleIndices);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Every level has at most a quarter of the triangles of the level before. The chain ends with the
+/// first level which has at most maxTriangles, the coarsest one that is used, or at minTriangles.
+/// One conservative simplifier continues from level to level, so every level contains the levels
+/// before it and this mesh. Levels which could not be simplified further end the chain early.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::buildLods(size_t maxTriangles, size_t minTriangles)
+{
+	_lods.clear();
+	if (numTriangles() <= maxTriangles or numTriangles() / 4 < minTriangles)
+		return;
+
+	MeshSimplifier simplifier(*this, true);
+	size_t triangles = numTriangles();
+	while (triangles > maxTriangles and triangles / 4 >= minTriangles)
+	{
+		std::shared_ptr<Mesh> level(simplifier.simplify(triangles / 4));
+		if (level->numTriangles() > triangles / 4 * 5 / 4)
+			break; // stuck, e.g. on the constraints of the hull
+		level->buildNormals();
+		_lods.push_back(level);
+		triangles = level->numTriangles();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+const Mesh* Mesh::lodWithin(size_t maxTriangles) const
+{
+	for (size_t level = 0; level < numLods(); level++)
+		if (lod(level)->numTriangles() <= maxTriangles)
+			return lod(level);
+	return lod(numLods() - 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::widenIndices()
+{
+	if (not hasShortIndices())
+		return;
+	_triangleIndices.assign(_shortIndices.begin(), _shortIndices.end());
+	std::vector<quint16>().swap(_shortIndices);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::add(const Mesh& other, const QVector3D offset)
+{
+	_filename.clear();
+	_lods.clear();
+
+	size_t oldVertSize = _vertices.size();
+	_vertices.resize(oldVertSize + other._vertices.size());
+	for (unsigned i = 0; i < other._vertices.size(); i++)
+		_vertices[oldVertSize + i] = other._vertices[i] + offset;
+
+	if (hasNormals())
+	{
+		if (other.hasNormals())
+			_normals.insert(_normals.end(), other._normals.begin(), other._normals.end());
+		else
+			_normals.resize(_vertices.size(), QVector3D(0., 0., 0.));
+	}
+
+	widenIndices(); // the sum may have too many vertices for 16 bits
+	size_t oldTriSize = _triangleIndices.size();
+	size_t otherSize = other.numTriangles() * Triangle::NUM_VERTICES;
+	_triangleIndices.resize(oldTriSize + otherSize);
+	for (size_t i = 0; i < otherSize; i++)
+		_triangleIndices[oldTriSize + i] = other.index(i) + oldVertSize; // adjusting the indices.
+
+	_min = vecmin(_min, other._min);
+	_max = vecmax(_max, other._max);
+	_name = QString("%1+%2").arg(_name).arg(other._name);
+}
 
-	file.close();
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Writes the mesh as ASCII OFF, binary STL, binary little endian PLY or 3MF, chosen by the extension of
+/// filename. MeshExporter does the work, with this mesh as its only part.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::save(QString filename)
+{
+	MeshExporter exporter(filename);
+	if (MeshExporter::formatOf(filename) == MeshExporter::Ply and not hasNormals())
+		buildNormals(); // PLY is the only format which carries them
+
+	exporter.setName(_name);
+	exporter.addPart(this);
+	exporter.write();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -269,6 +848,7 @@ void Mesh::setVertex(unsigned idx, QVector3D newVertex)
 		THROW(MeshException, QString("bad index %1").arg(QString::number(idx)));
 
 	_vertices[idx] = newVertex;
+	_lods.clear();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -303,6 +883,13 @@ void Mesh::scale(const QVector3D factor)
 
     for (size_t i = 0; i < numVertices(); i ++)
 		_vertices[i] *= factor;
+
+	for (std::shared_ptr<const Mesh>& level : _lods)
+	{
+		std::shared_ptr<Mesh> scaled(new Mesh(*level)); // levels may be shared with copies of this mesh
+		scaled->scale(factor);
+		level = scaled;
+	}
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -317,6 +904,13 @@ void Mesh::translate(const QVector3D offset)
 
 	for (size_t i = 0; i < _vertices.size(); i ++)
 		_vertices[i] += offset;
+
+	for (std::shared_ptr<const Mesh>& level : _lods)
+	{
+		std::shared_ptr<Mesh> translated(new Mesh(*level));
+		translated->translate(offset);
+		level = translated;
+	}
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -329,79 +923,112 @@ void Mesh::recalcMinMax()
 	_min = QVector3D(INFINITY, INFINITY, INFINITY);
 	_max = QVector3D(-INFINITY, -INFINITY, -INFINITY);
 
-	for (unsigned i = 0; i < _triangleIndices.size(); i++)
+	size_t numCorners = numTriangles() * Triangle::NUM_VERTICES;
+	for (size_t i = 0; i < numCorners; i++)
 	{
-		_min = vecmin(_min, _vertices[_triangleIndices[i]]);
-		_max = vecmax(_max, _vertices[_triangleIndices[i]]);
+		_min = vecmin(_min, _vertices[index(i)]);
+		_max = vecmax(_max, _vertices[index(i)]);
 	}
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The normal of a vertex is the normalized sum of the normals of the triangles around it. The face
+/// normals are computed in parallel. A vertex to triangle index in compressed rows is counted and
+/// filled in parallel, and every row is sorted, so each vertex sums its triangles in triangle order
+/// without sharing a sum with other threads. That gives the same normals for any thread count.
+///
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Mesh::buildNormals()
 {
-	typedef QMap</* index = */unsigned, /* normals = */ std::vector<QVector3D>*> Normals;
-    Normals normals;
+	long numTris = numTriangles();
+	long numCorners = numTris * Triangle::NUM_VERTICES;
+	long numVerts = _vertices.size();
+	std::vector<QVector3D> faceNormals(numTris);
+	TaskPool::instance().parallelFor(0, numTris, [&](size_t i)
+	{
+		size_t corner = i * Triangle::NUM_VERTICES;
+		faceNormals[i] = QVector3D::crossProduct(
+							 _vertices[index(corner + 1)] - _vertices[index(corner)],
+							 _vertices[index(corner + 2)] - _vertices[index(corner)]).normalized();
+	}, TaskPool::ELEMENT_GRAIN);
+
+	// the triangles of vertex v are triangles[rows[v]] to triangles[rows[v + 1]]
+	std::vector<std::atomic<quint32> > fill(numVerts); // value initialized to 0
+	TaskPool::instance().parallelFor(0, numCorners, [&](size_t i)
+	{
+		fill[index(i)].fetch_add(1, std::memory_order_relaxed);
+	}, TaskPool::ELEMENT_GRAIN);
 
-	for (unsigned i = 0; i < _triangleIndices.size(); i += 3)
+	std::vector<size_t> rows(numVerts + 1, 0);
+	for (long v = 0; v < numVerts; v++)
 	{
-		unsigned* indices = &_triangleIndices[i];
-		QVector3D vertex[3] =
-		{
-			_vertices[indices[0]],
-			_vertices[indices[1]],
-			_vertices[indices[2]]
-		};
-
-		QVector3D normal = QVector3D::crossProduct(
-							   vertex[1] - vertex[0],
-							   vertex[2] - vertex[0]).normalized();
-
-        for (unsigned j = 0; j < 3; j++)
-        {
-			Normals::iterator it = normals.find(indices[j]);
-            if (it == normals.end())
-            {
-				it = normals.insert(indices[j], new std::vector<QVector3D>);
-            }
-			it.value()->push_back(normal);
-        }
+		rows[v + 1] = rows[v] + fill[v].load(std::memory_order_relaxed);
+		fill[v].store(0, std::memory_order_relaxed);
 	}
 
-	if (_normals)
-		delete [] _normals;
-	_normals = new QVector3D[_vertices.size()];
+	std::vector<quint32> triangles(numCorners);
+	TaskPool::instance().parallelFor(0, numCorners, [&](size_t i)
+	{
+		quint32 v = index(i);
+		triangles[rows[v] + fill[v].fetch_add(1, std::memory_order_relaxed)] = i / Triangle::NUM_VERTICES;
+	}, TaskPool::ELEMENT_GRAIN);
 
-    for (Normals::iterator it = normals.begin(); it != normals.end(); ++it)
-    {
-		std::vector<QVector3D>* vec = it.value();
-        QVector3D normal(0., 0., 0.);
-        for (unsigned i = 0; i < vec->size(); i++)
-            normal += vec->at(i);
-
-        normal.normalize();
-		unsigned idx = it.key();
-		_normals[idx] = normal;
-    }
+	_normals.resize(numVerts);
+	TaskPool::instance().parallelFor(0, numVerts, [&](size_t v)
+	{
+		std::sort(triangles.begin() + rows[v], triangles.begin() + rows[v + 1]);
+		QVector3D sum(0., 0., 0.);
+		for (size_t t = rows[v]; t < rows[v + 1]; t++)
+			sum += faceNormals[triangles[t]];
+		_normals[v] = sum.normalized();
+	}, TaskPool::ELEMENT_GRAIN);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 ///
 ///
 ///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Copies up to TriangleBatch::SIZE triangles into batch and returns their number. The indices were
+/// validated while loading, so nothing is checked here. Unused slots repeat the last triangle, which
+/// keeps them finite for transform().
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned Mesh::gatherTriangles(size_t first, TriangleBatch& batch) const
+{
+	size_t count = std::min<size_t>(TriangleBatch::SIZE, numTriangles() - std::min(first, numTriangles()));
+	batch.count = count;
+	if (count == 0)
+		return 0;
+
+	for (unsigned i = 0; i < TriangleBatch::SIZE; i++)
+	{
+		size_t triangle = (first + std::min<size_t>(i, count - 1)) * Triangle::NUM_VERTICES;
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+		{
+			const QVector3D& v = _vertices[index(triangle + c)];
+			batch.x[c][i] = v.x();
+			batch.y[c][i] = v.y();
+			batch.z[c][i] = v.z();
+		}
+	}
+	return count;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 bool Mesh::Iterator::is_good() const
 {
-	return (_curr * Triangle::NUM_VERTICES) < _mesh._triangleIndices.size();
+	return _curr < _mesh.numTriangles();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Triangle Mesh::Iterator::get() const
 {
-	const unsigned* indices = &_mesh._triangleIndices[_curr * Triangle::NUM_VERTICES];
-
     Triangle t;
 	for (unsigned i = 0; i < Triangle::NUM_VERTICES; i++)
-        t.vertex[i] = _mesh.getVertex(indices[i]);		
+		t.vertex[i] = _mesh._vertices[_mesh.index(_curr * Triangle::NUM_VERTICES + i)]; // indices were validated while loading
 
     return t;
 }
@@ -431,12 +1058,15 @@ void Mesh::draw(bool use_lighting) const
     if (use_lighting)
     {
 	//glEnableClientState(GL_NORMAL_ARRAY);
-        glNormalPointer(GL_FLOAT, sizeof(QVector3D), (void*)_normals);
+        glNormalPointer(GL_FLOAT, sizeof(QVector3D), _normals.data());
     }
 
 	//glVertexPointer(/* num components */ 3, GL_FLOAT, sizeof(QVector3D), &_vertices[0]);
 	glVertexPointer(3, GL_FLOAT, sizeof(QVector3D), &_vertices[0]);
-	glDrawElements(GL_TRIANGLES, _triangleIndices.size(), GL_UNSIGNED_INT, &_triangleIndices[0]);
+	if (hasShortIndices())
+		glDrawElements(GL_TRIANGLES, _shortIndices.size(), GL_UNSIGNED_SHORT, _shortIndices.data());
+	else
+		glDrawElements(GL_TRIANGLES, _triangleIndices.size(), GL_UNSIGNED_INT, _triangleIndices.data());
 	//glDisableClientState(GL_NORMAL_ARRAY);
 	//glDisableClientState(GL_VERTEX_ARRAY);
 }
@@ -1,7 +1,9 @@
 #pragma once
 #include <QString>
+#include <QByteArray>
 #include <QObject>
 #include <vector>
+#include <memory>
 #include <functional>
 #include "util.h"
 
@@ -11,19 +13,65 @@ struct Triangle
 	static const unsigned NUM_VERTICES = 3; /// triangle has 3 vertices (at least in this universe)
 };
 
+/**
+ * Structure of arrays of up to SIZE triangles. x[c][i] is the x coordinate of corner c of the i-th
+ * triangle, so loops over the triangles of a batch have no gathers and vectorize.
+ */
+struct TriangleBatch
+{
+	static const unsigned SIZE = 8;
+
+	unsigned	count; /// number of valid triangles
+	float		x[Triangle::NUM_VERTICES][SIZE];
+	float		y[Triangle::NUM_VERTICES][SIZE];
+	float		z[Triangle::NUM_VERTICES][SIZE];
+
+	inline QVector3D vertex(unsigned triangle, unsigned corner) const { return QVector3D(x[corner][triangle], y[corner][triangle], z[corner][triangle]); }
+
+	/// v = (v - offset) * factor for all corners of all triangles.
+	inline void transform(const QVector3D offset, const QVector3D factor)
+	{
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+		{
+			for (unsigned i = 0; i < SIZE; i++)
+			{
+				x[c][i] = (x[c][i] - offset.x()) * factor.x();
+				y[c][i] = (y[c][i] - offset.y()) * factor.y();
+				z[c][i] = (z[c][i] - offset.z()) * factor.z();
+			}
+		}
+	}
+};
+
+class MeshInput;
+
 /// this class represents 3D Mesh.
 class Mesh
 {    
+	friend class MeshSimplifier;
+
 public:
 
 	Mesh(const Mesh& other); /// copy constructor
-    Mesh(const char* off_filename); /// OFF mesh constructor.
-    ~Mesh();
+	Mesh(Mesh&& other) = default; /// move constructor, steals the buffers of other.
+	Mesh& operator=(Mesh&& other) = default;
+	Mesh(std::vector<QVector3D>&& vertices, std::vector<unsigned>&& indices, const QString& name); /// takes over the index triples of a generated mesh.
+    Mesh(const char* filename, const QByteArray& bytes = QByteArray()); /// loads an OFF, STL, PLY (binary or ASCII) or OBJ file, which may be compressed (.gz, .zst). bytes: the file if it was read already.
+	static QString	nameOf(const QString& filename); /// the name a mesh loaded from filename gets
+	static void	scanBounds(const char* filename, QVector3D& min, QVector3D& max, const QByteArray& bytes = QByteArray()); /// bounding box from the vertices alone, faces are skipped.
 	void		add(const Mesh& other, const QVector3D offset); /// accumulation of meshes.
 	QVector3D	getMax() const { return _max; }
 	QVector3D   getMin() const { return _min; }
 	QVector3D	getGeometry() const { return _max - _min; } /// mesh BBox
 	size_t		numVertices() const { return _vertices.size(); }
+	size_t		numTriangles() const { return (_triangleIndices.size() + _shortIndices.size()) / Triangle::NUM_VERTICES; }
+	const QVector3D*	vertexData() const { return _vertices.data(); } /// numVertices() vertices.
+	inline unsigned		index(size_t corner) const { return _shortIndices.empty() ? _triangleIndices[corner] : _shortIndices[corner]; } /// vertex of a corner, all valid.
+	bool				hasShortIndices() const { return not _shortIndices.empty(); }
+	const unsigned*		indexData() const { return _triangleIndices.data(); } /// numTriangles() index triples unless hasShortIndices().
+	const quint16*		shortIndexData() const { return _shortIndices.data(); } /// numTriangles() index triples if hasShortIndices().
+	const QVector3D*	normalData() const { return _normals.data(); } /// numVertices() normals if hasNormals().
+	unsigned	gatherTriangles(size_t first, TriangleBatch& batch) const; /// fills batch with the triangles starting at first.
 	QVector3D   getVertex(unsigned idx) const;
 	void		setVertex(unsigned idx, QVector3D newVertex);
 	void		resetMinMax(); /// recalculates minimum and maximum coordinates.
@@ -34,9 +82,15 @@ public:
 	QString		getFilename() const { return _filename; }
 	void		recalcMinMax(); /// reexamines all vertices and determines new minimum and maximum values.
     void		draw(bool use_lighting) const;
-	void		buildNormals();
-	void		save(QString filename);
-    bool        hasNormals() const { return _normals; }
+	void		buildNormals(); /// per vertex normals, only needed for lit drawing and PLY files.
+	void		weld(float tolerance); /// merges vertices closer than tolerance, 0 merges equal ones only.
+	void		compactIndices(); /// stores the indices in 16 bits if there are few enough vertices.
+	void		buildLods(size_t maxTriangles = 0, size_t minTriangles = 1000); /// conservative simplifications, each a quarter of the one before, down to the first with at most maxTriangles.
+	size_t		numLods() const { return _lods.size() + 1; }
+	const Mesh*	lod(size_t level) const { return level == 0 ? this : _lods[level - 1].get(); } /// level 0 is this mesh.
+	const Mesh*	lodWithin(size_t maxTriangles) const; /// the finest level with at most maxTriangles, else the coarsest.
+	void		save(QString filename); /// writes OFF, binary STL, binary PLY or 3MF depending on the extension.
+    bool        hasNormals() const { return not _normals.empty(); }
 	double		aabbVolume() const;
 	bool		wasFullyTriangulated() const { return _fullyTriangulated; }
 	static Mesh*	random(unsigned max_vertices = 5);
@@ -63,14 +117,42 @@ public:
 
 private:
 
+	/// where the coordinates and normals are among the numbers of a vertex line.
+	struct VertexColumns
+	{
+		static const unsigned MAX_COUNT = 32;
+
+		unsigned	count;		/// numbers to read from a vertex line, the rest of the line is ignored
+		int			position[3];
+		int			normal[3];	/// -1 if the lines have no normals
+	};
+
 	Mesh();
+	void		parse(const QByteArray& bytes); /// reads _filename, or bytes if they are not empty, in the format its extension names.
+	void		parseOff(MeshInput& input);
+	void		parseOffBody(MeshInput& input, size_t firstLine, size_t vertex_count, size_t face_count, const VertexColumns& columns);
+	void		parseOffRecords(const char* begin, const char* end, size_t& line, size_t& record, size_t vertex_count, size_t face_count, const VertexColumns& columns);
+	void		parsePly(MeshInput& input);
+	void		parseObj(MeshInput& input);
+	void		parseObjLines(const char* begin, const char* end, size_t& line, bool last, size_t& maxIndex, size_t& maxIndexLine);
+	void		parseStl(MeshInput& input);
+	void		parseAsciiStl(const char* begin, const char* end, size_t& line, std::vector<QVector3D>& corners);
+	void		weldCorners(const std::vector<QVector3D>& corners);
+	void		widenIndices(); /// back to 32 bit indices, e.g. before triangles are added.
 
 	std::vector<QVector3D>	_vertices;  /// this array stores vertix triples of floats, which represent the vertices
-	QVector3D*				_normals;  /// this array stores vertix triples of floats, which represent the vertices
-	std::vector<unsigned>   _triangleIndices; /// this array hold index triples of the triangles.
+	std::vector<QVector3D>	_normals;  /// per vertex normals, empty until buildNormals() was called unless the file had them
+	std::vector<unsigned>   _triangleIndices; /// this array hold index triples of the triangles, empty if _shortIndices is used.
+	std::vector<quint16>	_shortIndices; /// the index triples of meshes with at most 65536 vertices after loading
 	QVector3D               _min; /// minimum x, y, z in this Mesh
 	QVector3D               _max; /// maximum x, y, z in this Mesh
 	QString                 _name;
 	QString					_filename; /// filename, that is the source of this mesh. It is empty if this is an aggregate.
 	bool					_fullyTriangulated;
+	bool					_verticesOnly; /// set by scanBounds(), the parsers skip the faces
+	std::vector<std::shared_ptr<const Mesh>>	_lods; /// levels of detail below this mesh, moved along with it and cleared when single vertices change
 };
+
+#ifdef ENABLE_TESTS
+void test_stl_loading();
+#endif
@@ -0,0 +1,593 @@
+#include <QByteArray>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include "config.h"
+#include "MeshExporter.h"
+#include "BufferedWriter.h"
+#include "ZipWriter.h"
+#include "Mesh.h"
+#include "Exception.h"
+#include "TaskPool.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+static const size_t STL_HEADER_SIZE = 80;
+static const size_t STL_FACET_SIZE = 50;
+
+static const char* const CONTENT_TYPES_3MF =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+	"<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+	"<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+	"</Types>\n";
+
+static const char* const RELATIONSHIPS_3MF =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+	"<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+	"</Relationships>\n";
+
+static const char* const MODEL_HEADER_3MF =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+	"<resources>\n";
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshExporter::MeshExporter(const QString& filename) :
+	_filename(filename),
+	_format(formatOf(filename)),
+	_numVertices(0),
+	_numTriangles(0),
+	_normals(true)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshExporter::Format MeshExporter::formatOf(const QString& filename)
+{
+	QString format = Compression::withoutCodec(filename); // "part.stl.gz" is a compressed STL file
+	if (format.endsWith(".off", Qt::CaseInsensitive))
+		return Off;
+	if (format.endsWith(".stl", Qt::CaseInsensitive))
+		return Stl;
+	if (format.endsWith(".ply", Qt::CaseInsensitive))
+		return Ply;
+	if (format.endsWith(".3mf", Qt::CaseInsensitive))
+		return ThreeMF;
+	THROW(MeshException, QString("unknown mesh extension in \'%1\'.").arg(filename));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::addPart(const Mesh* mesh, const QVector3D offset)
+{
+	QMatrix4x4 transform;
+	transform.setColumn(3, QVector4D(offset, 1.));
+	addPart(mesh, transform);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::addPart(const Mesh* mesh, const QMatrix4x4& transform)
+{
+	Source source = { nullptr, mesh->numVertices(), mesh->numTriangles(), mesh->hasNormals(), mesh->getName(), QString() };
+	addPart(source, transform);
+	_parts.back().mesh = mesh;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::addPart(const Source& source, const QMatrix4x4& transform)
+{
+	if (_numVertices + source.numVertices > std::numeric_limits<unsigned>::max())
+		THROW(MeshException, QString("too many vertices for \'%1\'.").arg(_filename));
+
+	Part part;
+	part.mesh = 0;
+	part.source = source;
+	part.transform = transform;
+	part.offset = transform.column(3).toVector3D();
+	part.rotated = false;
+	for (int row = 0; row < 3; row++)
+		for (int column = 0; column < 3; column++)
+			part.rotated = part.rotated or transform(row, column) != (row == column ? 1.f : 0.f);
+	part.firstVertex = _numVertices;
+	_parts.push_back(part);
+	_numVertices += source.numVertices;
+	_numTriangles += source.numTriangles;
+	_normals = _normals and source.normals;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::addBlocks(Block::Section section, unsigned part, std::vector<Block>& blocks) const
+{
+	size_t size = section == Block::Vertices ? _parts[part].source.numVertices : _parts[part].source.numTriangles;
+	for (size_t begin = 0; begin < size; begin += BLOCK_SIZE)
+	{
+		Block block = { section, part, begin, std::min(begin + BLOCK_SIZE, size) };
+		blocks.push_back(block);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The header holds the total counts, so it can be written before any part. OFF and PLY then list
+/// the vertices of all parts followed by the triangles of all parts, STL has only triangles.
+/// A window of blocks is formatted in parallel, then the window is written in order. The window is
+/// a few blocks per thread, so only a small part of the output is in memory at a time. The sources
+/// of the window are loaded in front of it and freed behind it, once their vertices or triangles
+/// are written, so a source is loaded once for its vertices and again for its triangles.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshExporter::write(Progress progress)
+{
+	if (_format == ThreeMF)
+		return write3mf(progress);
+
+	std::vector<Block> blocks;
+	for (unsigned p = 0; p < _parts.size() and _format != Stl; p++)
+		addBlocks(Block::Vertices, p, blocks);
+	for (unsigned p = 0; p < _parts.size(); p++)
+		addBlocks(Block::Triangles, p, blocks);
+
+	size_t window = 1;
+	#ifdef USE_OPENMP
+	window = omp_get_max_threads() * 4;
+	#endif
+	std::vector<ByteBuffer> buffers(window);
+
+	BufferedWriter out(_filename);
+	writeHeader(out);
+
+	bool aborted = progress and not progress(0, blocks.size());
+	try
+	{
+		for (size_t first = 0; first < blocks.size() and not aborted; first += window)
+		{
+			size_t count = std::min(window, blocks.size() - first);
+			acquireParts(blocks, first, count);
+
+			#ifdef USE_OPENMP
+			#pragma omp parallel for schedule(dynamic)
+			#endif
+			for (long i = 0; i < (long)count; i++)
+			{
+				buffers[i].clear();
+				format(blocks[first + i], buffers[i]);
+			}
+
+			for (size_t i = 0; i < count; i++)
+				out.put(buffers[i]);
+
+			releaseParts(blocks, first, count);
+			aborted = progress and not progress(first + count, blocks.size());
+		}
+	}
+	catch (...)
+	{
+		out.discard();
+		throw;
+	}
+
+	if (aborted)
+	{
+		out.discard();
+		return false;
+	}
+	out.close();
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The sources the blocks need are loaded in parallel, each parser uses the pool as well. A loaded
+/// mesh has to have the counts which went into the header.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::acquireParts(const std::vector<Block>& blocks, size_t first, size_t count)
+{
+	std::vector<unsigned> missing;
+	for (size_t i = first; i < first + count; i++)
+	{
+		unsigned p = blocks[i].part;
+		if (blocks[i].section != Block::Text and not _parts[p].mesh and std::find(missing.begin(), missing.end(), p) == missing.end())
+			missing.push_back(p);
+	}
+
+	std::vector<std::shared_ptr<const Mesh>> loaded(missing.size());
+	TaskPool::instance().parallelFor(0, missing.size(), [&](size_t i) { loaded[i] = _parts[missing[i]].source.load(); });
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		Part& part = _parts[missing[i]];
+		const Mesh* mesh = loaded[i].get();
+		if (mesh->numVertices() != part.source.numVertices or mesh->numTriangles() != part.source.numTriangles or (part.source.normals and not mesh->hasNormals()))
+			THROW(MeshException, QString("\'%1\' changed since it was loaded, \'%2\' is not written.").arg(part.source.name, _filename));
+		part.loaded = loaded[i];
+		part.mesh = mesh;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The blocks of a part follow each other within a section, a source is kept if its last block in
+/// the window continues in the next block which is no text.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::releaseParts(const std::vector<Block>& blocks, size_t first, size_t count)
+{
+	std::vector<unsigned> seen;
+	for (size_t i = first + count; i-- > first;)
+	{
+		unsigned p = blocks[i].part;
+		if (blocks[i].section == Block::Text or not _parts[p].source.load or std::find(seen.begin(), seen.end(), p) != seen.end())
+			continue;
+		seen.push_back(p);
+
+		size_t next = i + 1;
+		while (next < blocks.size() and blocks[next].section == Block::Text)
+			next++;
+		if (next == blocks.size() or blocks[next].part != p)
+		{
+			_parts[p].loaded.reset();
+			_parts[p].mesh = 0;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::writeHeader(ByteBuffer& out) const
+{
+	switch (_format)
+	{
+		case Off:
+			out.put("OFF\n");
+			out.put((unsigned)_numVertices);
+			out.put(' ');
+			out.put((unsigned)_numTriangles);
+			out.put(" 0\n");
+			break;
+
+		case Stl:
+		{
+			char header[STL_HEADER_SIZE];
+			memset(header, 0, sizeof(header));
+			QByteArray name = (_name.isEmpty() ? QString("NamelessSolid") : _name).toUtf8();
+			snprintf(header, sizeof(header), "binary STL %s written by " APP_NAME, name.constData());
+			out.put(header, sizeof(header));
+			out.putLE((quint32)_numTriangles);
+			break;
+		}
+
+		case Ply:
+			out.put("ply\n"
+					"format binary_little_endian 1.0\n"
+					"comment written by " APP_NAME "\n"
+					"element vertex ");
+			out.put((unsigned)_numVertices);
+			out.put("\n"
+					"property float x\n"
+					"property float y\n"
+					"property float z\n");
+			if (writesNormals())
+				out.put("property float nx\n"
+						"property float ny\n"
+						"property float nz\n");
+			out.put("element face ");
+			out.put((unsigned)_numTriangles);
+			out.put("\n"
+					"property list uchar uint vertex_indices\n"
+					"end_header\n");
+			break;
+
+		case ThreeMF:
+			break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Vertices are placed by the transform of their part and indices are moved by the number of
+/// vertices in front of the part, exactly like Mesh::add() does for translations.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::format(const Block& block, ByteBuffer& out) const
+{
+	const Part& part = _parts[block.part];
+	const QVector3D* vertices = part.mesh->vertexData();
+	const Mesh* mesh = part.mesh;
+
+	if (block.section == Block::Vertices)
+	{
+		const QVector3D* normals = writesNormals() ? part.mesh->normalData() : 0;
+		out.reserve((block.end - block.begin) * (_format == Off ? 36 : 6 * sizeof(float)));
+		for (size_t i = block.begin; i < block.end; i++)
+		{
+			QVector3D v = part.map(vertices[i]);
+			if (_format == Off)
+			{
+				out.put(v.x());
+				out.put(' ');
+				out.put(v.y());
+				out.put(' ');
+				out.put(v.z());
+				out.put('\n');
+			}
+			else
+			{
+				out.putLE(v.x());
+				out.putLE(v.y());
+				out.putLE(v.z());
+			}
+			if (normals)
+			{
+				QVector3D n = part.rotated ? part.transform.mapVector(normals[i]) : normals[i];
+				out.putLE(n.x());
+				out.putLE(n.y());
+				out.putLE(n.z());
+			}
+		}
+		return;
+	}
+
+	switch (_format)
+	{
+		case Off:
+			out.reserve((block.end - block.begin) * 36);
+			for (size_t i = block.begin * 3; i < block.end * 3; i += 3)
+			{
+				out.put("3 ");
+				out.put(mesh->index(i) + part.firstVertex);
+				out.put(' ');
+				out.put(mesh->index(i + 1) + part.firstVertex);
+				out.put(' ');
+				out.put(mesh->index(i + 2) + part.firstVertex);
+				out.put('\n');
+			}
+			break;
+
+		case Stl:
+			// the facet normal is taken from the moved triangle itself, vertex normals are not needed.
+			out.reserve((block.end - block.begin) * STL_FACET_SIZE);
+			for (size_t i = block.begin * 3; i < block.end * 3; i += 3)
+			{
+				QVector3D corners[Triangle::NUM_VERTICES];
+				for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+					corners[c] = part.map(vertices[mesh->index(i + c)]);
+				QVector3D normal = QVector3D::crossProduct(corners[1] - corners[0], corners[2] - corners[0]).normalized();
+
+				out.putLE(normal.x());
+				out.putLE(normal.y());
+				out.putLE(normal.z());
+				for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+				{
+					out.putLE(corners[c].x());
+					out.putLE(corners[c].y());
+					out.putLE(corners[c].z());
+				}
+				out.putLE((quint16)0); // attribute byte count
+			}
+			break;
+
+		case Ply:
+			out.reserve((block.end - block.begin) * (1 + 3 * sizeof(quint32)));
+			for (size_t i = block.begin * 3; i < block.end * 3; i += 3)
+			{
+				out.put((char)3);
+				out.putLE((quint32)(mesh->index(i) + part.firstVertex));
+				out.putLE((quint32)(mesh->index(i + 1) + part.firstVertex));
+				out.putLE((quint32)(mesh->index(i + 2) + part.firstVertex));
+			}
+			break;
+
+		case ThreeMF:
+			break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The vertices of a 3MF object are written as they are in the mesh, the placement is in the build
+/// item. Indices are local to the object.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshExporter::format3mf(const Block& block, ByteBuffer& out) const
+{
+	const Mesh* mesh = _parts[block.part].mesh;
+	if (block.section == Block::Vertices)
+	{
+		const QVector3D* vertices = mesh->vertexData();
+		for (size_t i = block.begin; i < block.end; i++)
+		{
+			out.put("<vertex x=\"");
+			out.putExact(vertices[i].x());
+			out.put("\" y=\"");
+			out.putExact(vertices[i].y());
+			out.put("\" z=\"");
+			out.putExact(vertices[i].z());
+			out.put("\"/>\n");
+		}
+	}
+	else
+	{
+		for (size_t i = block.begin * 3; i < block.end * 3; i += 3)
+		{
+			out.put("<triangle v1=\"");
+			out.put(mesh->index(i));
+			out.put("\" v2=\"");
+			out.put(mesh->index(i + 1));
+			out.put("\" v3=\"");
+			out.put(mesh->index(i + 2));
+			out.put("\"/>\n");
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Sources are not loaded to be compared, their identities tell. Meshes are compared by their data.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshExporter::sameMesh(const Part& first, const Part& second)
+{
+	if (first.source.load or second.source.load)
+		return first.source.load and second.source.load and not first.source.identity.isEmpty() and first.source.identity == second.source.identity;
+
+	const Mesh* a = first.mesh;
+	const Mesh* b = second.mesh;
+	if (a == b)
+		return true;
+	if (a->getFilename() != b->getFilename() or a->numVertices() != b->numVertices() or a->numTriangles() != b->numTriangles()
+		or a->getMin() != b->getMin() or a->getMax() != b->getMax() or a->hasShortIndices() != b->hasShortIndices())
+		return false;
+	return memcmp(a->vertexData(), b->vertexData(), a->numVertices() * sizeof(QVector3D)) == 0
+		and (a->hasShortIndices() ?
+			 memcmp(a->shortIndexData(), b->shortIndexData(), a->numTriangles() * 3 * sizeof(quint16)) :
+			 memcmp(a->indexData(), b->indexData(), a->numTriangles() * 3 * sizeof(unsigned))) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A 3MF file is a zip package with the model as XML in 3D/3dmodel.model. Every distinct mesh is
+/// written once as an object in <resources>, each part becomes an <item> of the <build> which refers
+/// to its object and carries the transform. 3MF multiplies row vectors from the left, so the matrix
+/// is written transposed, without the constant last column.
+/// The model is streamed like the other formats: blocks are formatted and deflated in parallel, the
+/// deflated pieces are written in order.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshExporter::write3mf(Progress progress)
+{
+	// parts with equal meshes share an object, which is written from the first of them.
+	std::vector<unsigned> objects;
+	std::vector<unsigned> objectOf(_parts.size());
+	for (unsigned p = 0; p < _parts.size(); p++)
+	{
+		unsigned o = 0;
+		while (o < objects.size() and not sameMesh(_parts[objects[o]], _parts[p]))
+			o++;
+		if (o == objects.size())
+			objects.push_back(p);
+		objectOf[p] = o;
+	}
+
+	std::vector<ByteBuffer> texts;
+	std::vector<Block> blocks;
+	ByteBuffer text;
+	auto addText = [&]()
+	{
+		Block block = { Block::Text, 0, texts.size(), 0 };
+		blocks.push_back(block);
+		texts.push_back(text);
+		text.clear();
+	};
+
+	text.put(MODEL_HEADER_3MF);
+	for (unsigned o = 0; o < objects.size(); o++)
+	{
+		text.put("<object id=\"");
+		text.put(o + 1);
+		text.put("\" type=\"model\" name=\"");
+		QByteArray name = _parts[objects[o]].source.name.toHtmlEscaped().toUtf8();
+		text.put(name.constData(), name.size());
+		text.put("\">\n<mesh>\n<vertices>\n");
+		addText();
+		addBlocks(Block::Vertices, objects[o], blocks);
+		text.put("</vertices>\n<triangles>\n");
+		addText();
+		addBlocks(Block::Triangles, objects[o], blocks);
+		text.put("</triangles>\n</mesh>\n</object>\n");
+	}
+	text.put("</resources>\n<build>\n");
+	for (unsigned p = 0; p < _parts.size(); p++)
+	{
+		text.put("<item objectid=\"");
+		text.put(objectOf[p] + 1);
+		text.put("\" transform=\"");
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				text.putExact(_parts[p].transform(row, column));
+				text.put(column == 3 and row == 2 ? '"' : ' ');
+			}
+		}
+		text.put("/>\n");
+	}
+	text.put("</build>\n</model>\n");
+	addText();
+
+	size_t window = 1;
+	#ifdef USE_OPENMP
+	window = omp_get_max_threads() * 4;
+	#endif
+	std::vector<ByteBuffer> raw(window);
+	std::vector<ZipWriter::Piece> pieces(window);
+
+	ZipWriter zip(_filename);
+	zip.addFile("[Content_Types].xml", QByteArray(CONTENT_TYPES_3MF));
+	zip.addFile("_rels/.rels", QByteArray(RELATIONSHIPS_3MF));
+	zip.beginFile("3D/3dmodel.model");
+
+	bool aborted = progress and not progress(0, blocks.size());
+	for (size_t first = 0; first < blocks.size() and not aborted; first += window)
+	{
+		size_t count = std::min(window, blocks.size() - first);
+		try
+		{
+			acquireParts(blocks, first, count);
+		}
+		catch (...)
+		{
+			zip.discard();
+			throw;
+		}
+
+		std::exception_ptr error;
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic)
+		#endif
+		for (long i = 0; i < (long)count; i++)
+		{
+			const Block& block = blocks[first + i];
+			bool last = first + i + 1 == blocks.size(); // finishes the deflate stream
+			try
+			{
+				if (block.section == Block::Text)
+				{
+					pieces[i].compress(texts[block.begin].data(), texts[block.begin].size(), last);
+				}
+				else
+				{
+					raw[i].clear();
+					format3mf(block, raw[i]);
+					pieces[i].compress(raw[i].data(), raw[i].size(), last);
+				}
+			}
+			catch (...)
+			{
+				#ifdef USE_OPENMP
+				#pragma omp critical
+				#endif
+				error = std::current_exception();
+			}
+		}
+		if (error)
+			std::rethrow_exception(error);
+
+		for (size_t i = 0; i < count; i++)
+			zip.put(pieces[i]);
+		releaseParts(blocks, first, count);
+
+		aborted = progress and not progress(first + count, blocks.size());
+	}
+
+	if (aborted)
+	{
+		zip.discard();
+		return false;
+	}
+	zip.endFile();
+	zip.close();
+	return true;
+}
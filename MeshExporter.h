@@ -0,0 +1,100 @@
+#pragma once
+#include <QString>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <vector>
+#include <functional>
+#include <memory>
+
+class Mesh;
+class ByteBuffer;
+
+/**
+ * Writes a list of meshes, each placed by its own transform, as one OFF, binary STL, binary PLY or
+ * 3MF file, without building an aggregate Mesh. The output is cut into blocks of vertices or
+ * triangles, the blocks are formatted in parallel and written in order, so an OFF, STL or PLY file
+ * is the same as the one the concatenated mesh would give. PLY files get the vertex normals if every
+ * part has them. 3MF keeps the instancing: equal meshes
+ * are written once as an object and every part becomes a build item with its transform.
+ * Mesh::save() uses the exporter with a single part.
+ *
+ * A part can also be a Source, whose mesh is loaded only while its blocks are formatted and freed
+ * once they are written, so a job is exported with a few meshes in memory at a time. Its counts
+ * have to be known up front for the header.
+ */
+class MeshExporter
+{
+public:
+
+	enum Format { Off, Stl, Ply, ThreeMF };
+
+	/// progress callback, gets the number of finished and of all blocks. Returning false aborts.
+	typedef std::function<bool (size_t done, size_t total)> Progress;
+
+	/// a part whose mesh is loaded when its blocks are formatted.
+	struct Source
+	{
+		std::function<std::shared_ptr<const Mesh> ()>	load;
+		size_t		numVertices;	/// of the mesh load() returns, write() throws if it has others
+		size_t		numTriangles;
+		bool		normals;		/// the loaded mesh has normals
+		QString		name;
+		QString		identity;		/// sources with the same identity load equal meshes, 3MF writes them once. Empty: unlike any other.
+	};
+
+	MeshExporter(const QString& filename); /// the format is chosen by the extension of filename.
+
+	void		addPart(const Mesh* mesh, const QVector3D offset = QVector3D()); /// mesh has to live until write() returns.
+	void		addPart(const Mesh* mesh, const QMatrix4x4& transform);
+	void		addPart(const Source& source, const QMatrix4x4& transform);
+	void		setName(const QString& name) { _name = name; } /// goes into the STL header.
+	bool		write(Progress progress = Progress()); /// false if progress aborted, the partial file is removed. Also if a source fails to load, which throws.
+
+	static Format	formatOf(const QString& filename); /// throws MeshException for unknown extensions.
+
+private:
+
+	struct Part
+	{
+		const Mesh*	mesh;		/// null while the mesh of a source is not loaded
+		std::shared_ptr<const Mesh>	loaded;
+		Source		source;		/// load is empty for a part which was added as a mesh
+		QMatrix4x4	transform;
+		QVector3D	offset;		/// translation of transform
+		bool		rotated;	/// transform is more than the translation by offset
+		unsigned	firstVertex; /// index of the first vertex of this part in the written file
+
+		/// a null offset leaves the vertices untouched, so that a single mesh is written as it is.
+		inline QVector3D map(const QVector3D& v) const { return rotated ? transform.map(v) : offset.isNull() ? v : v + offset; }
+	};
+
+	struct Block
+	{
+		enum Section { Vertices, Triangles, Text };
+
+		Section		section;
+		unsigned	part;
+		size_t		begin; /// first vertex or triangle of the part, index of the text for Text blocks
+		size_t		end;
+	};
+
+	static const size_t BLOCK_SIZE = 1 << 16; /// vertices or triangles per block
+
+	inline bool	writesNormals() const { return _format == Ply and _normals and not _parts.empty(); }
+	void		writeHeader(ByteBuffer& out) const;
+	void		format(const Block& block, ByteBuffer& out) const;
+	void		format3mf(const Block& block, ByteBuffer& out) const;
+	void		addBlocks(Block::Section section, unsigned part, std::vector<Block>& blocks) const;
+	void		acquireParts(const std::vector<Block>& blocks, size_t first, size_t count); /// loads the sources the blocks need
+	void		releaseParts(const std::vector<Block>& blocks, size_t first, size_t count); /// frees the sources no later block needs
+	static bool	sameMesh(const Part& a, const Part& b); /// true if a and b have the same geometry, e.g. two nodes which loaded the same file.
+	bool		write3mf(Progress progress);
+
+	QString				_filename;
+	Format				_format;
+	QString				_name;
+	std::vector<Part>	_parts;
+	size_t				_numVertices;
+	size_t				_numTriangles;
+	bool				_normals; /// all parts have normals, binary PLY writes them too
+};
@@ -0,0 +1,100 @@
+#include <cstring>
+#include "MeshInput.h"
+#include "Exception.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshInput::MeshInput(const QString& filename, const QByteArray& bytes) :
+	_filename(filename),
+	_file(filename),
+	_begin(0),
+	_end(0),
+	_finished(false)
+{
+	Compression::Codec codec = Compression::codecOf(filename);
+	if (codec != Compression::None)
+	{
+		if (bytes.isEmpty() and not QFile::exists(filename))
+			THROW(MeshException, QString("Unable to open file \'%1\' for reading.").arg(filename));
+		_decompressor.reset(new Decompressor(filename, codec, bytes));
+		_decompressor->start();
+		return;
+	}
+
+	_bytes = bytes;
+	if (not _bytes.isEmpty())
+		return;
+
+	if (not _file.open(QIODevice::ReadOnly))
+		THROW(MeshException, QString("Unable to open file \'%1\' for reading: %2").arg(filename, _file.errorString()));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshInput::~MeshInput()
+{
+	_decompressor.reset();
+	_file.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+const char* MeshInput::linesEnd() const
+{
+	if (_finished)
+		return _end;
+	for (const char* pos = _end; pos > _begin; pos--)
+		if (pos[-1] == '\n')
+			return pos;
+	return _begin;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshInput::consume(const char* pos)
+{
+	_begin = pos;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A mapped or read file is handed out at once. Blocks of a stream are appended behind the unparsed
+/// rest of the window, which is moved to the front first, so the window stays about one block large.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshInput::fill()
+{
+	if (_finished)
+		return false;
+
+	if (not _bytes.isEmpty())
+	{
+		_begin = _bytes.constData();
+		_end = _begin + _bytes.size();
+		_finished = true;
+		return true;
+	}
+
+	if (not _decompressor)
+	{
+		qint64 size = _file.size();
+		const char* data = size > 0 ? (const char*)_file.map(0, size) : 0;
+		if (not data)
+			THROW(MeshException, QString("Unable to map file \'%1\': %2").arg(_filename, size > 0 ? _file.errorString() : QString("file is empty")));
+		_begin = data;
+		_end = data + size;
+		_finished = true;
+		return true;
+	}
+
+	size_t rest = _end - _begin;
+	if (rest and _begin != _window.data())
+		memmove(_window.data(), _begin, rest);
+	_window.resize(rest);
+
+	bool added = _decompressor->pop(_block);
+	if (added)
+		_window.insert(_window.end(), _block.begin(), _block.end());
+	else
+		_finished = true;
+
+	_begin = _window.data();
+	_end = _window.data() + _window.size();
+	return added;
+}
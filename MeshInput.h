@@ -0,0 +1,52 @@
+#pragma once
+#include <QString>
+#include <QFile>
+#include <memory>
+#include <vector>
+#include "Compression.h"
+
+/**
+ * The bytes of a mesh file as a window which the parsers work through. Plain files are memory mapped
+ * and the window is the whole file right away, or it is the bytes a FileReader read already. Compressed files are decompressed on another thread
+ * and arrive in blocks: every fill() appends the next block to what the parser left in the window,
+ * usually the start of a line or record which continues in the new block.
+ *
+ *	while (input.fill() or input.begin() != input.end())
+ *	{
+ *		const char* stop = input.linesEnd();
+ *		... parse [input.begin(), stop) ...
+ *		input.consume(stop);
+ *	}
+ *
+ * Once the input is finished a parser has to consume the whole window or throw.
+ */
+class MeshInput
+{
+public:
+
+	MeshInput(const QString& filename, const QByteArray& bytes = QByteArray()); /// bytes: the file if it was read already
+	~MeshInput();
+
+	inline const char*	begin() const { return _begin; }
+	inline const char*	end() const { return _end; }
+	inline bool			finished() const { return _finished; } /// no bytes will follow the window
+	inline bool			isStream() const { return _decompressor != nullptr; }
+	const char*			linesEnd() const; /// behind the last newline in the window, end() once finished
+	void				consume(const char* pos); /// the bytes in front of pos are parsed
+	bool				fill(); /// appends the next block to the window, false if there was none left
+
+private:
+
+	MeshInput(const MeshInput& other);
+	MeshInput& operator=(const MeshInput& other);
+
+	QString				_filename;
+	QFile				_file;
+	QByteArray			_bytes;		/// the whole file, empty if it is mapped or streamed
+	std::unique_ptr<Decompressor>	_decompressor;
+	std::vector<char>	_window;	/// decompressed bytes which are not parsed yet
+	std::vector<char>	_block;
+	const char*			_begin;
+	const char*			_end;
+	bool				_finished;
+};
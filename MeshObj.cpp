@@ -0,0 +1,235 @@
+#include <QString>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "config.h"
+#include "Mesh.h"
+#include "Exception.h"
+#include "TextParser.h"
+#include "MeshInput.h"
+#include "TaskPool.h"
+
+namespace
+{
+	/// a newline aligned piece of an OBJ file.
+	struct ObjChunk
+	{
+		const char*		begin;
+		const char*		end;
+		size_t			firstLine;		/// line number of begin
+		size_t			firstVertex;	/// number of "v" lines before begin
+		size_t			numLines;
+		size_t			numVertices;
+		std::vector<unsigned> triangles; /// fan triangulated faces of this chunk
+		size_t			firstTriangleIndex; /// position of triangles in the final index array
+		QVector3D		min;
+		QVector3D		max;
+		bool			fullyTriangulated;
+		size_t			maxIndex;		/// largest index behind the known vertices, 0 if there was none
+		size_t			maxIndexLine;
+		QString			error;			/// first error in this chunk, empty if there was none
+	};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads the corners of an "f" line and appends their fan triangulation to triangles. A corner is
+/// v, v/vt, v//vn or v/vt/vn, only v is used. Positive indices count from 1, negative ones count back
+/// from the last vertex in front of the line, which is vertex definedVertices - 1. Indices from
+/// vertex_count up to max_count may refer to vertices which are not parsed yet, the largest of
+/// them is kept in maxIndex.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool parseObjFace(TextParser& in, size_t definedVertices, size_t vertex_count, size_t max_count, std::vector<unsigned>& triangles, bool& fullyTriangulated, size_t& maxIndex, QString& error)
+{
+	unsigned numCorners = 0, firstIndex = 0, lastIndex = 0;
+	for (; not in.atLineEnd(); numCorners++)
+	{
+		long index;
+		if (not in.read(index) or index == 0)
+		{
+			error = "failed to read vertex index.";
+			return false;
+		}
+		in.skipRestOfWord(); // texture and normal indices
+
+		long vertexIndex = index > 0 ? index - 1 : (long)definedVertices + index;
+		if (vertexIndex < 0 or (size_t)vertexIndex >= max_count)
+		{
+			error = QString("vertex index %1 is out of range.").arg(QString::number(index));
+			return false;
+		}
+		if ((size_t)vertexIndex >= vertex_count)
+			maxIndex = std::max<size_t>(maxIndex, vertexIndex);
+
+		if (numCorners == 0)
+			firstIndex = vertexIndex;
+		else if (numCorners >= 2) // this triangulation should work for convex polygons
+		{
+			triangles.push_back(firstIndex);
+			triangles.push_back(lastIndex);
+			triangles.push_back(vertexIndex);
+		}
+		lastIndex = vertexIndex;
+	}
+
+	if (numCorners < 3)
+	{
+		error = "polygon has less than 3 vertices.";
+		return false;
+	}
+	if (numCorners != 3)
+		fullyTriangulated = false;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Wavefront OBJ files are parsed window by window, a compressed file is parsed while its next block
+/// is decompressed. Faces may use vertices which come later in the file, those indices are checked
+/// once all vertices are known. Texture coordinates, normals, groups and materials are ignored.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseObj(MeshInput& input)
+{
+	size_t line = 1, maxIndex = 0, maxIndexLine = 0;
+	while (input.fill() or input.begin() != input.end())
+	{
+		const char* stop = input.linesEnd();
+		parseObjLines(input.begin(), stop, line, input.finished(), maxIndex, maxIndexLine);
+		input.consume(stop);
+	}
+
+	if (_vertices.empty())
+		THROW(MeshException, QString("\'%1\' has no vertices.").arg(_filename));
+	if (maxIndexLine and maxIndex >= _vertices.size())
+		THROW(MeshException, QString("in %1:%2 vertex index %3 is out of range.").arg(_filename, QString::number(maxIndexLine), QString::number(maxIndex + 1)));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Parses the lines in [begin, end) like the body of an OFF file: the text is split into newline
+/// aligned chunks, a first pass counts the "v" lines of every chunk and a prefix sum gives each chunk
+/// the index of its first vertex. The second pass stores the vertices at their final place, which
+/// also resolves negative indices, and collects the triangles per chunk, the third pass appends
+/// them. line is the line number of begin and is moved behind end. Unless this is the last piece
+/// of the file, faces may refer to vertices behind end, the largest such index and its line are
+/// kept in maxIndex and maxIndexLine.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseObjLines(const char* begin, const char* end, size_t& line, bool last, size_t& maxIndex, size_t& maxIndexLine)
+{
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+	size_t max_chunks = TaskPool::instance().numThreads() * 4;
+	max_chunks = std::max<size_t>(1, std::min<size_t>(max_chunks, (end - begin) / MIN_CHUNK_SIZE));
+
+	std::vector<const char*> bounds = TextParser::splitLines(begin, end, max_chunks);
+	std::vector<ObjChunk> chunks(std::max<size_t>(1, bounds.size()) - 1);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].begin = bounds[i];
+		chunks[i].end = bounds[i + 1];
+	}
+
+	// pass 1: count the lines and vertices of every chunk
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		ObjChunk& chunk = chunks[i];
+		TextParser in(chunk.begin, chunk.end, 0);
+		chunk.numVertices = 0;
+		for (; not in.atEnd(); in.nextLine())
+			if (in.startsWithWord("v"))
+				chunk.numVertices++;
+		chunk.numLines = in.line();
+	});
+
+	size_t vertex_count = _vertices.size();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].firstVertex = vertex_count;
+		chunks[i].firstLine = line;
+		vertex_count += chunks[i].numVertices;
+		line += chunks[i].numLines;
+	}
+	if (vertex_count > std::numeric_limits<unsigned>::max())
+		THROW(MeshException, QString("\'%1\' has too many vertices.").arg(_filename));
+
+	// pass 2: parse the vertices and faces
+	size_t max_count = last ? vertex_count : std::numeric_limits<unsigned>::max();
+	_vertices.resize(vertex_count);
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		ObjChunk& chunk = chunks[i];
+		chunk.min = QVector3D(INFINITY, INFINITY, INFINITY);
+		chunk.max = QVector3D(-INFINITY, -INFINITY, -INFINITY);
+		chunk.fullyTriangulated = true;
+		chunk.maxIndex = 0;
+		chunk.maxIndexLine = 0;
+
+		TextParser in(chunk.begin, chunk.end, chunk.firstLine);
+		size_t vertex = chunk.firstVertex;
+		for (; not in.atEnd(); in.nextLine())
+		{
+			if (in.startsWithWord("v"))
+			{
+				in.skipWord();
+				float coord[3];
+				if (not in.read(coord[0]) or not in.read(coord[1]) or not in.read(coord[2]))
+				{
+					chunk.error = QString("in %1:%2 failed to read coordinate.").arg(_filename, QString::number(in.line()));
+					break;
+				}
+
+				QVector3D v(coord[0], coord[1], coord[2]); // the optional w and vertex colors are ignored
+				chunk.min = vecmin(chunk.min, v);
+				chunk.max = vecmax(chunk.max, v);
+				_vertices[vertex++] = v;
+			}
+			else if (not _verticesOnly and in.startsWithWord("f"))
+			{
+				in.skipWord();
+				QString error;
+				size_t faceMaxIndex = chunk.maxIndex;
+				if (not parseObjFace(in, vertex, vertex_count, max_count, chunk.triangles, chunk.fullyTriangulated, faceMaxIndex, error))
+				{
+					chunk.error = QString("in %1:%2 %3").arg(_filename, QString::number(in.line()), error);
+					break;
+				}
+				if (faceMaxIndex > chunk.maxIndex)
+				{
+					chunk.maxIndex = faceMaxIndex;
+					chunk.maxIndexLine = in.line();
+				}
+			}
+		}
+	});
+
+	// the first error in the file is reported, like a serial parser would do.
+	size_t numIndices = _triangleIndices.size();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		if (not chunks[i].error.isEmpty())
+			THROW(MeshException, chunks[i].error);
+
+		if (chunks[i].maxIndex > maxIndex)
+		{
+			maxIndex = chunks[i].maxIndex;
+			maxIndexLine = chunks[i].maxIndexLine;
+		}
+		chunks[i].firstTriangleIndex = numIndices;
+		numIndices += chunks[i].triangles.size();
+		_min = vecmin(_min, chunks[i].min);
+		_max = vecmax(_max, chunks[i].max);
+		_fullyTriangulated = _fullyTriangulated and chunks[i].fullyTriangulated;
+	}
+
+	// pass 3: append the triangles
+	_triangleIndices.resize(numIndices);
+	TaskPool::instance().parallelFor(0, chunks.size(), [&](size_t i)
+	{
+		if (not chunks[i].triangles.empty())
+			memcpy(&_triangleIndices[chunks[i].firstTriangleIndex], chunks[i].triangles.data(), chunks[i].triangles.size() * sizeof(unsigned));
+	});
+}
@@ -0,0 +1,533 @@
+#include <QString>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "Mesh.h"
+#include "Exception.h"
+#include "TextParser.h"
+#include "MeshInput.h"
+#include "TaskPool.h"
+
+namespace
+{
+	enum PlyType { PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64, PlyNoType };
+
+	struct PlyProperty
+	{
+		std::string	name;
+		PlyType		type;		/// type of the value, or of the list items
+		PlyType		countType;	/// type of the list length, PlyNoType if this is no list
+		size_t		offset;		/// byte offset in a binary record, only valid if the element has no lists
+	};
+
+	struct PlyElement
+	{
+		std::string					name;
+		size_t						count;
+		std::vector<PlyProperty>	properties;
+		size_t						size; /// bytes of a binary record, 0 if the element has lists
+
+		/// index of the property called name, -1 if there is none.
+		int find(const char* name) const
+		{
+			for (size_t i = 0; i < properties.size(); i++)
+				if (properties[i].name == name)
+					return i;
+			return -1;
+		}
+	};
+
+	/// the parts of a binary PLY file which are kept for the mesh.
+	struct PlyData
+	{
+		std::vector<QVector3D>	vertices;
+		std::vector<QVector3D>	normals;
+		std::vector<unsigned>	triangles;
+		QVector3D				min;
+		QVector3D				max;
+		bool					fullyTriangulated;
+	};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static PlyType plyType(const std::string& name)
+{
+	static const char* const names[][2] = { {"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+											{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"} };
+	for (unsigned i = 0; i < PlyNoType; i++)
+		if (name == names[i][0] or name == names[i][1])
+			return (PlyType)i;
+	return PlyNoType;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline size_t plySize(PlyType type)
+{
+	static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[type];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/// reads a little endian value of type at data, every PLY type fits into a double without loss.
+static inline double readPly(const char* data, PlyType type)
+{
+	switch (type)
+	{
+		case PlyInt8:	return (qint8)data[0];
+		case PlyUInt8:	return (quint8)data[0];
+		case PlyInt16:	{ qint16 v; memcpy(&v, data, 2); return qFromLittleEndian(v); }
+		case PlyUInt16:	{ quint16 v; memcpy(&v, data, 2); return qFromLittleEndian(v); }
+		case PlyInt32:	{ qint32 v; memcpy(&v, data, 4); return qFromLittleEndian(v); }
+		case PlyUInt32:	{ quint32 v; memcpy(&v, data, 4); return qFromLittleEndian(v); }
+		case PlyFloat32:
+		{
+			quint32 bits;
+			memcpy(&bits, data, 4);
+			bits = qFromLittleEndian(bits);
+			float v;
+			memcpy(&v, &bits, 4);
+			return v;
+		}
+		case PlyFloat64:
+		{
+			quint64 bits;
+			memcpy(&bits, data, 8);
+			bits = qFromLittleEndian(bits);
+			double v;
+			memcpy(&v, &bits, 8);
+			return v;
+		}
+		default:		return 0;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/// bytes a binary record of element takes at least, its size if it has no lists.
+static size_t minPlyRecordSize(const PlyElement& element)
+{
+	size_t size = 0;
+	for (const PlyProperty& property : element.properties)
+		size += plySize(property.countType != PlyNoType ? property.countType : property.type);
+	return size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/// moves data past one binary record of element, returns 0 if the record does not end before end.
+static const char* skipPlyRecord(const PlyElement& element, const char* data, const char* end)
+{
+	if (element.size)
+		return (size_t)(end - data) >= element.size ? data + element.size : 0;
+
+	for (const PlyProperty& property : element.properties)
+	{
+		size_t size = plySize(property.type);
+		if (property.countType != PlyNoType)
+		{
+			if ((size_t)(end - data) < plySize(property.countType))
+				return 0;
+			double count = readPly(data, property.countType);
+			data += plySize(property.countType);
+			if (count < 0)
+				return 0;
+			size *= (size_t)count;
+		}
+		if ((size_t)(end - data) < size)
+			return 0;
+		data += size;
+	}
+	return data;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Binary vertices have a fixed size, so the records are read in parallel chunks, each with its own
+/// bounding box. Reads the vertices from done on which lie completely in [data, end) and moves data
+/// and done behind them.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static void readPlyVertices(const QString& filename, const PlyElement& element, size_t& done, const char*& data, const char* end, PlyData& mesh)
+{
+	if (not element.size)
+		THROW(MeshException, QString("\'%1\' has list properties in its vertices, which are not supported.").arg(filename));
+	size_t count = std::min<size_t>(element.count - done, (end - data) / element.size);
+
+	const PlyProperty* position[3];
+	const PlyProperty* normal[3];
+	const char* names[2][3] = { {"x", "y", "z"}, {"nx", "ny", "nz"} };
+	bool hasNormals = true;
+	for (unsigned c = 0; c < 3; c++)
+	{
+		int p = element.find(names[0][c]);
+		if (p < 0)
+			THROW(MeshException, QString("\'%1\' has no %2 coordinate.").arg(filename, names[0][c]));
+		position[c] = &element.properties[p];
+		p = element.find(names[1][c]);
+		hasNormals = hasNormals and p >= 0;
+		normal[c] = p >= 0 ? &element.properties[p] : 0;
+	}
+
+	mesh.vertices.resize(done + count); // grows with the records which arrived, the header count is not trusted
+	if (hasNormals)
+		mesh.normals.resize(done + count);
+
+	size_t numChunks = TaskPool::instance().numThreads() * 4;
+	numChunks = std::max<size_t>(1, std::min<size_t>(numChunks, count / 4096));
+	std::vector<QVector3D> chunkMin(numChunks, QVector3D(INFINITY, INFINITY, INFINITY));
+	std::vector<QVector3D> chunkMax(numChunks, QVector3D(-INFINITY, -INFINITY, -INFINITY));
+
+	TaskPool::instance().parallelFor(0, numChunks, [&](size_t chunk)
+	{
+		size_t first = count * chunk / numChunks, last = count * (chunk + 1) / numChunks;
+		for (size_t i = first; i < last; i++)
+		{
+			const char* record = data + i * element.size;
+			size_t vertexIndex = done + i;
+			QVector3D vertex(readPly(record + position[0]->offset, position[0]->type),
+							 readPly(record + position[1]->offset, position[1]->type),
+							 readPly(record + position[2]->offset, position[2]->type));
+			mesh.vertices[vertexIndex] = vertex;
+			chunkMin[chunk] = vecmin(chunkMin[chunk], vertex);
+			chunkMax[chunk] = vecmax(chunkMax[chunk], vertex);
+			if (hasNormals)
+				mesh.normals[vertexIndex] = QVector3D(readPly(record + normal[0]->offset, normal[0]->type),
+											readPly(record + normal[1]->offset, normal[1]->type),
+											readPly(record + normal[2]->offset, normal[2]->type));
+		}
+	});
+
+	for (size_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		mesh.min = vecmin(mesh.min, chunkMin[chunk]);
+		mesh.max = vecmax(mesh.max, chunkMax[chunk]);
+	}
+	data += count * element.size;
+	done += count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Faces are lists, so in general their records have to be walked one after another. Most files
+/// only hold triangles, then every record has the same size, which is checked in parallel and the
+/// triangles are read in parallel too. Anything else takes the serial path, which also finds the
+/// face an error is reported for. Polygons are fan triangulated like in OFF files. Like
+/// readPlyVertices() only the faces from done on which lie completely in [data, end) are read.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static void readPlyFaces(const QString& filename, const PlyElement& element, size_t vertexCount, size_t& done, const char*& data, const char* end, PlyData& mesh)
+{
+	int listIndex = element.find("vertex_indices");
+	if (listIndex < 0)
+		listIndex = element.find("vertex_index");
+	if (listIndex < 0 or element.properties[listIndex].countType == PlyNoType)
+		THROW(MeshException, QString("\'%1\' has no list of vertex indices in its faces.").arg(filename));
+	const PlyProperty& list = element.properties[listIndex];
+
+	if (element.properties.size() == 1)
+	{
+		size_t recordSize = plySize(list.countType) + 3 * plySize(list.type);
+		size_t count = std::min<size_t>(element.count - done, (end - data) / recordSize);
+		std::atomic<bool> regular(true); // only written when a record is not a valid triangle
+		TaskPool::instance().parallelFor(0, count, [&](size_t i)
+		{
+			const char* record = data + i * recordSize;
+			bool triangle = readPly(record, list.countType) == 3;
+			for (unsigned c = 0; c < 3; c++)
+			{
+				double index = readPly(record + plySize(list.countType) + c * plySize(list.type), list.type);
+				triangle = triangle and index >= 0 and index < vertexCount;
+			}
+			if (not triangle)
+				regular = false;
+		}, TaskPool::ELEMENT_GRAIN);
+
+		if (regular and count > 0)
+		{
+			size_t first = mesh.triangles.size();
+			mesh.triangles.resize(first + count * 3);
+			TaskPool::instance().parallelFor(0, count, [&](size_t i)
+			{
+				const char* items = data + i * recordSize + plySize(list.countType);
+				for (unsigned c = 0; c < 3; c++)
+					mesh.triangles[first + i * 3 + c] = (unsigned)readPly(items + c * plySize(list.type), list.type);
+			}, TaskPool::ELEMENT_GRAIN);
+			data += count * recordSize;
+			done += count;
+			return;
+		}
+	}
+
+	if (mesh.triangles.empty()) // as many triangles as faces fit into the window, not as the header says
+		mesh.triangles.reserve(std::min<size_t>(element.count - done, (end - data) / minPlyRecordSize(element)) * 3);
+	for (; done < element.count; done++)
+	{
+		const char* record = data;
+		const char* next = skipPlyRecord(element, data, end);
+		if (not next)
+			return; // the face continues behind end
+		data = next;
+
+		// the list starts behind the properties in front of it
+		const char* items = record;
+		for (int p = 0; p < listIndex; p++)
+		{
+			const PlyProperty& property = element.properties[p];
+			items += property.countType == PlyNoType ? plySize(property.type)
+													 : plySize(property.countType) + (size_t)readPly(items, property.countType) * plySize(property.type);
+		}
+		double count = readPly(items, list.countType);
+		items += plySize(list.countType);
+		if (count < 3)
+			THROW(MeshException, QString("in \'%1\' face %2 has less than 3 vertices.").arg(filename, QString::number(done)));
+		if (count != 3)
+			mesh.fullyTriangulated = false;
+
+		unsigned firstIndex = 0, lastIndex = 0;
+		for (unsigned j = 0; j < count; j++)
+		{
+			double index = readPly(items + j * plySize(list.type), list.type);
+			if (index < 0 or index >= vertexCount)
+				THROW(MeshException, QString("in \'%1\' face %2 has vertex index %3 out of range.").arg(filename, QString::number(done), QString::number(index)));
+
+			if (j == 0)
+				firstIndex = index;
+			else if (j >= 2)
+			{
+				mesh.triangles.push_back(firstIndex);
+				mesh.triangles.push_back(lastIndex);
+				mesh.triangles.push_back(index);
+			}
+			lastIndex = index;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Reads the header, which lists the elements with their properties, then the body. Binary little
+/// endian bodies are read straight from the mapping, the vertex element gives positions and, if it
+/// has nx, ny and nz, the normals. ASCII bodies are laid out like the body of an OFF file and go to
+/// parseOffBody(). Elements other than vertex and face are skipped. Compressed files are read block
+/// by block, each element continues with the records of the next block.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parsePly(MeshInput& input)
+{
+	// the header has to be in the window up to the newline behind end_header.
+	const char* END_HEADER = "end_header";
+	const size_t MAX_HEADER_SIZE = 1 << 20;
+	for (input.fill(); not input.finished() and (size_t)(input.end() - input.begin()) < MAX_HEADER_SIZE; input.fill())
+	{
+		const char* found = std::search(input.begin(), input.end(), END_HEADER, END_HEADER + strlen(END_HEADER));
+		if (found != input.end() and memchr(found, '\n', input.end() - found))
+			break;
+	}
+
+	TextParser in(input.begin(), input.end());
+	if (in.readWord() != "ply")
+		THROW(MeshException, QString("\'%1\' is not a PLY file.").arg(_filename));
+	in.nextLine();
+
+	bool ascii = false;
+	std::vector<PlyElement> elements;
+	for (;; in.nextLine())
+	{
+		if (in.atEnd())
+			THROW(MeshException, QString("\'%1\' has no end_header.").arg(_filename));
+
+		std::string keyword = in.readWord();
+		if (keyword == "end_header")
+			break;
+
+		if (keyword == "format")
+		{
+			std::string format = in.readWord();
+			if (format == "ascii")
+				ascii = true;
+			else if (format != "binary_little_endian")
+				THROW(MeshException, QString("in %1:%2 the format %3 is not supported.").arg(_filename, QString::number(in.line()), format.c_str()));
+		}
+		else if (keyword == "element")
+		{
+			PlyElement element;
+			element.name = in.readWord();
+			element.size = 0;
+			if (not in.read(element.count))
+				THROW(MeshException, QString("in %1:%2 failed to read element count.").arg(_filename, QString::number(in.line())));
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+				THROW(MeshException, QString("in %1:%2 property without element.").arg(_filename, QString::number(in.line())));
+
+			PlyProperty property;
+			std::string type = in.readWord();
+			property.countType = PlyNoType;
+			if (type == "list")
+			{
+				property.countType = plyType(in.readWord());
+				type = in.readWord();
+			}
+			property.type = plyType(type);
+			property.name = in.readWord();
+			if (property.type == PlyNoType or (type == "list" and property.countType == PlyNoType) or property.name.empty())
+				THROW(MeshException, QString("in %1:%2 broken property.").arg(_filename, QString::number(in.line())));
+			elements.back().properties.push_back(property);
+		}
+		else if (keyword != "comment" and keyword != "obj_info" and not keyword.empty())
+			THROW(MeshException, QString("in %1:%2 unknown keyword %3.").arg(_filename, QString::number(in.line()), keyword.c_str()));
+	}
+	in.nextLine();
+
+	// binary records without lists have a fixed layout
+	int vertexElement = -1, faceElement = -1;
+	for (size_t e = 0; e < elements.size(); e++)
+	{
+		PlyElement& element = elements[e];
+		for (PlyProperty& property : element.properties)
+		{
+			if (property.countType != PlyNoType)
+			{
+				element.size = 0;
+				break;
+			}
+			property.offset = element.size;
+			element.size += plySize(property.type);
+		}
+		if (element.name == "vertex")
+			vertexElement = e;
+		else if (element.name == "face")
+			faceElement = e;
+	}
+	if (vertexElement < 0)
+		THROW(MeshException, QString("\'%1\' has no vertices.").arg(_filename));
+	size_t vertexCount = elements[vertexElement].count;
+	if (vertexCount > std::numeric_limits<unsigned>::max())
+		THROW(MeshException, QString("\'%1\' has too many vertices.").arg(_filename));
+
+	input.consume(in.pos());
+	size_t line = in.line();
+
+	if (ascii)
+	{
+		// the lines of elements in front of the vertices are skipped, vertices and faces have to follow each other.
+		if (faceElement >= 0 and faceElement != vertexElement + 1)
+			THROW(MeshException, QString("\'%1\' has other elements between its vertices and faces, which is not supported.").arg(_filename));
+		size_t skip = 0;
+		for (int e = 0; e < vertexElement; e++)
+			skip += elements[e].count;
+		while (skip > 0 and (input.fill() or input.begin() != input.end()))
+		{
+			TextParser lines(input.begin(), input.linesEnd(), line);
+			for (; skip > 0; skip--)
+			{
+				lines.skipEmptyLines();
+				if (lines.atEnd())
+					break;
+				lines.nextLine();
+			}
+			line = lines.line();
+			input.consume(lines.pos());
+		}
+
+		const PlyElement& vertices = elements[vertexElement];
+		const char* names[6] = { "x", "y", "z", "nx", "ny", "nz" };
+		int found[6];
+		VertexColumns columns;
+		columns.count = 0;
+		for (unsigned c = 0; c < 6; c++)
+		{
+			found[c] = vertices.find(names[c]);
+			if (found[c] >= 0)
+				columns.count = std::max<unsigned>(columns.count, found[c] + 1);
+		}
+		if (found[0] < 0 or found[1] < 0 or found[2] < 0)
+			THROW(MeshException, QString("\'%1\' has no vertex coordinates.").arg(_filename));
+		if (columns.count > VertexColumns::MAX_COUNT)
+			THROW(MeshException, QString("\'%1\' has too many vertex properties.").arg(_filename));
+		for (int p = 0; p < (int)columns.count; p++)
+			if (vertices.properties[p].countType != PlyNoType)
+				THROW(MeshException, QString("\'%1\' has list properties in its vertices, which are not supported.").arg(_filename));
+
+		bool hasNormals = found[3] >= 0 and found[4] >= 0 and found[5] >= 0;
+		for (unsigned c = 0; c < 3; c++)
+		{
+			columns.position[c] = found[c];
+			columns.normal[c] = hasNormals ? found[c + 3] : -1;
+		}
+
+		size_t faceCount = 0;
+		if (faceElement >= 0)
+		{
+			const PlyElement& faces = elements[faceElement];
+			if (faces.properties.empty() or faces.properties[0].countType == PlyNoType)
+				THROW(MeshException, QString("\'%1\' has no list of vertex indices in its faces.").arg(_filename));
+			faceCount = faces.count;
+		}
+		parseOffBody(input, line, vertexCount, _verticesOnly ? 0 : faceCount, columns);
+		return;
+	}
+
+	PlyData mesh;
+	mesh.min = _min;
+	mesh.max = _max;
+	mesh.fullyTriangulated = true;
+	if (_verticesOnly)
+		faceElement = -1; // the faces are skipped like other elements, or not read at all behind the vertices
+
+	// a mapped or read file has to hold the records its header promises, before anything is allocated for them
+	if (not input.isStream())
+	{
+		size_t remaining = input.end() - input.begin();
+		for (size_t e = 0; e < elements.size() and (int)e <= std::max(vertexElement, faceElement); e++)
+		{
+			size_t size = minPlyRecordSize(elements[e]);
+			if (size > 0 and elements[e].count > remaining / size)
+				THROW(MeshException, QString("'%1' promises %2 %3 records, more than the file holds.").arg(_filename,
+										QString::number(elements[e].count), elements[e].name.c_str()));
+			remaining -= elements[e].count * size;
+		}
+	}
+	for (size_t e = 0; e < elements.size() and (int)e <= std::max(vertexElement, faceElement); e++)
+	{
+		const PlyElement& element = elements[e];
+		for (size_t done = 0;;)
+		{
+			const char* data = input.begin();
+			if ((int)e == vertexElement)
+				readPlyVertices(_filename, element, done, data, input.end(), mesh);
+			else if ((int)e == faceElement)
+				readPlyFaces(_filename, element, vertexCount, done, data, input.end(), mesh);
+			else
+			{
+				for (const char* next; done < element.count and (next = skipPlyRecord(element, data, input.end())); done++)
+					data = next;
+			}
+			input.consume(data);
+
+			if (done == element.count)
+				break;
+			if (not input.fill())
+			{
+				if ((int)e == vertexElement)
+					THROW(MeshException, QString("\'%1\' ends within its vertices.").arg(_filename));
+				if ((int)e == faceElement)
+					THROW(MeshException, QString("\'%1\' ends within face %2.").arg(_filename, QString::number(done)));
+				THROW(MeshException, QString("\'%1\' ends within element %2.").arg(_filename, element.name.c_str()));
+			}
+		}
+	}
+
+	_vertices.swap(mesh.vertices);
+	_normals.swap(mesh.normals);
+	_triangleIndices.swap(mesh.triangles);
+	_min = mesh.min;
+	_max = mesh.max;
+	_fullyTriangulated = mesh.fullyTriangulated;
+}
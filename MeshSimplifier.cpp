@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+#include "config.h"
+#include "MeshSimplifier.h"
+#include "Mesh.h"
+#include "TaskPool.h"
+
+namespace
+{
+	const double BORDER_WEIGHT = 100.;	/// weight of the planes which keep open borders in place
+	const unsigned NONE = ~0u;
+
+	inline quint64 edgeKey(unsigned a, unsigned b)
+	{
+		return a < b ? ((quint64)a << 32) | b : ((quint64)b << 32) | a;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshSimplifier::Quadric::Quadric()
+{
+	std::fill(q, q + 10, 0.);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshSimplifier::Quadric::addPlane(const QVector3D& normal, double offset, double weight)
+{
+	double a = normal.x(), b = normal.y(), c = normal.z(), d = offset;
+	q[0] += weight * a * a;	q[1] += weight * a * b;	q[2] += weight * a * c;	q[3] += weight * a * d;
+	q[4] += weight * b * b;	q[5] += weight * b * c;	q[6] += weight * b * d;
+	q[7] += weight * c * c;	q[8] += weight * c * d;
+	q[9] += weight * d * d;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshSimplifier::Quadric::operator+=(const Quadric& other)
+{
+	for (unsigned i = 0; i < 10; i++)
+		q[i] += other.q[i];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+double MeshSimplifier::Quadric::error(const QVector3D& v) const
+{
+	double x = v.x(), y = v.y(), z = v.z();
+	return q[0] * x * x + 2. * q[1] * x * y + 2. * q[2] * x * z + 2. * q[3] * x
+		 + q[4] * y * y + 2. * q[5] * y * z + 2. * q[6] * y
+		 + q[7] * z * z + 2. * q[8] * z
+		 + q[9];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshSimplifier::Quadric::optimum(QVector3D& v) const
+{
+	// the gradient vanishes where A v = -b, solved by Cramer's rule.
+	double a00 = q[0], a01 = q[1], a02 = q[2], a11 = q[4], a12 = q[5], a22 = q[7];
+	double b0 = -q[3], b1 = -q[6], b2 = -q[8];
+	double det = a00 * (a11 * a22 - a12 * a12) - a01 * (a01 * a22 - a12 * a02) + a02 * (a01 * a12 - a11 * a02);
+	double trace = a00 + a11 + a22;
+	if (not (std::fabs(det) > 1e-10 * trace * trace * trace))
+		return false;
+
+	double x = (b0 * (a11 * a22 - a12 * a12) - a01 * (b1 * a22 - a12 * b2) + a02 * (b1 * a12 - a11 * b2)) / det;
+	double y = (a00 * (b1 * a22 - a12 * b2) - b0 * (a01 * a22 - a12 * a02) + a02 * (a01 * b2 - b1 * a02)) / det;
+	double z = (a00 * (a11 * b2 - b1 * a12) - a01 * (a01 * b2 - b1 * a02) + b0 * (a01 * a12 - a11 * a02)) / det;
+	v = QVector3D(x, y, z);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Sets up the quadrics of all vertices and evaluates every edge once, in parallel.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+MeshSimplifier::MeshSimplifier(const Mesh& mesh, bool conservative) :
+	_mesh(mesh),
+	_conservative(conservative),
+	_slack(0.f),
+	_numFaces(0)
+{
+	size_t numVerts = mesh.numVertices();
+	_positions.assign(mesh.vertexData(), mesh.vertexData() + numVerts);
+	_quadrics.resize(numVerts);
+	_versions.assign(numVerts, 0);
+	_removed.assign(numVerts, false);
+	_vertexFaces.resize(numVerts);
+
+	// the connected parts of a mesh may be wound differently, so outside is taken from the signed volume of each part.
+	std::vector<unsigned> parent(numVerts);
+	for (size_t v = 0; v < numVerts; v++)
+		parent[v] = v;
+	auto root = [&parent](unsigned v)
+	{
+		while (parent[v] != v)
+			v = parent[v] = parent[parent[v]];
+		return v;
+	};
+	_faces.reserve(mesh.numTriangles());
+	for (size_t t = 0; t < mesh.numTriangles(); t++)
+	{
+		size_t corner = t * Triangle::NUM_VERTICES;
+		Face face = {{ mesh.index(corner), mesh.index(corner + 1), mesh.index(corner + 2) }};
+		if (face[0] == face[1] or face[1] == face[2] or face[0] == face[2])
+			continue;
+		_faces.push_back(face);
+		parent[root(face[1])] = root(face[0]);
+		parent[root(face[2])] = root(face[0]);
+	}
+	std::vector<double> volumes(numVerts, 0.);
+	for (const Face& face : _faces)
+	{
+		unsigned part = root(face[0]);
+		QVector3D origin = _positions[part];
+		volumes[part] += QVector3D::dotProduct(_positions[face[0]] - origin, QVector3D::crossProduct(_positions[face[1]] - origin, _positions[face[2]] - origin));
+	}
+	_outside.resize(_faces.size());
+	for (size_t f = 0; f < _faces.size(); f++)
+		_outside[f] = volumes[root(_faces[f][0])] < 0. ? -1.f : 1.f;
+	_slack = 1e-6f * mesh.getGeometry().length(); // rounding of the pushed positions
+	_faceRemoved.assign(_faces.size(), false);
+	_numFaces = _faces.size();
+
+	// area weighted planes of the triangles, edges with a single triangle get a perpendicular plane too.
+	std::unordered_map<quint64, unsigned> edgeFaces;
+	for (size_t f = 0; f < _faces.size(); f++)
+	{
+		const Face& face = _faces[f];
+		QVector3D normal = faceNormal(face);
+		float length = normal.length();
+		QVector3D unit = length > 0.f ? normal / length : normal;
+		double offset = -QVector3D::dotProduct(unit, _positions[face[0]]);
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+		{
+			_quadrics[face[c]].addPlane(unit, offset, length / 2.);
+			_vertexFaces[face[c]].push_back(f);
+			edgeFaces[edgeKey(face[c], face[(c + 1) % 3])]++;
+		}
+	}
+	for (size_t f = 0; f < _faces.size(); f++)
+	{
+		const Face& face = _faces[f];
+		QVector3D unit = faceNormal(face).normalized();
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+		{
+			unsigned u = face[c], v = face[(c + 1) % 3];
+			if (edgeFaces[edgeKey(u, v)] != 1)
+				continue;
+			QVector3D edge = _positions[v] - _positions[u];
+			QVector3D normal = QVector3D::crossProduct(edge, unit).normalized();
+			double offset = -QVector3D::dotProduct(normal, _positions[u]);
+			_quadrics[u].addPlane(normal, offset, edge.lengthSquared() * BORDER_WEIGHT);
+			_quadrics[v].addPlane(normal, offset, edge.lengthSquared() * BORDER_WEIGHT);
+		}
+	}
+
+	std::vector<quint64> edges;
+	edges.reserve(edgeFaces.size());
+	for (const std::pair<const quint64, unsigned>& edge : edgeFaces)
+		edges.push_back(edge.first);
+	std::sort(edges.begin(), edges.end()); // the order of the heap does not depend on the hash map
+
+	long numEdges = edges.size();
+	std::vector<Collapse> collapses(numEdges);
+	std::vector<char> feasible(numEdges);
+	TaskPool::instance().parallelFor(0, numEdges, [&](size_t i)
+	{
+		feasible[i] = evaluate(edges[i] >> 32, edges[i] & 0xffffffff, collapses[i]);
+	}, TaskPool::ELEMENT_GRAIN);
+
+	for (long i = 0; i < numEdges; i++)
+		if (feasible[i])
+			_heap.push_back(collapses[i]);
+	std::make_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QVector3D MeshSimplifier::faceNormal(const Face& face) const
+{
+	return QVector3D::crossProduct(_positions[face[1]] - _positions[face[0]], _positions[face[2]] - _positions[face[0]]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshSimplifier::neighbours(unsigned v, std::vector<unsigned>& out) const
+{
+	out.clear();
+	for (unsigned f : _vertexFaces[v])
+		if (not _faceRemoved[f])
+			for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+				if (_faces[f][c] != v)
+					out.push_back(_faces[f][c]);
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Collects the outward planes of the triangles around a and b, and their mean normal as the direction
+/// in which pushOut() moves.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshSimplifier::planesAround(unsigned a, unsigned b, std::vector<Plane>& planes, QVector3D& direction) const
+{
+	planes.clear();
+	direction = QVector3D(0., 0., 0.);
+	unsigned ends[2] = { a, b };
+	for (unsigned v : ends)
+	{
+		for (unsigned f : _vertexFaces[v])
+		{
+			const Face& face = _faces[f];
+			if (_faceRemoved[f] or (v == b and (face[0] == a or face[1] == a or face[2] == a)))
+				continue; // the triangles of the edge are around a already
+			Plane plane;
+			plane.normal = (faceNormal(face) * _outside[f]).normalized();
+			if (plane.normal.isNull())
+				continue;
+			plane.offset = -QVector3D::dotProduct(plane.normal, _positions[face[0]]);
+			planes.push_back(plane);
+			direction += plane.normal;
+		}
+	}
+	direction.normalize();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// true if pos is outside of all planes, up to rounding.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshSimplifier::isOutside(const std::vector<Plane>& planes, const QVector3D& pos) const
+{
+	for (const Plane& plane : planes)
+		if (QVector3D::dotProduct(plane.normal, pos) + plane.offset < -_slack)
+			return false;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Moves pos along direction until it is outside of all planes, false if no such move exists or it is
+/// longer than maxDistance. Thin parts would otherwise grow spikes.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshSimplifier::pushOut(const std::vector<Plane>& planes, const QVector3D& direction, float maxDistance, QVector3D& pos) const
+{
+	float distance = 0.f;
+	for (const Plane& plane : planes)
+	{
+		float inside = -(QVector3D::dotProduct(plane.normal, pos) + plane.offset);
+		if (inside <= 0.f)
+			continue;
+		float speed = QVector3D::dotProduct(plane.normal, direction);
+		if (speed <= 1e-3f)
+			return false;
+		distance = std::max(distance, inside / speed);
+	}
+	if (distance > maxDistance)
+		return false;
+	pos += direction * distance;
+	return isOutside(planes, pos);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Tries the optimum of the summed quadric, the middle and both ends of the edge and takes the one
+/// with the least error, after moving it outside for a conservative simplifier.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshSimplifier::evaluate(unsigned a, unsigned b, Collapse& collapse) const
+{
+	Quadric quadric = _quadrics[a];
+	quadric += _quadrics[b];
+
+	QVector3D middle = (_positions[a] + _positions[b]) * 0.5f;
+	float length = (_positions[b] - _positions[a]).length();
+	QVector3D candidates[4];
+	unsigned numCandidates = 0;
+	QVector3D optimum;
+	// an almost flat neighbourhood can put the optimum far away, then the other candidates do better.
+	if (quadric.optimum(optimum) and (optimum - middle).length() <= 2.f * length)
+		candidates[numCandidates++] = optimum;
+	candidates[numCandidates++] = middle;
+	candidates[numCandidates++] = _positions[a];
+	candidates[numCandidates++] = _positions[b];
+
+	std::vector<Plane> planes;
+	QVector3D direction;
+	if (_conservative)
+		planesAround(a, b, planes, direction);
+
+	bool found = false;
+	for (unsigned i = 0; i < numCandidates; i++)
+	{
+		QVector3D pos = candidates[i];
+		if (_conservative and not pushOut(planes, direction, 0.5f * length, pos))
+			continue;
+		double cost = quadric.error(pos);
+		if (not found or cost < collapse.cost)
+		{
+			found = true;
+			collapse.cost = cost;
+			collapse.pos = pos;
+		}
+	}
+	collapse.a = a;
+	collapse.b = b;
+	collapse.versionA = _versions[a];
+	collapse.versionB = _versions[b];
+	return found;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The collapse has to keep the surface a manifold where it is one: the only vertices next to both
+/// ends are the ones across the shared triangles. No remaining triangle may flip or degenerate.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MeshSimplifier::canCollapse(const Collapse& collapse) const
+{
+	unsigned a = collapse.a, b = collapse.b;
+	size_t shared = 0;
+	for (unsigned f : _vertexFaces[a])
+		if (not _faceRemoved[f] and (_faces[f][0] == b or _faces[f][1] == b or _faces[f][2] == b))
+			shared++;
+	if (shared == 0)
+		return false;
+
+	std::vector<unsigned> around[2];
+	neighbours(a, around[0]);
+	neighbours(b, around[1]);
+	std::vector<unsigned> common;
+	std::set_intersection(around[0].begin(), around[0].end(), around[1].begin(), around[1].end(), std::back_inserter(common));
+	if (common.size() != shared)
+		return false;
+
+	// a tetrahedron passes the test above, its collapse would leave a triangle twice.
+	auto sorted = [a, b](Face face)
+	{
+		for (unsigned& v : face)
+			if (v == b)
+				v = a;
+		std::sort(face.begin(), face.end());
+		return face;
+	};
+	for (unsigned f : _vertexFaces[b])
+	{
+		if (_faceRemoved[f])
+			continue;
+		Face moved = sorted(_faces[f]);
+		if (moved[0] == moved[1] or moved[1] == moved[2])
+			continue; // shared with a
+		for (unsigned g : _vertexFaces[a])
+			if (not _faceRemoved[g] and sorted(_faces[g]) == moved)
+				return false;
+	}
+
+	unsigned ends[2] = { a, b };
+	for (unsigned v : ends)
+	{
+		for (unsigned f : _vertexFaces[v])
+		{
+			const Face& face = _faces[f];
+			if (_faceRemoved[f] or face[0] == (v == a ? b : a) or face[1] == (v == a ? b : a) or face[2] == (v == a ? b : a))
+				continue;
+			QVector3D corners[3];
+			for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+				corners[c] = face[c] == v ? collapse.pos : _positions[face[c]];
+			QVector3D before = faceNormal(face);
+			QVector3D after = QVector3D::crossProduct(corners[1] - corners[0], corners[2] - corners[0]);
+			if (QVector3D::dotProduct(before, after) <= 1e-3f * before.length() * after.length())
+				return false;
+		}
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MeshSimplifier::collapse(const Collapse& collapse)
+{
+	unsigned a = collapse.a, b = collapse.b;
+	_positions[a] = collapse.pos;
+	_quadrics[a] += _quadrics[b];
+	_removed[b] = true;
+	_versions[a]++;
+	_versions[b]++;
+
+	for (unsigned f : _vertexFaces[b])
+	{
+		if (_faceRemoved[f])
+			continue;
+		Face& face = _faces[f];
+		if (face[0] == a or face[1] == a or face[2] == a)
+		{
+			_faceRemoved[f] = true;
+			_numFaces--;
+			continue;
+		}
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++)
+			if (face[c] == b)
+				face[c] = a;
+		_vertexFaces[a].push_back(f);
+	}
+	std::vector<unsigned>().swap(_vertexFaces[b]);
+	std::vector<unsigned>& faces = _vertexFaces[a];
+	faces.erase(std::remove_if(faces.begin(), faces.end(), [this](unsigned f) { return _faceRemoved[f]; }), faces.end());
+
+	std::vector<unsigned> ring;
+	neighbours(a, ring);
+	for (unsigned v : ring)
+	{
+		Collapse next;
+		if (evaluate(a, v, next))
+		{
+			_heap.push_back(next);
+			std::push_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Collapses the cheapest edges until at most maxTriangles are left or no edge can collapse anymore.
+/// Entries of the heap whose vertices changed are skipped, the changed edges were pushed again. A
+/// conservative collapse whose surroundings moved since it was evaluated is evaluated again.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Mesh* MeshSimplifier::simplify(size_t maxTriangles)
+{
+	std::vector<Plane> planes;
+	QVector3D direction;
+	while (_numFaces > maxTriangles and not _heap.empty())
+	{
+		std::pop_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+		Collapse next = _heap.back();
+		_heap.pop_back();
+
+		if (_removed[next.a] or _removed[next.b] or _versions[next.a] != next.versionA or _versions[next.b] != next.versionB)
+			continue;
+		if (_conservative)
+			planesAround(next.a, next.b, planes, direction);
+		if (_conservative and not isOutside(planes, next.pos))
+		{
+			Collapse again;
+			if (evaluate(next.a, next.b, again))
+			{
+				_heap.push_back(again);
+				std::push_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+			}
+			continue;
+		}
+		if (canCollapse(next))
+			collapse(next);
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->_name = _mesh.getName();
+	mesh->_fullyTriangulated = true;
+	std::vector<unsigned> number(_positions.size(), NONE);
+	mesh->_triangleIndices.reserve(_numFaces * Triangle::NUM_VERTICES);
+	for (size_t f = 0; f < _faces.size(); f++)
+	{
+		if (_faceRemoved[f])
+			continue;
+		for (unsigned v : _faces[f])
+		{
+			if (number[v] == NONE)
+			{
+				number[v] = mesh->_vertices.size();
+				mesh->_vertices.push_back(_positions[v]);
+			}
+			mesh->_triangleIndices.push_back(number[v]);
+		}
+	}
+	mesh->recalcMinMax();
+	mesh->compactIndices();
+	return mesh;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <QVector3D>
+#include <array>
+#include <vector>
+
+class Mesh;
+
+/**
+ * Quadric error simplification by edge collapses (Garland and Heckbert). Every vertex carries the
+ * sum of the squared distances to the planes of its triangles, an edge collapses into the point
+ * which adds the least error. Edges on the border of open meshes get extra planes, so borders keep
+ * their shape.
+ *
+ * A conservative simplifier only places collapsed vertices outside of the planes of all triangles
+ * around the edge (progressive hulls, Sander et al.), so every result contains the mesh it was
+ * simplified from and heightmaps of it cover the heightmaps of the mesh. Outside is taken from the
+ * signed volume of every connected part, so parts with inverted winding work too.
+ *
+ * simplify() can be called with decreasing limits to get a series of levels of detail.
+ */
+class MeshSimplifier
+{
+public:
+
+	MeshSimplifier(const Mesh& mesh, bool conservative);
+
+	Mesh*	simplify(size_t maxTriangles); /// continues collapsing and returns a copy of the result.
+
+private:
+
+	/// symmetric 4x4 matrix of the plane distances, upper triangle row by row.
+	struct Quadric
+	{
+		double	q[10];
+
+		Quadric();
+		void	addPlane(const QVector3D& normal, double offset, double weight);
+		void	operator+=(const Quadric& other);
+		double	error(const QVector3D& v) const;
+		bool	optimum(QVector3D& v) const; /// false if the minimum is not unique
+	};
+
+	/// collapse of edge (a, b) into a at pos, stale if a vertex changed since it was evaluated.
+	struct Collapse
+	{
+		double		cost;
+		unsigned	a;
+		unsigned	b;
+		unsigned	versionA;
+		unsigned	versionB;
+		QVector3D	pos;
+
+		inline bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	/// plane of a triangle with the normal pointing outside.
+	struct Plane
+	{
+		QVector3D	normal;
+		float		offset;
+	};
+
+	typedef std::array<unsigned, 3> Face;
+
+	bool		evaluate(unsigned a, unsigned b, Collapse& collapse) const;
+	void		planesAround(unsigned a, unsigned b, std::vector<Plane>& planes, QVector3D& direction) const;
+	bool		pushOut(const std::vector<Plane>& planes, const QVector3D& direction, float maxDistance, QVector3D& pos) const;
+	bool		isOutside(const std::vector<Plane>& planes, const QVector3D& pos) const;
+	bool		canCollapse(const Collapse& collapse) const;
+	void		collapse(const Collapse& collapse);
+	QVector3D	faceNormal(const Face& face) const; /// not normalized, twice the area long
+	void		neighbours(unsigned v, std::vector<unsigned>& out) const;
+
+	const Mesh&					_mesh;
+	bool						_conservative;
+	std::vector<float>			_outside;	/// per triangle: 1 if its part is wound counter clockwise seen from outside, else -1
+	float						_slack;		/// distance inside the planes which is taken as rounding
+	std::vector<QVector3D>		_positions;
+	std::vector<Quadric>		_quadrics;
+	std::vector<unsigned>		_versions;	/// bumped on every change of a vertex
+	std::vector<bool>			_removed;	/// vertices collapsed into others
+	std::vector<Face>			_faces;
+	std::vector<bool>			_faceRemoved;
+	std::vector<std::vector<unsigned>>	_vertexFaces; /// may list removed faces
+	std::vector<Collapse>		_heap;
+	size_t						_numFaces;
+};
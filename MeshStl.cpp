@@ -0,0 +1,241 @@
+#include <QString>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "config.h"
+#include "Mesh.h"
+#include "Exception.h"
+#include "TextParser.h"
+#include "MeshInput.h"
+#include "TaskPool.h"
+
+static const size_t STL_HEADER_SIZE = 80;
+static const size_t STL_FACET_SIZE = 50; /// normal, 3 vertices, attribute byte count
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline float readFloatLE(const char* data)
+{
+	quint32 bits;
+	memcpy(&bits, data, sizeof(bits));
+	bits = qFromLittleEndian(bits);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void readStlFacets(const char* facets, size_t numFacets, QVector3D* corners)
+{
+	// the corners are read straight from the input, the normals are ignored.
+	TaskPool::instance().parallelFor(0, numFacets, [&](size_t i)
+	{
+		const char* vertex = facets + i * STL_FACET_SIZE + 3 * sizeof(float);
+		for (unsigned c = 0; c < Triangle::NUM_VERTICES; c++, vertex += 3 * sizeof(float))
+			corners[i * Triangle::NUM_VERTICES + c] = QVector3D(readFloatLE(vertex), readFloatLE(vertex + 4), readFloatLE(vertex + 8));
+	}, TaskPool::ELEMENT_GRAIN);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A binary STL file is an 80 byte header, the number of facets and 50 bytes per facet. ASCII files
+/// start with "solid", but so do the headers of some binary files. A file is read as ASCII if it
+/// starts with "solid" and has a "facet" near the beginning, unless its size fits the facet count of
+/// a binary file. The size of a compressed file is not known in advance, there the text decides.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseStl(MeshInput& input)
+{
+	const size_t BINARY_START = STL_HEADER_SIZE + sizeof(quint32);
+	const size_t ASCII_PROBE_SIZE = 1024;
+	const char* FACET = "facet";
+	input.fill();
+	while (not input.finished() and (size_t)(input.end() - input.begin()) < std::max(BINARY_START, ASCII_PROBE_SIZE))
+		input.fill();
+
+	const char* begin = input.begin();
+	size_t size = input.end() - begin;
+	const char* probeEnd = begin + std::min(size, ASCII_PROBE_SIZE);
+	TextParser probe(begin, probeEnd);
+	probe.skipEmptyLines();
+	bool ascii = probe.startsWith("solid") and std::search(begin, probeEnd, FACET, FACET + strlen(FACET)) != probeEnd;
+
+	bool binary = false;
+	quint32 numFacets = 0;
+	if (size >= BINARY_START)
+	{
+		memcpy(&numFacets, begin + STL_HEADER_SIZE, sizeof(numFacets));
+		numFacets = qFromLittleEndian(numFacets);
+		binary = not ascii or (input.finished() and size == BINARY_START + (size_t)numFacets * STL_FACET_SIZE);
+	}
+
+	std::vector<QVector3D> corners;
+	if (binary)
+	{
+		// the facet count of a mapped file is checked against its size before anything is allocated,
+		// a stream could claim any count and gets its corners a window at a time.
+		if (input.finished())
+		{
+			size_t available = (size - BINARY_START) / STL_FACET_SIZE;
+			if (available < numFacets)
+				THROW(MeshException, QString("\'%1\' is truncated, %2 of %3 facets are missing.").arg(_filename,
+										QString::number(numFacets - available), QString::number(numFacets)));
+			corners.resize((size_t)numFacets * Triangle::NUM_VERTICES);
+		}
+		input.consume(begin + BINARY_START);
+		size_t done = 0;
+		while (done < numFacets)
+		{
+			size_t count = std::min<size_t>(numFacets - done, (input.end() - input.begin()) / STL_FACET_SIZE);
+			if (count == 0 and not input.fill())
+				break;
+			if (corners.size() < (done + count) * Triangle::NUM_VERTICES)
+				corners.resize((done + count) * Triangle::NUM_VERTICES);
+			readStlFacets(input.begin(), count, corners.data() + done * Triangle::NUM_VERTICES);
+			input.consume(input.begin() + count * STL_FACET_SIZE);
+			done += count;
+		}
+		if (done < numFacets)
+			THROW(MeshException, QString("\'%1\' is truncated, %2 of %3 facets are missing.").arg(_filename,
+									QString::number(numFacets - done), QString::number(numFacets)));
+		weldCorners(corners);
+		return;
+	}
+
+	TextParser in(begin, input.end());
+	in.skipEmptyLines();
+	if (not in.startsWith("solid"))
+		THROW(MeshException, QString("\'%1\' is neither a binary nor an ASCII STL file.").arg(_filename));
+
+	size_t line = 1;
+	while (input.fill() or input.begin() != input.end())
+	{
+		const char* stop = input.linesEnd();
+		parseAsciiStl(input.begin(), stop, line, corners);
+		input.consume(stop);
+	}
+	weldCorners(corners);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Only the "vertex x y z" lines of an ASCII STL file matter, every three of them form a triangle.
+/// The text is cut into newline aligned chunks which collect their vertices in parallel, the chunks
+/// are then appended to corners in order. line is the line number of begin and is moved behind end.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Mesh::parseAsciiStl(const char* begin, const char* end, size_t& line, std::vector<QVector3D>& corners)
+{
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+	size_t max_chunks = TaskPool::instance().numThreads() * 4;
+	max_chunks = std::max<size_t>(1, std::min<size_t>(max_chunks, (end - begin) / MIN_CHUNK_SIZE));
+
+	std::vector<const char*> bounds = TextParser::splitLines(begin, end, max_chunks);
+	size_t numChunks = bounds.size() - 1;
+	std::vector<std::vector<QVector3D> > chunkCorners(numChunks);
+	std::vector<size_t> chunkLines(numChunks, 0);
+	std::vector<size_t> errorLines(numChunks, 0); /// line of the first broken vertex in a chunk, relative to the chunk
+
+	TaskPool::instance().parallelFor(0, numChunks, [&](size_t i)
+	{
+		TextParser in(bounds[i], bounds[i + 1], 0);
+		for (; not in.atEnd(); in.nextLine())
+		{
+			if (in.atLineEnd() or not in.startsWith("vertex"))
+				continue;
+
+			in.skipWord();
+			float coord[3];
+			if (not in.read(coord[0]) or not in.read(coord[1]) or not in.read(coord[2]))
+			{
+				errorLines[i] = in.line() + 1;
+				break;
+			}
+			chunkCorners[i].push_back(QVector3D(coord[0], coord[1], coord[2]));
+		}
+		chunkLines[i] = in.line();
+	});
+
+	for (size_t i = 0; i < numChunks; i++)
+	{
+		if (errorLines[i])
+			THROW(MeshException, QString("in %1:%2 failed to read vertex.").arg(_filename, QString::number(line + errorLines[i] - 1)));
+		corners.insert(corners.end(), chunkCorners[i].begin(), chunkCorners[i].end());
+		std::vector<QVector3D>().swap(chunkCorners[i]);
+		line += chunkLines[i];
+	}
+}
+
+#ifdef ENABLE_TESTS
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <cassert>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// loads a binary STL grid on its own, from inside an OpenMP loop, where nested regions get fewer
+/// threads, and from inside tasks of the pool, and checks that every load welds it into the same mesh.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void test_stl_loading()
+{
+	const unsigned GRID = 40;
+	QString filename = QDir::tempPath() + "/qmeshpack_test_grid.stl";
+	{
+		QFile file(filename);
+		bool opened = file.open(QIODevice::WriteOnly);
+		assert(opened);
+		(void)opened;
+		char header[STL_HEADER_SIZE] = {};
+		file.write(header, STL_HEADER_SIZE);
+		quint32 numFacets = qToLittleEndian<quint32>(2 * GRID * GRID);
+		file.write((const char*)&numFacets, sizeof(numFacets));
+		for (unsigned y = 0; y < GRID; y++)
+			for (unsigned x = 0; x < GRID; x++)
+				for (unsigned half = 0; half < 2; half++)
+				{
+					float facet[12] = { 0.f, 0.f, 1.f,
+										(float)x, (float)y, 0.f,
+										(float)x + 1, (float)y + half, 0.f,
+										(float)x + 1 - half, (float)y + 1, 0.f };
+					char record[STL_FACET_SIZE] = {};
+					for (unsigned i = 0; i < 12; i++)
+					{
+						quint32 bits;
+						memcpy(&bits, &facet[i], sizeof(bits));
+						bits = qToLittleEndian(bits);
+						memcpy(record + i * sizeof(bits), &bits, sizeof(bits));
+					}
+					file.write(record, STL_FACET_SIZE);
+				}
+	}
+
+	Mesh reference(filename.toUtf8().constData());
+	assert(reference.numTriangles() == 2 * GRID * GRID);
+	assert(reference.numVertices() == (GRID + 1) * (GRID + 1));
+
+	const int LOADS = 8;
+	std::vector<char> same(2 * LOADS, 0);
+	auto check = [&](int load)
+	{
+		Mesh mesh(filename.toUtf8().constData());
+		bool equal = mesh.numVertices() == reference.numVertices() and mesh.numTriangles() == reference.numTriangles();
+		for (size_t corner = 0; equal and corner < 3 * mesh.numTriangles(); corner++)
+			equal = mesh.getVertex(mesh.index(corner)) == reference.getVertex(reference.index(corner));
+		same[load] = equal;
+	};
+	#ifdef USE_OPENMP
+	#pragma omp parallel for
+	#endif
+	for (int load = 0; load < LOADS; load++)
+		check(load);
+	TaskPool::instance().parallelFor(LOADS, 2 * LOADS, [&](size_t load) { check(load); });
+	for (int load = 0; load < 2 * LOADS; load++)
+		assert(same[load]);
+
+	QFile::remove(filename);
+	qDebug() << "stl loading: all tests passed";
+}
+#endif
@@ -1,52 +1,385 @@
 #include "Node.h"
+#include "HeightmapCache.h"
+#include "TaskPool.h"
 #include <memory>
-#include <QtConcurrent/QtConcurrentRun>
 using namespace std;
 
+namespace
+{
+	const size_t	MAX_DRAWN_TRIANGLES = 1 << 18;	/// larger meshes get levels of detail and the view draws the finest one below this
+	const double	PROXY_TRIANGLES_PER_PIXEL = 4.;	/// more triangles per pixel of the images add no detail
+	const unsigned	MAX_PROXY_LEVELS = 16;			/// more levels of detail than buildLods() makes for a mesh which fits into memory
+	const unsigned	MAX_STAND_IN_CELLS = 32;		/// columns of the stand-in of a lightweight node along its longer side
+
+	/// the corners of a cell counter-clockwise seen from above, and the neighbour across the edge from corner k to k + 1.
+	const int		CELL_CORNERS[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+	const int		CELL_NEIGHBOURS[4][2] = { {0, -1}, {1, 0}, {0, 1}, {-1, 0} };
+
+	/////////////////////////////////////////////////////////////////////////////////////////////////////
+	///
+	/// Builds what a lightweight node is drawn with: a column per cell of a coarse grid over the images,
+	/// from the lowest bottom to the highest top of its pixels, with walls where the neighbour is lower
+	/// or missing. The dilation is taken off the heights, the footprint keeps it. At most
+	/// MAX_STAND_IN_CELLS squared columns take a few hundred KB at worst, 0 if no pixel is set.
+	///
+	/////////////////////////////////////////////////////////////////////////////////////////////////////
+	shared_ptr<Mesh> buildStandIn(const Image& top, const Image& bottom, QVector3D origin, unsigned dilation, float pixelSize, const QString& name)
+	{
+		unsigned radius = Image::dilationRadius(dilation, pixelSize);
+		if (top.getWidth() <= 2 * radius or top.getHeight() <= 2 * radius)
+			return shared_ptr<Mesh>();
+		unsigned width = top.getWidth() - 2 * radius, height = top.getHeight() - 2 * radius;
+		unsigned cell = (max(width, height) + MAX_STAND_IN_CELLS - 1) / MAX_STAND_IN_CELLS;
+		int columns = (width + cell - 1) / cell, rows = (height + cell - 1) / cell;
+
+		vector<float> high(columns * rows, -INFINITY), low(columns * rows, INFINITY);
+		for (quint32 y = radius; y < radius + height; y++)
+		{
+			for (const Image::Span* span = top.spansBegin(y); span != top.spansEnd(y); ++span)
+			{
+				for (quint32 x = max<quint32>(span->begin, radius); x < min<quint32>(span->end, radius + width); x++)
+				{
+					if (not bottom.hasPixelAt(x, y))
+						continue;
+					size_t c = (y - radius) / cell * columns + (x - radius) / cell;
+					high[c] = max(high[c], top.at(x, y) - dilation);
+					low[c] = min(low[c], bottom.at(x, y) + dilation);
+				}
+			}
+		}
+
+		vector<QVector3D> vertices;
+		vector<unsigned> indices;
+		auto quad = [&](const QVector3D& a, const QVector3D& b, const QVector3D& c, const QVector3D& d)
+		{
+			unsigned first = vertices.size();
+			vertices.insert(vertices.end(), { a, b, c, d });
+			indices.insert(indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+		};
+
+		for (int j = 0; j < rows; j++)
+		{
+			for (int i = 0; i < columns; i++)
+			{
+				size_t c = j * columns + i;
+				if (high[c] < low[c])
+					continue;
+				float x[4], y[4];
+				for (unsigned k = 0; k < 4; k++)
+				{
+					x[k] = origin.x() + min<unsigned>((i + CELL_CORNERS[k][0]) * cell, width) * pixelSize;
+					y[k] = origin.y() + min<unsigned>((j + CELL_CORNERS[k][1]) * cell, height) * pixelSize;
+				}
+				auto at = [&](unsigned k, float z) { return QVector3D(x[k], y[k], origin.z() + z); };
+				quad(at(0, high[c]), at(1, high[c]), at(2, high[c]), at(3, high[c]));
+				quad(at(3, low[c]), at(2, low[c]), at(1, low[c]), at(0, low[c]));
+
+				// the parts of the column which stand out of the neighbour's column
+				for (unsigned k = 0; k < 4; k++)
+				{
+					int ni = i + CELL_NEIGHBOURS[k][0], nj = j + CELL_NEIGHBOURS[k][1];
+					bool inside = ni >= 0 and ni < columns and nj >= 0 and nj < rows;
+					size_t n = inside ? nj * columns + ni : 0;
+					float spans[2][2] = { { low[c], high[c] }, { 1., 0. } };
+					if (inside and high[n] >= low[n])
+					{
+						spans[0][0] = max(low[c], high[n]);
+						spans[1][0] = low[c];
+						spans[1][1] = min(high[c], low[n]);
+					}
+					unsigned next = (k + 1) % 4;
+					for (unsigned s = 0; s < 2; s++)
+						if (spans[s][0] < spans[s][1])
+							quad(at(k, spans[s][0]), at(next, spans[s][0]), at(next, spans[s][1]), at(k, spans[s][1]));
+				}
+			}
+		}
+		if (indices.empty())
+			return shared_ptr<Mesh>();
+		return make_shared<Mesh>(move(vertices), move(indices), name);
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-Node::Node(QString filename, unsigned dilation)	:
+Node::Node(QString filename, unsigned dilation, float pixelSize, bool lightweight, const QByteArray& bytes)	:
+	_filename(filename),
+	_lightweight(lightweight),
+	_normals(false),
+	_fullyTriangulated(true),
+	_numVertices(0),
+	_numTriangles(0),
 	_top(0),
 	_bottom(0),
-	_dilation(dilation)
+	_dilation(dilation),
+	_pixelSize(pixelSize),
+	_scale(1., 1., 1.),
+	_topBottomVolume(0.)
 {
-    _mesh = new Mesh(filename.toUtf8().constData());
-	auto_ptr<Mesh> mesh_guard(_mesh);
-	rebuildImages();
-	mesh_guard.release();
 	_transform.setToIdentity();
+	_name = Mesh::nameOf(filename);
+	if (HeightmapCache::instance().isEnabled())
+		_contentHash = bytes.isEmpty() ? HeightmapCache::contentHash(filename) : HeightmapCache::contentHash(bytes.constData(), bytes.size());
+
+	// a lightweight node with cached images needs nothing of its mesh file but the hash
+	if (lightweight and not _contentHash.isEmpty() and loadCachedImages())
+		return;
+
+	shared_ptr<Mesh> mesh = loadMesh(lightweight ? RasterLevels : DrawnLevels, bytes);
+	_min = mesh->getMin();
+	_max = mesh->getMax();
+	_fullyTriangulated = mesh->wasFullyTriangulated();
+	rebuildImages(mesh.get());
+	if (not lightweight)
+		_mesh = mesh;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Node::~Node()
 {	
-	delete _mesh;
 	delete _top;
 	delete _bottom;		
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-void Node::rebuildImages()
+///
+/// reads the mesh file again and brings the mesh into the state the node's mesh had: scaled, renamed
+/// and with normals if they were asked for. Large meshes get levels of detail down to the coarsest
+/// one which is used, for the images or also for drawing. Both pick their level from the same chain
+/// whether the node is lightweight or not, so the images and their cache key are the same.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+shared_ptr<Mesh> Node::loadMesh(Levels levels, const QByteArray& bytes) const
 {
-#if defined (USE_QTCONCURRENT) or defined (USE_OPENMP)
-	QFuture<Image*> futureTop =  QtConcurrent::run([this](){return new Image(*_mesh, Image::Top, _dilation);});
-	QFuture<Image*> futureBottom =  QtConcurrent::run([this](){return new Image(*_mesh, Image::Bottom, _dilation);});
-	if (_top)
+	shared_ptr<Mesh> mesh(new Mesh(_filename.toUtf8().constData(), bytes));
+	if (_scale != QVector3D(1., 1., 1.))
+		mesh->scale(_scale);
+	mesh->setName(_name);
+	if (levels != NoLevels and mesh->numTriangles() > MAX_DRAWN_TRIANGLES)
 	{
-		delete _top;
-		delete _bottom;
+		size_t rastered = rasteredTriangles(*mesh);
+		mesh->buildLods(levels == DrawnLevels ? min(rastered, MAX_DRAWN_TRIANGLES) : rastered);
 	}
-	_top = futureTop.result();
-	_bottom = futureBottom.result();
-#else
-	_top = new Image(*_mesh, Image::Top, _dilation);
-	_bottom = new Image(*_mesh, Image::Bottom, _dilation);
-#endif
+	if (_normals and not mesh->hasNormals())
+		mesh->buildNormals();
+	return mesh;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t Node::rasteredTriangles(const Mesh& mesh) const
+{
+	QVector3D geometry = mesh.getGeometry();
+	return PROXY_TRIANGLES_PER_PIXEL * geometry.x() * geometry.y() / (_pixelSize * _pixelSize);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Mesh* Node::getMesh()
+{
+	QMutexLocker lock(&_meshMutex);
+	if (not _mesh)
+		_mesh = loadMesh(DrawnLevels);
+	return _mesh.get();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A lightweight node hands out a mesh which is freed once the caller drops it, so exporting a job
+/// does not keep all meshes loaded afterwards.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+shared_ptr<const Mesh> Node::acquireMesh(bool normals) const
+{
+	{
+		QMutexLocker lock(&_meshMutex);
+		if (_mesh)
+		{
+			if (normals and not _mesh->hasNormals())
+				_mesh->buildNormals();
+			return _mesh;
+		}
+	}
+	shared_ptr<Mesh> mesh = loadMesh(NoLevels);
+	if (normals and not mesh->hasNormals())
+		mesh->buildNormals();
+	return mesh;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::buildNormals()
+{
+	_normals = true;
+	QMutexLocker lock(&_meshMutex);
+	if (_mesh and not _mesh->hasNormals())
+		_mesh->buildNormals();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Normals are built here under the lock rather than when the mesh is loaded, so meshes which are
+/// never looked at with lighting do not pay for them. Large meshes are drawn from a level of detail,
+/// which has normals already.
+///
+/// A lightweight node is drawn with the stand-in built from its images, the view never loads a file.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::draw(bool use_lighting) const
+{
+	QMutexLocker lock(&_meshMutex);
+	if (_mesh)
+	{
+		const Mesh* drawn = _mesh->lodWithin(MAX_DRAWN_TRIANGLES);
+		if (use_lighting and not drawn->hasNormals())
+			_mesh->buildNormals();
+		drawn->draw(use_lighting);
+	}
+	else if (_standIn)
+	{
+		if (use_lighting and not _standIn->hasNormals())
+			_standIn->buildNormals();
+		_standIn->draw(use_lighting);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::setName(const QString& name)
+{
+	_name = name;
+	QMutexLocker lock(&_meshMutex);
+	if (_mesh)
+		_mesh->setName(name);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Node::loadCachedImages(const QByteArray& key)
+{
+	HeightmapCache::Entry entry;
+	if (not HeightmapCache::instance().load(key, _name, entry))
+		return false;
+
+	delete _top;
+	delete _bottom;
+	_top = entry.top.release();
+	_bottom = entry.bottom.release();
+	_topBottomVolume = entry.volume;
+	_min = entry.min;
+	_max = entry.max;
+	_fullyTriangulated = entry.fullyTriangulated;
+	_numVertices = entry.numVertices;
+	_numTriangles = entry.numTriangles;
+	rebuildStandIn();
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Without the mesh the level of detail the images were rendered from is not known. The level follows
+/// from the mesh and the other parts of the key, so at most one level has an entry and the few others
+/// are misses which cost a failed open each.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Node::loadCachedImages()
+{
+	for (unsigned level = 0; level < MAX_PROXY_LEVELS; level++)
+		if (loadCachedImages(HeightmapCache::key(_contentHash, _scale, _dilation, _pixelSize, level)))
+			return true;
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The images come from the heightmap cache if this mesh was rasterized before with the same scale,
+/// dilation, pixel size and level of detail, otherwise they are rendered from mesh, or from the node's
+/// mesh if it is 0, and stored in the cache. Only a miss loads the mesh of a lightweight node.
+///
+/// A mesh with far more triangles than its images have pixels, as at coarse pixel sizes, is rendered
+/// from a level of detail. The levels contain the mesh, so the images cover it. A level whose bounding
+/// box grew by more than a pixel is not used, and the bounding box of the node is the one of the
+/// rendered mesh, as the images start at its minimum.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::rebuildImages(const Mesh* mesh)
+{
+	shared_ptr<const Mesh> loaded;
+	if (not mesh)
+	{
+		{
+			QMutexLocker lock(&_meshMutex);
+			loaded = _mesh;
+		}
+		if (not loaded and not _contentHash.isEmpty() and loadCachedImages())
+			return;
+		if (not loaded)
+			loaded = loadMesh(RasterLevels);
+		mesh = loaded.get();
+	}
+	_numVertices = mesh->numVertices();
+	_numTriangles = mesh->numTriangles();
+
+	size_t maxTriangles = rasteredTriangles(*mesh);
+	const Mesh* source = mesh;
+	unsigned proxyLevel = 0;
+	for (size_t level = 1; level < mesh->numLods() and source->numTriangles() > maxTriangles; level++)
+	{
+		const Mesh* lod = mesh->lod(level);
+		QVector3D grown = vecmax(mesh->getMin() - lod->getMin(), lod->getMax() - mesh->getMax());
+		if (grown.x() > _pixelSize or grown.y() > _pixelSize or grown.z() > _pixelSize)
+			break;
+		source = lod;
+		proxyLevel = level;
+	}
+
+	QByteArray key;
+	if (not _contentHash.isEmpty())
+	{
+		key = HeightmapCache::key(_contentHash, _scale, _dilation, _pixelSize, proxyLevel);
+		if (loadCachedImages(key))
+			return;
+	}
+	_min = source->getMin();
+	_max = source->getMax();
+
+	// the bottom is rasterized here while the pool may take the top, a loading task does not wait idle.
+	Image* top = 0;
+	TaskGroup group;
+	group.run([this, source, &top]() { top = new Image(*source, Image::Top, _dilation, _pixelSize); });
+	Image* bottom = new Image(*source, Image::Bottom, _dilation, _pixelSize);
+	group.wait();
+	delete _top;
+	delete _bottom;
+	_top = top;
+	_bottom = bottom;
+
+	_topBottomVolume = _top->diffSum(*_bottom);
+	if (not key.isEmpty())
+		HeightmapCache::instance().store(key, *_top, *_bottom, _min, _max, _topBottomVolume, _fullyTriangulated, _numVertices, _numTriangles);
+	rebuildStandIn();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Runs where the images were built, on the loading or the worker thread, so drawing only swaps in
+/// the finished stand-in.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::rebuildStandIn()
+{
+	if (not _lightweight)
+		return;
+	shared_ptr<Mesh> standIn = buildStandIn(*_top, *_bottom, _min, _dilation, _pixelSize, _name);
+	QMutexLocker lock(&_meshMutex);
+	_standIn = standIn;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void Node::scaleMesh(QVector3D factor)
 {
-	_mesh->scale(factor);
+	{
+		QMutexLocker lock(&_meshMutex);
+		if (_mesh)
+			_mesh->scale(factor);
+	}
+	_min *= factor;
+	_max *= factor;
+	_scale *= factor;
 	rebuildImages();
 }
 
@@ -59,3 +392,25 @@ void Node::setDilationValue(unsigned dil)
 		rebuildImages();
 	}
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void Node::setPixelSize(float pixelSize)
+{
+	if (pixelSize != _pixelSize)
+	{
+		_pixelSize = pixelSize;
+		rebuildImages();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// converts a placement of the top left pixel of the images at (x, y) and the height z into the
+/// position of this node's mesh in mesh units.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+QVector3D Node::imageToWorld(quint32 x, quint32 y, Image::ColorType z) const
+{
+	float border = Image::dilationRadius(_dilation, _pixelSize) * _pixelSize;
+	return QVector3D(x * _pixelSize + border, y * _pixelSize + border, z + _dilation) - _min;
+}
@@ -1,34 +1,60 @@
 #pragma once
 #include <QMatrix4x4>
 #include <QVector3D>
+#include <QMutex>
 #include "Image.h"
 #include <functional>
+#include <memory>
 
 /**
  * creates top and bottom z-buffer for the 3D mesh file.
  *	@param filename: filename of the mesh file.
  *	@param dilation: dilation value for renderings.
+ *	@param pixelSize: edge of a z-buffer pixel in mesh units.
+ *	@param lightweight: drops the mesh once the images are built, see acquireMesh().
+ *	@param bytes: the mesh file if a FileReader read it already, else it is opened.
+ *
+ * A lightweight node keeps only its images and the name, file and bounding box of its mesh, so large
+ * jobs fit into memory. It is displayed as a coarse stand-in built from its images, and its mesh is
+ * loaded from the file again when it is exported. If its images are in the heightmap cache, the mesh
+ * file is only hashed and never parsed.
  */
 class Node
 {
 public:
 
-	Node(QString filename, unsigned dilation = 10);
+	Node(QString filename, unsigned dilation = 10, float pixelSize = 1., bool lightweight = false, const QByteArray& bytes = QByteArray());
 	~Node();	
 
-    const Mesh*     getMesh() const { return _mesh; }
-    Mesh*           getMesh() { return _mesh; }
+	Mesh*			getMesh(); /// loads the mesh of a lightweight node and keeps it.
+	std::shared_ptr<const Mesh>	acquireMesh(bool normals = false) const; /// the kept mesh or a temporary copy loaded from the file.
+	void			buildNormals(); /// builds the normals of the mesh, for a lightweight node whenever it is loaded.
+	void			draw(bool use_lighting) const; /// draws the mesh, or the stand-in of a lightweight node. Normals are built on the first lit draw.
 	const Image*	getTop() const { return _top; }
 	const Image*	getBottom() const { return _bottom; }
 	void			scaleMesh(const QVector3D factor);		
 	void			setDilationValue(unsigned dil);
+	void			setPixelSize(float pixelSize);
+	QVector3D		imageToWorld(quint32 x, quint32 y, Image::ColorType z) const;
 
 	inline void			setPos(QVector3D pos) { _transform.setColumn(3, QVector4D(pos, 1.)); }
 	inline QVector3D	getPos() const { return _transform.column(3).toVector3D(); }
 	inline unsigned		getDilationValue() const  { return _dilation; }
+	inline float		getPixelSize() const { return _pixelSize; }
 	inline QMatrix4x4	getTransform() const { return _transform; }
-	inline double		getAABBVolume() const { return _mesh->getGeometry().x() * _mesh->getGeometry().y() * _mesh->getGeometry().z(); }
-	inline double		getTopBottomVolume() const { return _top->diffSum(*_bottom); }
+	inline bool			isLightweight() const { return _lightweight; }
+	inline QString		getName() const { return _name; }
+	void				setName(const QString& name);
+	inline QString		getFilename() const { return _filename; }
+	inline QVector3D	getMin() const { return _min; } /// bounding box of the images, of the scaled mesh or a level of detail containing it.
+	inline QVector3D	getMax() const { return _max; }
+	inline QVector3D	getGeometry() const { return _max - _min; }
+	inline bool			wasFullyTriangulated() const { return _fullyTriangulated; }
+	inline size_t		numVertices() const { return _numVertices; } /// of the mesh, also while a lightweight node has not loaded it
+	inline size_t		numTriangles() const { return _numTriangles; }
+	inline QVector3D	getScale() const { return _scale; }
+	inline double		getAABBVolume() const { return getGeometry().x() * getGeometry().y() * getGeometry().z(); }
+	inline double		getTopBottomVolume() const { return _topBottomVolume; }
 	struct Orientation
 	{
 		Image*	top;
@@ -38,11 +64,34 @@ public:
 
 private:
 
-	void		rebuildImages();
+	bool		loadCachedImages(const QByteArray& key); /// false on a miss
+	bool		loadCachedImages(); /// of any level of detail, for a node whose mesh is not loaded
+	void		rebuildImages(const Mesh* mesh = 0);
+	void		rebuildStandIn(); /// from the images, for a lightweight node
+	/// how far down a loaded mesh gets levels of detail: none for an export, those the images or also the view use.
+	enum Levels { NoLevels, RasterLevels, DrawnLevels };
 
-	Mesh*		_mesh;
+	std::shared_ptr<Mesh>	loadMesh(Levels levels, const QByteArray& bytes = QByteArray()) const; /// bytes: the mesh file if it was read already
+	size_t		rasteredTriangles(const Mesh& mesh) const; /// more triangles than this add no detail to the images
+
+	mutable std::shared_ptr<Mesh>	_mesh;	/// null for a lightweight node until getMesh() is called
+	std::shared_ptr<Mesh>	_standIn;	/// drawn instead of the mesh of a lightweight node, null if its images are empty
+	mutable QMutex	_meshMutex;	/// guards _mesh and _standIn
+	QString		_filename;
+	QString		_name;
+	QVector3D	_min;
+	QVector3D	_max;
+	bool		_lightweight;
+	bool		_normals;		/// buildNormals() was called
+	bool		_fullyTriangulated;
+	size_t		_numVertices;
+	size_t		_numTriangles;
 	Image*		_top;
 	Image*		_bottom;
 	unsigned	_dilation;
+	float		_pixelSize;
 	QMatrix4x4	_transform;
+	QVector3D	_scale;			/// product of all scaleMesh() factors, part of the heightmap cache key and applied to reloaded meshes
+	QByteArray	_contentHash;	/// of the mesh file, empty if the heightmap cache is not used
+	double		_topBottomVolume;
 };
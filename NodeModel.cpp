@@ -4,8 +4,8 @@
 #include "util.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-NodeModel::NodeModel(QObject *parent, QVector3D geometry, unsigned defaultDilationValue) :
-	QAbstractItemModel(parent), _geometry(geometry), _defaultDilationValue(defaultDilationValue)
+NodeModel::NodeModel(QObject *parent, QVector3D geometry, unsigned defaultDilationValue, float pixelSize) :
+	QAbstractItemModel(parent), _geometry(geometry), _defaultDilationValue(defaultDilationValue), _pixelSize(pixelSize)
 {
 }
 
@@ -77,7 +77,7 @@ bool NodeModel::setData(const QModelIndex & index, const QVariant& value, int ro
 		if (index.column() == (int)Name)
 		{
 			emit dataChanged(index, index);
-			_nodes[index.row()]->getMesh()->setName(value.toString());
+			_nodes[index.row()]->setName(value.toString());
 			return true;
 		}
 		else if (index.column() == (int)Dilation)
@@ -107,16 +107,16 @@ QVariant NodeModel::data(const QModelIndex& index, int role) const
 				{
 					default:
 					case Name:
-                        return node->getMesh()->getName();
+                        return node->getName();
 					case Position:
 						return toString(node->getPos());
 					case Dilation:
 						return node->getDilationValue();
 					case AABBSize:
-						return toString(node->getMesh()->getGeometry());
+						return toString(node->getGeometry());
 					case AABBVolume:
 					{
-						QVector3D geom = node->getMesh()->getGeometry();
+						QVector3D geom = node->getGeometry();
 						return geom.x() * geom.y() * geom.z();
 					}
 				}
@@ -181,7 +181,7 @@ void NodeModel::addNode(Node* node)
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Node* NodeModel::addMesh(const char* filename)
 {
-	Node* node = new Node(filename, _defaultDilationValue);
+	Node* node = new Node(filename, _defaultDilationValue, _pixelSize);
 	beginInsertRows(QModelIndex(), _nodes.size(), _nodes.size() + 1);
 	_nodes.push_back(node);
 	endInsertRows();
@@ -211,6 +211,19 @@ void NodeModel::setGeometry(QVector3D geometry)
 	emit geometryChanged();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void NodeModel::setPixelSize(float pixelSize)
+{
+	if (pixelSize == _pixelSize)
+		return;
+
+	_pixelSize = pixelSize;
+	beginResetModel();
+	for (unsigned i = 0; i < _nodes.size(); i++)
+		_nodes[i]->setPixelSize(pixelSize);
+	endResetModel();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void NodeModel::nodePositionChanged(unsigned i)
 {
@@ -224,8 +237,8 @@ void NodeModel::nodePositionChanged(unsigned i)
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 static bool greaterVolume(const Node* n1, const Node* n2)
 {
-    QVector3D g1 = n1->getMesh()->getGeometry();
-    QVector3D g2 = n2->getMesh()->getGeometry();
+    QVector3D g1 = n1->getGeometry();
+    QVector3D g2 = n2->getGeometry();
 
     return (g1.x() * g1.y() * g1.z()) > (g2.x() * g2.y() * g2.z());
 }
@@ -233,8 +246,8 @@ static bool greaterVolume(const Node* n1, const Node* n2)
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 static bool greaterHeight(const Node* n1, const Node* n2)
 {
-	QVector3D g1 = n1->getMesh()->getGeometry();
-	QVector3D g2 = n2->getMesh()->getGeometry();
+	QVector3D g1 = n1->getGeometry();
+	QVector3D g2 = n2->getGeometry();
 
 	return (g1.y() > g2.y());
 }
@@ -255,9 +268,9 @@ void NodeModel::sort(int column, Qt::SortOrder order)
 	{
 		case Name:
 			if (order == Qt::AscendingOrder)
-				comparator = [](const Node* n1, const Node* n2){ return n1->getMesh()->getName() < n2->getMesh()->getName(); };
+				comparator = [](const Node* n1, const Node* n2){ return n1->getName() < n2->getName(); };
 			else
-				comparator = [](const Node* n1, const Node* n2){ return n1->getMesh()->getName() > n2->getMesh()->getName(); };
+				comparator = [](const Node* n1, const Node* n2){ return n1->getName() > n2->getName(); };
 			break;
 
 		case Position:
@@ -276,9 +289,9 @@ void NodeModel::sort(int column, Qt::SortOrder order)
 
 		case AABBSize:
 			if (order == Qt::AscendingOrder)
-				comparator = [](const Node* n1, const Node* n2){ return n1->getMesh()->getGeometry() < n2->getMesh()->getGeometry(); };
+				comparator = [](const Node* n1, const Node* n2){ return n1->getGeometry() < n2->getGeometry(); };
 			else
-				comparator = [](const Node* n1, const Node* n2){ return n1->getMesh()->getGeometry() > n2->getMesh()->getGeometry(); };
+				comparator = [](const Node* n1, const Node* n2){ return n1->getGeometry() > n2->getGeometry(); };
 			break;
 
 		case AABBVolume: // AABB Volume
@@ -323,7 +336,7 @@ double NodeModel::nodesVolume() const
 	double volume = 0.;
 	for (unsigned i = 0; i < _nodes.size(); i++)
 	{
-		volume += _nodes[i]->getMesh()->aabbVolume();
+		volume += _nodes[i]->getAABBVolume();
 	}
 	return volume;
 }
@@ -18,7 +18,7 @@ public:
 		AABBVolume
 	};
 
-	explicit NodeModel(QObject *parent, QVector3D geometry = QVector3D(400., 400., 1000.), unsigned defaultDilationValue = 0);
+	explicit NodeModel(QObject *parent, QVector3D geometry = QVector3D(400., 400., 1000.), unsigned defaultDilationValue = 0, float pixelSize = 1.);
 	virtual ~NodeModel();
 
 	Qt::ItemFlags flags(const QModelIndex & index) const;
@@ -39,6 +39,10 @@ public:
 	void		sortByBBoxSize();
 	unsigned	getDefaultDilationValue() const { return _defaultDilationValue; }
 	void		setDefaultDilationValue(unsigned defaultDilationValue) { _defaultDilationValue = defaultDilationValue; }
+	float		getPixelSize() const { return _pixelSize; }
+	quint32		getBaseWidth() const { return _geometry.x() / _pixelSize; } /// box width in pixels
+	quint32		getBaseHeight() const { return _geometry.y() / _pixelSize; } /// box height in pixels
+	void		setPixelSize(float pixelSize);
 	double		nodesVolume() const;
 
 
@@ -62,4 +66,5 @@ private:
 	QVector3D			_geometry;
 	std::vector<Node*>	_nodes;
 	unsigned			_defaultDilationValue;
+	float				_pixelSize; /// edge of a z-buffer pixel in mesh units, used by all nodes.
 };
@@ -0,0 +1,277 @@
+#include <QSettings>
+#include <algorithm>
+#include "config.h"
+#include "TaskPool.h"
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+/// queues of threads outside the pool, more of them than threads which spawn tasks at once.
+static const unsigned OUTSIDE_QUEUES = 16;
+
+/// index of the queue of the calling thread, -1 until it spawns a task.
+static thread_local int t_queue = -1;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool& TaskPool::instance()
+{
+	static TaskPool pool; // magic statics are thread safe in c++11
+	return pool;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The cores are the ones the process may run on, which is less than the machine has under taskset
+/// or in a container with a cpuset. The first one of them is left to the waiting thread when the
+/// workers are pinned.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::TaskPool() :
+	_queued(0),
+	_nextOutside(0),
+	_stopping(false)
+{
+	std::vector<int> cpus;
+	#ifdef Q_OS_LINUX
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &set))
+				cpus.push_back(cpu);
+	#endif
+	unsigned cores = cpus.empty() ? std::max(1, QThread::idealThreadCount()) : cpus.size();
+
+	QSettings settings(APP_VENDOR, APP_NAME);
+	unsigned maxThreads = settings.value("max_threads", 0).toUInt(); // 0: all cores
+	bool pin = settings.value("pin_threads", false).toBool() and not cpus.empty();
+
+	_numThreads = maxThreads > 0 ? maxThreads : cores;
+	_numWorkers = std::max(1u, _numThreads - 1);
+	for (unsigned i = 0; i < _numWorkers + OUTSIDE_QUEUES; i++)
+		_queues.emplace_back(new Queue());
+	for (unsigned i = 0; i < _numWorkers; i++)
+	{
+		_workers.emplace_back(new Worker(*this, i, pin ? cpus[(i + 1) % cpus.size()] : -1));
+		_workers.back()->start();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::~TaskPool()
+{
+	{
+		QMutexLocker lock(&_mutex);
+		_stopping = true;
+		_wake.wakeAll();
+	}
+	for (size_t i = 0; i < _workers.size(); i++)
+		_workers[i]->wait();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// A task per thread pulls chunks off a shared counter, so the chunks start in order and a slow one
+/// does not hold up the others. The caller runs one of the tasks, unless a worker took it first.
+/// Every task keeps pulling until the range is done, so with maxTasks fewer tasks than threads the
+/// other threads stay free for other tasks all along.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskPool::parallelFor(size_t begin, size_t end, const std::function<void (size_t)>& body, size_t grain, size_t maxTasks)
+{
+	if (begin >= end)
+		return;
+	grain = std::max<size_t>(grain, 1);
+	size_t numChunks = (end - begin + grain - 1) / grain;
+	std::atomic<size_t> next(0);
+	auto runChunks = [&]()
+	{
+		for (size_t chunk = next++; chunk < numChunks; chunk = next++)
+		{
+			size_t last = std::min(end, begin + (chunk + 1) * grain);
+			for (size_t i = begin + chunk * grain; i < last; i++)
+				body(i);
+		}
+	};
+
+	size_t numTasks = std::min<size_t>(numChunks, maxTasks > 0 ? std::min<size_t>(maxTasks, _numThreads) : _numThreads);
+	TaskGroup group;
+	for (size_t i = 0; i < numTasks; i++)
+		group.run(runChunks);
+	group.wait();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::Queue& TaskPool::ownQueue()
+{
+	if (t_queue < 0)
+		t_queue = _numWorkers + _nextOutside++ % OUTSIDE_QUEUES;
+	return *_queues[t_queue];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskPool::push(Task* task)
+{
+	Queue& queue = ownQueue();
+	{
+		QMutexLocker lock(&queue.mutex);
+		queue.tasks.push_back(task);
+	}
+	_queued++;
+
+	QMutexLocker lock(&_mutex);
+	_wake.wakeOne();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::Task* TaskPool::popOwn(const TaskGroup* group)
+{
+	Queue& queue = ownQueue();
+	QMutexLocker lock(&queue.mutex);
+	if (queue.tasks.empty() or (group and queue.tasks.back()->group != group))
+		return 0;
+	Task* task = queue.tasks.back();
+	queue.tasks.pop_back();
+	_queued--;
+	return task;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::Task* TaskPool::steal(unsigned thief)
+{
+	for (size_t i = 1; i < _queues.size(); i++)
+	{
+		Queue& queue = *_queues[(thief + i) % _queues.size()];
+		QMutexLocker lock(&queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		Task* task = queue.tasks.front();
+		queue.tasks.pop_front();
+		_queued--;
+		return task;
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The group is told under its mutex, a waiter which saw the last task done may destroy the group
+/// right after.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskPool::execute(Task* task)
+{
+	TaskGroup* group = task->group;
+	try
+	{
+		task->function();
+	}
+	catch (...)
+	{
+		QMutexLocker lock(&group->_mutex);
+		if (not group->_exception)
+			group->_exception = std::current_exception();
+	}
+	delete task;
+
+	QMutexLocker lock(&group->_mutex);
+	if (--group->_pending == 0)
+		group->_done.wakeAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskPool::work(unsigned index)
+{
+	t_queue = index;
+	for (;;)
+	{
+		Task* task = popOwn(0);
+		if (not task)
+			task = steal(index);
+		if (task)
+		{
+			execute(task);
+			continue;
+		}
+
+		QMutexLocker lock(&_mutex);
+		while (_queued == 0 and not _stopping)
+			_wake.wait(&_mutex);
+		if (_stopping)
+			return;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskPool::Worker::Worker(TaskPool& pool, unsigned index, int cpu) :
+	_pool(pool),
+	_index(index),
+	_cpu(cpu)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskPool::Worker::run()
+{
+	#ifdef Q_OS_LINUX
+	if (_cpu >= 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(_cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	#endif
+	_pool.work(_index);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskGroup::TaskGroup() :
+	_pool(TaskPool::instance()),
+	_pending(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TaskGroup::~TaskGroup()
+{
+	join();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::run(std::function<void ()> function)
+{
+	_pending++;
+	_pool.push(new TaskPool::Task { function, this });
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::wait()
+{
+	join();
+	if (_exception)
+	{
+		std::exception_ptr exception = _exception;
+		_exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::join()
+{
+	for (;;)
+	{
+		TaskPool::Task* task = _pool.popOwn(this);
+		if (task)
+		{
+			_pool.execute(task);
+			continue;
+		}
+
+		QMutexLocker lock(&_mutex);
+		if (_pending == 0)
+			return;
+		_done.wait(&_mutex);
+	}
+}
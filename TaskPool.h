@@ -0,0 +1,132 @@
+#pragma once
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class TaskGroup;
+
+/**
+ * The one pool of threads which loading, rasterization and placement run on. Before it they started
+ * OpenMP teams and QtConcurrent runs of their own, which nested into each other and started more
+ * threads than there are cores. Tasks are spawned into a TaskGroup and may spawn and wait for groups
+ * of their own.
+ *
+ * Every thread which spawns tasks has a deque of them. It runs its newest task first, idle workers
+ * steal the oldest task of another deque. A thread which waits for a group runs the tasks of that
+ * group which are still in its own deque and sleeps once the rest is stolen. So a waiting task does
+ * not block a worker while its subtasks are queued, and it never picks up unrelated work.
+ *
+ * The cap is the "max_threads" setting, 0 (the default) means one thread per core the process may
+ * run on. One thread of the cap is left to the thread which waits for a job, there is at least one
+ * worker. With "pin_threads" every worker is bound to a core of its own (Linux only). Loops which
+ * may run inside tasks, like the ones of the mesh parsers, use parallelFor() rather than OpenMP, so
+ * they nest into the pool instead of starting teams of their own.
+ */
+class TaskPool
+{
+public:
+
+	static const size_t	ELEMENT_GRAIN = 1 << 12; /// for loops over vertices, corners and the like, a cheap body needs many indices per chunk
+
+	static TaskPool&	instance();
+	~TaskPool();
+
+	inline unsigned	numThreads() const { return _numThreads; } /// the cap, workers and one waiting thread
+
+	/// body(i) for all i in [begin, end), grain consecutive indices at a time in increasing order,
+	/// like an OpenMP loop with a dynamic schedule. The calling thread takes part and waits. At most
+	/// maxTasks threads run the loop, 0 means all of them, so a long loop can leave threads to the
+	/// work which runs beside it.
+	void	parallelFor(size_t begin, size_t end, const std::function<void (size_t)>& body, size_t grain = 1, size_t maxTasks = 0);
+
+private:
+
+	friend class TaskGroup;
+
+	struct Task
+	{
+		std::function<void ()>	function;
+		TaskGroup*				group;
+	};
+
+	/// the tasks spawned by one thread, the owner works at the back and thieves at the front.
+	struct Queue
+	{
+		QMutex				mutex;
+		std::deque<Task*>	tasks;
+	};
+
+	class Worker : public QThread
+	{
+	public:
+
+		Worker(TaskPool& pool, unsigned index, int cpu);
+
+	protected:
+
+		void	run();
+
+	private:
+
+		TaskPool&	_pool;
+		unsigned	_index;
+		int			_cpu; /// the worker is bound to, -1 if it is not pinned
+	};
+
+	TaskPool();
+	TaskPool(const TaskPool& other);
+	TaskPool& operator=(const TaskPool& other);
+
+	Queue&	ownQueue(); /// of the calling thread, threads outside the pool share a few queues
+	void	push(Task* task);
+	Task*	popOwn(const TaskGroup* group); /// the newest task of the calling thread if it belongs to group, any if group is null
+	Task*	steal(unsigned thief); /// the oldest task of another queue
+	void	execute(Task* task);
+	void	work(unsigned index);
+
+	unsigned	_numThreads;
+	unsigned	_numWorkers;
+	std::vector<std::unique_ptr<Queue>>		_queues; /// one per worker, then the ones of threads outside the pool
+	std::vector<std::unique_ptr<Worker>>	_workers;
+	std::atomic<int>		_queued;		/// tasks in all queues
+	std::atomic<unsigned>	_nextOutside;	/// hands out the queues of threads outside the pool
+	bool					_stopping;
+	QMutex					_mutex;
+	QWaitCondition			_wake;			/// a task was queued or the pool stops
+};
+
+/**
+ * Tasks which are waited for together. The destructor waits as well, so tasks may use the locals of
+ * the scope which spawned them. The first exception thrown by a task is thrown again by wait().
+ */
+class TaskGroup
+{
+public:
+
+	TaskGroup();
+	~TaskGroup();
+
+	void	run(std::function<void ()> function);
+	void	wait();
+
+private:
+
+	friend class TaskPool;
+
+	TaskGroup(const TaskGroup& other);
+	TaskGroup& operator=(const TaskGroup& other);
+
+	void	join(); /// waits without throwing
+
+	TaskPool&			_pool;
+	std::atomic<int>	_pending;	/// spawned tasks which are not done
+	std::exception_ptr	_exception;
+	QMutex				_mutex;
+	QWaitCondition		_done;		/// the last pending task is done
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/**
+ * Cursor over a block of ASCII text which is parsed in place, e.g. a memory mapped mesh file. Numbers
+ * are read with std::from_chars, no QString or stream is involved. The cursor counts the lines it
+ * passes, so the loaders can report line numbers in their errors. A '#' starts a comment which
+ * lasts until the end of the line.
+ */
+class TextParser
+{
+public:
+
+	inline TextParser(const char* begin, const char* end, size_t firstLine = 1) : _pos(begin), _end(end), _line(firstLine) {}
+
+	inline bool			atEnd() const { return _pos >= _end; }
+	inline size_t		line() const { return _line; }
+	inline const char*	pos() const { return _pos; }
+
+	/// skips spaces, tabs and carriage returns, but stays on the current line.
+	inline void skipBlanks()
+	{
+		while (_pos < _end and (*_pos == ' ' or *_pos == '\t' or *_pos == '\r'))
+			_pos++;
+	}
+
+	/// true if only blanks or a comment are left on the current line.
+	inline bool atLineEnd()
+	{
+		skipBlanks();
+		return _pos >= _end or *_pos == '\n' or *_pos == '#';
+	}
+
+	/// moves to the beginning of the next line, the rest of the current line is ignored.
+	inline void nextLine()
+	{
+		const char* newline = (const char*)memchr(_pos, '\n', _end - _pos);
+		_pos = newline ? newline + 1 : _end;
+		_line++;
+	}
+
+	/// moves to the next line which has something else than blanks and comments on it.
+	inline void skipEmptyLines()
+	{
+		while (_pos < _end and atLineEnd())
+			nextLine();
+		skipBlanks();
+	}
+
+	/// true if the next word starts with prefix. The cursor does not move.
+	inline bool startsWith(const char* prefix)
+	{
+		skipBlanks();
+		size_t length = strlen(prefix);
+		return (size_t)(_end - _pos) >= length and memcmp(_pos, prefix, length) == 0;
+	}
+
+	/// true if the next word is exactly word, e.g. "v" matches "v 1 2 3" but not "vn 0 0 1".
+	inline bool startsWithWord(const char* word)
+	{
+		if (not startsWith(word))
+			return false;
+		const char* next = _pos + strlen(word);
+		return next >= _end or *next == ' ' or *next == '\t' or *next == '\r' or *next == '\n';
+	}
+
+	/// skips the next word, i.e. everything up to the next blank or newline.
+	inline void skipWord()
+	{
+		skipBlanks();
+		skipRestOfWord();
+	}
+
+	/// skips what is left of the current word, e.g. "/2/3" behind the 1 of "1/2/3".
+	inline void skipRestOfWord()
+	{
+		while (_pos < _end and *_pos != ' ' and *_pos != '\t' and *_pos != '\r' and *_pos != '\n')
+			_pos++;
+	}
+
+	/// returns the next word on the current line and moves past it, empty at the end of the line.
+	inline std::string readWord()
+	{
+		skipBlanks();
+		const char* begin = _pos;
+		skipWord();
+		return std::string(begin, _pos);
+	}
+
+	/// reads the next number on the current line, returns false if there is none.
+	template<class T>
+	inline bool read(T& value)
+	{
+		skipBlanks();
+		const char* begin = (_pos < _end and *_pos == '+') ? _pos + 1 : _pos;
+		std::from_chars_result result = std::from_chars(begin, _end, value);
+		if (result.ec != std::errc())
+			return false;
+		_pos = result.ptr;
+		return true;
+	}
+
+	/// splits [begin, end) into at most count pieces of similar size, each piece starts at the beginning
+	/// of a line. Returns the boundaries, piece i is [result[i], result[i + 1]).
+	static std::vector<const char*> splitLines(const char* begin, const char* end, size_t count)
+	{
+		std::vector<const char*> result(1, begin);
+		size_t step = (end - begin) / (count ? count : 1) + 1;
+		while (result.back() < end)
+		{
+			const char* pos = result.back() + step;
+			if (pos >= end)
+			{
+				result.push_back(end);
+				break;
+			}
+			const char* newline = (const char*)memchr(pos, '\n', end - pos);
+			result.push_back(newline ? newline + 1 : end);
+		}
+		return result;
+	}
+
+private:
+
+	const char*	_pos;	/// current position
+	const char*	_end;	/// end of the text
+	size_t		_line;	/// line number of the current position
+};
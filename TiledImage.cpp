@@ -0,0 +1,225 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "TiledImage.h"
+#include "ImageKernels.h"
+#include "Exception.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/// tiles are allocated in chunks of one huge page (2 MiB on x86-64), 128 tiles each.
+static const size_t CHUNK_SIZE = 2 * 1024 * 1024;
+static const size_t TILES_PER_CHUNK = CHUNK_SIZE / (TiledImage::TILE_PIXELS * sizeof(TiledImage::ColorType));
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static void* allocateChunk()
+{
+#ifdef __linux__
+	void* mem = mmap(0, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem != MAP_FAILED)
+	{
+		madvise(mem, CHUNK_SIZE, MADV_HUGEPAGE); // only a hint, ignore failure.
+		return mem;
+	}
+	return 0;
+#else
+	return malloc(CHUNK_SIZE);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+static void freeChunk(void* chunk)
+{
+#ifdef __linux__
+	munmap(chunk, CHUNK_SIZE);
+#else
+	free(chunk);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TiledImage::TiledImage(quint32 width, quint32 height) :
+	_floorTile(TILE_PIXELS, 0.),
+	_chunkTilesLeft(0),
+	_numAllocated(0),
+	_width(width),
+	_height(height),
+	_tilesX((width + TILE_MASK) >> TILE_SHIFT),
+	_tilesY((height + TILE_MASK) >> TILE_SHIFT),
+	_minColor(INFINITY),
+	_maxColor(-INFINITY)
+{
+	if (width == 0 or height == 0)
+		THROW(ImageException, "bad geometry");
+
+	_tiles.assign((size_t)_tilesX * _tilesY, &_floorTile[0]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TiledImage::~TiledImage()
+{
+	releaseTiles();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TiledImage::releaseTiles()
+{
+	for (size_t i = 0; i < _chunks.size(); i++)
+		freeChunk(_chunks[i]);
+
+	_chunks.clear();
+	_chunkTilesLeft = 0;
+	_numAllocated = 0;
+	std::fill(_tiles.begin(), _tiles.end(), &_floorTile[0]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Returns the tile containing (x, y), allocating it first if it still is the shared floor tile.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+TiledImage::ColorType* TiledImage::writableTile(quint32 x, quint32 y)
+{
+	ColorType*& tile = _tiles[tileIndex(x, y)];
+	if (tile != &_floorTile[0])
+		return tile;
+
+	if (_chunkTilesLeft == 0)
+	{
+		void* chunk = allocateChunk();
+		if (not chunk)
+			THROW(ImageException, "out of memory while allocating base image tiles");
+		_chunks.push_back(chunk);
+		_chunkTilesLeft = TILES_PER_CHUNK;
+	}
+
+	tile = (ColorType*)_chunks.back() + (TILES_PER_CHUNK - _chunkTilesLeft) * TILE_PIXELS;
+	_chunkTilesLeft--;
+	_numAllocated++;
+	memcpy(tile, &_floorTile[0], TILE_PIXELS * sizeof(ColorType));
+	return tile;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TiledImage::setPixel(quint32 x, quint32 y, ColorType color)
+{
+	assert(x < _width and y < _height);
+	writableTile(x, y)[pixelIndex(x, y)] = color;
+	_minColor = std::min(_minColor, color);
+	_maxColor = std::max(_maxColor, color);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TiledImage::setAllPixelsTo(ColorType value)
+{
+	releaseTiles();
+	std::fill(_floorTile.begin(), _floorTile.end(), value);
+	_minColor = _maxColor = value;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void TiledImage::insertAt(quint32 x, quint32 y, quint32 z, const Image& other)
+{
+	if ((x + other.getWidth() > _width) or (y + other.getHeight() > _height))
+		THROW(ImageException, "images overlap");
+
+	QRect bounds = other.getBounds();
+	for (int other_y = bounds.top(); other_y <= bounds.bottom(); other_y++)
+	{
+		quint32 base_y = y + other_y;
+		for (const Image::Span* span = other.spansBegin(other_y); span != other.spansEnd(other_y); ++span)
+		{
+			// a span is split into the parts that are contiguous inside of a tile row.
+			quint32 other_x = span->begin;
+			while (other_x < span->end)
+			{
+				quint32 base_x = x + other_x;
+				quint32 count = std::min(span->end - other_x, TILE_SIZE - (base_x & TILE_MASK));
+				ColorType* dst = writableTile(base_x, base_y) + pixelIndex(base_x, base_y);
+				for (quint32 i = 0; i < count; i++)
+				{
+					ColorType color = z + other.at(other_x + i, other_y);
+					dst[i] = color;
+					_minColor = std::min(_minColor, color);
+					_maxColor = std::max(_maxColor, color);
+				}
+				other_x += count;
+			}
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Tiles which were never written are read from the shared floor tile, so they behave like a flat
+/// floor without being allocated.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+Image::offset_info TiledImage::findMinZDistanceAt(quint32 current_x, quint32 current_y, const Image* bottom, ColorType threshold) const
+{
+	if ((current_x + bottom->getWidth() > _width) or (current_y + bottom->getHeight() > _height))
+		THROW(ImageException, "images overlap");
+
+	ColorType min_z = INFINITY;
+	quint32 min_x = 0;
+	quint32 min_y = 0;
+	bool early_rejection = false;
+
+	ImageRegion bottomRegion = bottom->region();
+	QRect bounds = bottom->getBounds();
+	for (quint32 y = bounds.top(); (int)y <= bounds.bottom(); y++)
+	{
+		quint32 base_y = current_y + y;
+		const ColorType* bottomRow = bottomRegion.row(y);
+		for (const Image::Span* span = bottom->spansBegin(y); span != bottom->spansEnd(y); ++span)
+		{
+			quint32 x = span->begin;
+			while (x < span->end)
+			{
+				quint32 base_x = current_x + x;
+				quint32 count = std::min(span->end - x, TILE_SIZE - (base_x & TILE_MASK));
+				const ColorType* base = _tiles[tileIndex(base_x, base_y)] + pixelIndex(base_x, base_y);
+				size_t idx = ImageKernels::minDiff(bottomRow + x, base, count, min_z);
+				if (idx != count)
+				{
+					min_x = x + idx;
+					min_y = y;
+				}
+
+				#ifdef ENABLE_EARLY_TERMINATION
+				if (min_z < threshold)
+				{
+					early_rejection = true;
+					goto out;
+				}
+				#endif
+
+				x += count;
+			}
+		}
+	}
+
+	assert(min_z != INFINITY && "impossible since at least base image has minimum height everywhere." );
+
+out:
+
+	Image::offset_info info = {min_x, min_y, min_z, early_rejection};
+	return info;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// The view points into the tile table, so it is only valid until the tile is written for the first
+/// time or the tiles are released. Tiles at the right and bottom border are cut to the image size.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+ImageRegion TiledImage::tileRegion(quint32 x, quint32 y) const
+{
+	assert(x < _width and y < _height);
+	quint32 tile_x = x & ~TILE_MASK;
+	quint32 tile_y = y & ~TILE_MASK;
+	return ImageRegion(_tiles[tileIndex(x, y)], 0, TILE_SIZE, std::min(TILE_SIZE, _width - tile_x), std::min(TILE_SIZE, _height - tile_y));
+}
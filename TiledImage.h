@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include "Image.h"
+
+/**
+ * Heightmap which stores its pixels in square tiles of TILE_SIZE x TILE_SIZE instead of one row-major
+ * array. It is used as the base image while packing: a footprint of height h touches only a few
+ * neighbouring tiles instead of h rows that are a whole box width apart in memory.
+ *
+ * Tiles are allocated on the first write. Until then a tile points to a single shared floor tile, so
+ * areas of the box which stay at the floor height cost no memory. Allocated tiles come from chunks
+ * which are backed by transparent huge pages on linux to keep TLB misses low.
+ */
+class TiledImage
+{
+public:
+
+	typedef Image::ColorType ColorType;
+
+	static const quint32 TILE_SHIFT = 6;
+	static const quint32 TILE_SIZE = 1U << TILE_SHIFT; /// tile edge in pixels (64)
+	static const quint32 TILE_MASK = TILE_SIZE - 1;
+	static const quint32 TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+	TiledImage(quint32 width, quint32 height);
+	~TiledImage();
+
+	inline quint32		getWidth() const { return _width; }
+	inline quint32		getHeight() const { return _height; }
+	inline ColorType	maxColor() const { return _maxColor; }
+	inline ColorType	minColor() const { return _minColor; }
+	inline ColorType	at(quint32 x, quint32 y) const { return _tiles[tileIndex(x, y)][pixelIndex(x, y)]; }
+	inline size_t		numAllocatedTiles() const { return _numAllocated; }
+	ImageRegion			tileRegion(quint32 x, quint32 y) const; /// view of the tile containing (x, y), without copying.
+	void				setPixel(quint32 x, quint32 y, ColorType color);
+	void				setAllPixelsTo(ColorType value);
+	void				insertAt(quint32 x, quint32 y, quint32 z, const Image& other);
+	Image::offset_info	findMinZDistanceAt(quint32 current_x, quint32 current_y, const Image *bottom, ColorType threshold) const;
+
+private:
+
+	TiledImage(const TiledImage& other);
+	TiledImage& operator=(const TiledImage& other);
+
+	/// index of the tile containing (x, y) inside of _tiles.
+	inline size_t tileIndex(quint32 x, quint32 y) const { return (size_t)(y >> TILE_SHIFT) * _tilesX + (x >> TILE_SHIFT); }
+	/// index of the pixel (x, y) inside of its tile.
+	static inline quint32 pixelIndex(quint32 x, quint32 y) { return ((y & TILE_MASK) << TILE_SHIFT) | (x & TILE_MASK); }
+
+	ColorType*	writableTile(quint32 x, quint32 y);
+	void		releaseTiles();
+
+	std::vector<ColorType*>	_tiles;		/// tile table, row of tiles after row of tiles.
+	std::vector<ColorType>	_floorTile;	/// shared tile for all tiles which were never written.
+	std::vector<void*>		_chunks;	/// memory chunks the tiles are carved from.
+	size_t					_chunkTilesLeft; /// free tiles in the last chunk.
+	size_t					_numAllocated; /// number of tiles that were written to.
+	quint32		_width;		/// image width
+	quint32		_height;	/// image height
+	quint32		_tilesX;	/// number of tiles in a row
+	quint32		_tilesY;	/// number of tile rows
+	ColorType	_minColor;	/// minimum color of this image
+	ColorType	_maxColor;	/// maximum color of this image
+};
@@ -1,5 +1,7 @@
 #include <QAtomicInt>
 #include <QDateTime>
+#include <QMutex>
+#include <QWaitCondition>
 #include <QtConcurrent/QtConcurrentMap>
 #include <QCoreApplication>
 #include <cassert>
@@ -7,14 +9,21 @@
 #include <QStringList>
 #include <QSettings>
 #include <stdexcept>
+#include <algorithm>
 #include <cstring>
 #include <vector>
 #include <atomic>
+#include <memory>
 #include "WorkerThread.h"
+#include "TiledImage.h"
+#include "MeshExporter.h"
+#include "FileReader.h"
+#include "TaskPool.h"
 #include "config.h"
 #ifdef USE_OPENMP
 #include <omp.h>
 #endif
+
 /*
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void WorkerThread::computePositions()
@@ -59,8 +68,8 @@ void WorkerThread::computePositions()
 								best_y = y;
 								best_x = x;
 								threshold = info.offset;
-								double h = z - node->getMesh()->getMin().z()
-											 + node->getMesh()->getMax().z()
+								double h = z - node->getMin().z()
+											 + node->getMax().z()
 											 + node->getDilationValue();
 								if (h > max_height)
 									max_height = h;
@@ -74,7 +83,7 @@ void WorkerThread::computePositions()
 		if (max_height > _nodes.getGeometry().z())
 			break; // nodes don't fit in the box anymore.
 
-		QVector3D newPos = QVector3D(best_x, best_y, best_z) - node->getMesh()->getMin() +
+		QVector3D newPos = QVector3D(best_x, best_y, best_z) - node->getMin() +
 						   QVector3D(node->getDilationValue(), node->getDilationValue(), node->getDilationValue());
 
 		base.insertAt(best_x, best_y, best_z, *(node->getTop()));
@@ -93,8 +102,9 @@ WorkerThread::WorkerThread(QObject *parent, NodeModel &nodes) :
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void WorkerThread::run()
 {
+	// OpenMP regions outside of the pool's tasks, e.g. of the exporter, stay within its cap too
 	#ifdef USE_OPENMP
-	omp_set_num_threads(QThread::idealThreadCount());
+	omp_set_num_threads(TaskPool::instance().numThreads());
 	#endif
 
 	quint64 time = QDateTime::currentDateTime().toMSecsSinceEpoch();
@@ -121,6 +131,11 @@ void WorkerThread::run()
 				makeNormals();
 				break;
 
+			case LoadAndComputePositions:
+				if (_args.isValid())
+					loadAndComputePositions();
+				break;
+
 			default:
 				assert(0 && "bad task was selected, this should never happen");
 				break;
@@ -147,30 +162,20 @@ void WorkerThread::makeNormals()
     QAtomicInt progress_atom(0);
 
 	size_t num_nodes = _nodes.numNodes();
-	#ifdef USE_OPENMP
-	#pragma omp parallel for
-	#endif
 	#ifndef USE_QTCONCURRENT
-	for (unsigned i = 0; i < num_nodes; i++)
+	TaskPool::instance().parallelFor(0, num_nodes, [this, &progress_atom](size_t i)
 	{
-		Mesh* mesh = _nodes.getNode(i)->getMesh();
-		if (not mesh->hasNormals())
-		{
-			emit report(QString("processing mesh \"%1\"").arg(mesh->getName()), Console::Info);
-			mesh->buildNormals();
-		}
+		Node* node = _nodes.getNode(i);
+		emit report(QString("processing mesh \"%1\"").arg(node->getName()), Console::Info);
+		node->buildNormals();
 		emit reportProgress(progress_atom.fetchAndAddRelaxed(1));
-	}
+	});
 	#else
 	std::function<void (Node* node)> mapBuildNormals =
 	[this, &progress_atom](Node* node)
 	{
-		Mesh* mesh = node->getMesh();
-		if (not mesh->hasNormals())
-		{
-			emit report(QString("processing mesh \"%1\"").arg(mesh->getName()), Console::Info);
-			mesh->buildNormals();
-		}
+		emit report(QString("processing mesh \"%1\"").arg(node->getName()), Console::Info);
+		node->buildNormals();
 		emit reportProgress(progress_atom.fetchAndAddRelaxed(1));
 	};
 
@@ -188,25 +193,42 @@ void WorkerThread::saveNodeList()
 		return;
 	}
 
-	emit reportProgressMax(_nodes.numNodes());
-
-	const Node* node = _nodes.getNode(0);
-	emit report(QString("processing mesh \"%1\"").arg(node->getMesh()->getName()), Console::Info);
-    Mesh aggregate(*node->getMesh());
-
-	for (unsigned i = 1; i < _nodes.numNodes(); i++)
+	// every node is written with its own offset, no aggregate mesh is built. The mesh of a lightweight
+	// node is loaded only while its blocks are written, the header takes the counts the node kept.
+	MeshExporter exporter(filename);
+	bool normals = MeshExporter::formatOf(filename) == MeshExporter::Ply; // the only format which carries them
+	QStringList names;
+	std::vector<std::shared_ptr<const Mesh>> meshes;
+	for (unsigned i = 0; i < _nodes.numNodes(); i++)
 	{
-		emit reportProgress(i);
-		node = _nodes.getNode(i);
-		emit report(tr("processing mesh \"%1\"").arg(node->getMesh()->getName()), Console::Info);
-        aggregate.add(*node->getMesh(), node->getPos());
-		if (_shouldStop)
+		const Node* node = _nodes.getNode(i);
+		if (node->isLightweight())
 		{
-			emit report(tr("saving aborted"), Console::Notify);
-			break;
+			QVector3D scale = node->getScale();
+			QString identity = QString("%1 %2 %3 %4").arg(node->getFilename()).arg(scale.x()).arg(scale.y()).arg(scale.z());
+			MeshExporter::Source source = { [node, normals]() { return node->acquireMesh(normals); },
+											node->numVertices(), node->numTriangles(), normals, node->getName(), identity };
+			exporter.addPart(source, node->getTransform());
 		}
+		else
+		{
+			meshes.push_back(node->acquireMesh(normals));
+			exporter.addPart(meshes.back().get(), node->getTransform());
+		}
+		names << node->getName();
 	}
-	aggregate.save(filename);
+	exporter.setName(names.join("+"));
+
+	bool finished = exporter.write([this](size_t done, size_t total)
+	{
+		if (done == 0)
+			emit reportProgressMax((int)total);
+		emit reportProgress((int)done);
+		return not _shouldStop;
+	});
+
+	if (not finished)
+		emit report(tr("saving aborted"), Console::Notify);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -219,78 +241,79 @@ void WorkerThread::loadNodeList()
 		return;
 	}
 
+    // normals are not built here, a node builds them when it is drawn with lighting or exported
     QSettings settings(APP_VENDOR, APP_NAME);
-    bool build_normals = settings.value("use_lighting", true).toBool();
+    bool lightweight = settings.value("lightweight_nodes", false).toBool(); // meshes are dropped after rasterization
 
     // QStringList is not thread safe even for access
     std::vector<QString> filenames;
+    std::vector<QString> meshFiles;
     for (long i = 0; i < qfilenames.size(); i++)
+    {
         filenames.push_back(qfilenames[i]);
+        meshFiles.push_back(qfilenames[i].split(';')[0]);
+    }
+
+    // the files are read ahead of the threads which parse them, in the order those ask for them
+    FileReader reader(meshFiles, settings.value("files_in_flight", 64).toUInt());
+    reader.start();
 
 	emit reportProgressMax(filenames.size());
 	std::atomic<int> progress_atom(0);
 
 	#ifndef USE_QTCONCURRENT
-	size_t fsize = filenames.size();
-	bool abort = false;
+	std::atomic<bool> abort(false);
+	QMutex mutex;
 
-	#ifdef USE_OPENMP
-	#pragma omp parallel for
-	#endif
-	for (size_t i = 0; i < fsize; i++)
+	// the nodes rasterize on the same pool, their nested tasks do not add threads
+	TaskPool::instance().parallelFor(0, filenames.size(), [&](size_t i)
 	{
-		#ifdef USE_OPENMP
-		#pragma omp flush (abort)
-		#endif
 		if (not abort)
 		{
 			if (_shouldStop)
 			{
 				emit report(tr("aborting!"), Console::Info);
 				abort = true;
-				#ifdef USE_OPENMP
-				#pragma omp flush (abort)
-				#endif
 			}
 
 			QStringList slist =  filenames[i].split(';');
             assert(not slist.isEmpty());
 
-			Node* node = new Node(slist[0].toUtf8().constData(), _nodes.getDefaultDilationValue());
-            if (build_normals)
-                node->getMesh()->buildNormals();
+			QByteArray bytes;
+			reader.take(i, bytes);
+			Node* node = new Node(slist[0].toUtf8().constData(), _nodes.getDefaultDilationValue(), _nodes.getPixelSize(), lightweight, bytes);
 
 			if (slist.size() == 4)
 				node->setPos(QVector3D(slist[1].toDouble(), slist[2].toDouble(), slist[3].toDouble()));
 
 			emit reportProgress(progress_atom++);
-			emit report(tr("loaded %1").arg(node->getMesh()->getName()), Console::Info);
-			if (not node->getMesh()->wasFullyTriangulated())
-				report(tr("warning, mesh %1 was not fully triangulated.").arg(node->getMesh()->getName()), Console::Notify);
+			emit report(tr("loaded %1").arg(node->getName()), Console::Info);
+			if (not node->wasFullyTriangulated())
+				report(tr("warning, mesh %1 was not fully triangulated.").arg(node->getName()), Console::Notify);
 
-			#ifdef USE_OPENMP
-			#pragma omp critical
-			#endif
-			{
-				_nodes.addNode(node);
-			}
+			QMutexLocker lock(&mutex);
+			_nodes.addNode(node);
 		}
-	}
+	});
 	#elif defined USE_QTCONCURRENT
-	std::function<Node* (const QString& str)> mapCreateNode =
-		[this, &progress_atom, build_normals](const QString& str)
+	std::vector<size_t> indices;
+	for (size_t i = 0; i < filenames.size(); i++)
+		indices.push_back(i);
+
+	std::function<Node* (size_t i)> mapCreateNode =
+		[this, &filenames, &reader, &progress_atom, lightweight](size_t i)
 		{
-			QStringList slist =  str.split(';');
-			Node* node = new Node(slist[0].toUtf8().constData(), _nodes.getDefaultDilationValue());
-            if (build_normals)
-                node->getMesh()->buildNormals();
+			QStringList slist =  filenames[i].split(';');
+			QByteArray bytes;
+			reader.take(i, bytes);
+			Node* node = new Node(slist[0].toUtf8().constData(), _nodes.getDefaultDilationValue(), _nodes.getPixelSize(), lightweight, bytes);
 			if (slist.size() == 4)
 				node->setPos(QVector3D(slist[1].toDouble(), slist[2].toDouble(), slist[3].toDouble()));
 
 			emit reportProgress(progress_atom++);
-			emit report(tr("loaded %1").arg(node->getMesh()->getName()), Console::Info);
-			if (not node->getMesh()->wasFullyTriangulated())
-				report(tr("warning, mesh %1 was not fully triangulated.").arg(node->getMesh()->getName()), Console::Notify);
+			emit report(tr("loaded %1").arg(node->getName()), Console::Info);
+			if (not node->wasFullyTriangulated())
+				report(tr("warning, mesh %1 was not fully triangulated.").arg(node->getName()), Console::Notify);
 			return node;
 		};
 
@@ -298,17 +321,170 @@ void WorkerThread::loadNodeList()
 	std::function<void (int, Node*)> reduceAddNode =
 			[this](int, Node* node) { _nodes.addNode(node); };
 
-	_future = QtConcurrent::mappedReduced<int>(filenames, mapCreateNode, reduceAddNode, QtConcurrent::UnorderedReduce);
+	_future = QtConcurrent::mappedReduced<int>(indices, mapCreateNode, reduceAddNode, QtConcurrent::UnorderedReduce);
 	_future.waitForFinished();
 	#endif
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Loads the files in _args and packs them together with the loaded nodes, without waiting for all
+/// files first. A quick pass reads only the vertices of every file for its bounding box, so all parts
+/// can be sorted by volume like sortByBBoxSize() does. Then the files are loaded and rasterized in
+/// that order on the task pool, while this thread places every node as soon as it and the nodes in
+/// front of it are there. Placing the large parts overlaps loading the small ones. Once a node does
+/// not fit the rest is still loaded, but not placed.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void WorkerThread::loadAndComputePositions()
+{
+	QStringList qfilenames = _args.toStringList();
+	if (qfilenames.isEmpty())
+	{
+		report(tr("no files given"), Console::Error);
+		return;
+	}
+
+	QSettings settings(APP_VENDOR, APP_NAME);
+	bool lightweight = settings.value("lightweight_nodes", false).toBool(); // meshes are dropped after rasterization
+	unsigned dilation = _nodes.getDefaultDilationValue();
+	float pixelSize = _nodes.getPixelSize();
+	unsigned filesInFlight = settings.value("files_in_flight", 64).toUInt();
+
+	/// a loaded node or a file to pack.
+	struct Part
+	{
+		QString		filename;	/// empty for a loaded node
+		int			node;		/// index of a loaded node, -1 for a file
+		double		volume;		/// of the bounding box
+	};
+	std::vector<Part> parts;
+	for (unsigned i = 0; i < _nodes.numNodes(); i++)
+	{
+		Part part = { QString(), (int)i, _nodes.getNode(i)->getAABBVolume() };
+		parts.push_back(part);
+	}
+	size_t firstFile = parts.size();
+	for (long i = 0; i < qfilenames.size(); i++)
+	{
+		Part part = { qfilenames[i].split(';')[0], -1, 0. }; // the positions of a list are computed again
+		parts.push_back(part);
+	}
+	emit reportProgressMax(parts.size());
+
+	// pass 1: bounding boxes from the vertices. A file which can not be read goes last, loading it reports the error.
+	std::vector<QString> listOrder;
+	for (size_t i = firstFile; i < parts.size(); i++)
+		listOrder.push_back(parts[i].filename);
+	std::unique_ptr<FileReader> reader(new FileReader(listOrder, filesInFlight));
+	reader->start();
+
+	TaskPool::instance().parallelFor(firstFile, parts.size(), [&](size_t i)
+	{
+		if (_shouldStop)
+			return;
+		try
+		{
+			QByteArray bytes;
+			reader->take(i - firstFile, bytes);
+			QVector3D min, max;
+			Mesh::scanBounds(parts[i].filename.toUtf8().constData(), min, max, bytes);
+			QVector3D geometry = max - min;
+			parts[i].volume = geometry.x() * geometry.y() * geometry.z();
+		}
+		catch (const std::exception&)
+		{
+			parts[i].volume = -1.;
+		}
+	});
+	std::stable_sort(parts.begin(), parts.end(), [](const Part& a, const Part& b) { return a.volume > b.volume; });
+
+	// the files are read again in packing order, from the page cache if they are small enough to stay there
+	std::vector<QString> packingOrder;
+	std::vector<long> fileIndex(parts.size(), -1);
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (parts[i].node >= 0)
+			continue;
+		fileIndex[i] = packingOrder.size();
+		packingOrder.push_back(parts[i].filename);
+	}
+	reader.reset(new FileReader(packingOrder, filesInFlight));
+	reader->start();
+
+	// pass 2: the files are loaded in packing order, every node is handed over as soon as it is there.
+	// The loading runs on half of the threads at most, the others are left to the placement.
+	std::vector<Node*> loaded(parts.size(), 0);
+	std::vector<char> ready(parts.size(), 0);
+	QMutex mutex;
+	QWaitCondition arrived;
+	TaskGroup loading;
+	loading.run([&]()
+	{
+		TaskPool::instance().parallelFor(0, parts.size(), [&](size_t i)
+		{
+			Node* node = 0;
+			if (parts[i].node < 0 and not _shouldStop)
+			{
+				try
+				{
+					QByteArray bytes;
+					reader->take(fileIndex[i], bytes);
+					node = new Node(parts[i].filename, dilation, pixelSize, lightweight, bytes);
+					emit report(tr("loaded %1").arg(node->getName()), Console::Info);
+					if (not node->wasFullyTriangulated())
+						emit report(tr("warning, mesh %1 was not fully triangulated.").arg(node->getName()), Console::Notify);
+				}
+				catch (const std::exception& ex)
+				{
+					emit report(tr("failed to load %1: %2").arg(parts[i].filename, QString::fromUtf8(ex.what())), Console::Error);
+				}
+			}
+
+			QMutexLocker lock(&mutex);
+			loaded[i] = node;
+			ready[i] = 1;
+			arrived.wakeAll();
+		}, 1, std::max(1u, TaskPool::instance().numThreads() / 2));
+	});
+
+	BaseImage base(_nodes.getBaseWidth(), _nodes.getBaseHeight());
+	base.setAllPixelsTo(0.);
+	std::atomic<float> max_height(-INFINITY);
+	bool placing = true;
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		unsigned index = parts[i].node;
+		if (parts[i].node < 0)
+		{
+			Node* node;
+			{
+				QMutexLocker lock(&mutex);
+				while (not ready[i])
+					arrived.wait(&mutex);
+				node = loaded[i];
+			}
+			if (not node)
+				continue;
+			_nodes.addNode(node);
+			index = _nodes.numNodes() - 1;
+		}
+
+		placing = placing and not _shouldStop and placeNode(base, index, max_height);
+		emit reportProgress(i);
+	}
+	loading.wait();
+
+	if (placing)
+		emit report(tr("max height is %1").arg(max_height), Console::Info);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 bool WorkerThread::nodeFits(const Node* node) const
 {
 	QVector3D geometry = _nodes.getGeometry();
-	return	(node->getTop()->getWidth() <= geometry.x()) and
-			(node->getTop()->getHeight() <= geometry.y()) and
+	return	(node->getTop()->getWidth() <= _nodes.getBaseWidth()) and
+			(node->getTop()->getHeight() <= _nodes.getBaseHeight()) and
 			((node->getTop()->maxColor() - node->getBottom()->minColor()) <= geometry.z());
 
 }
@@ -328,101 +504,98 @@ void WorkerThread::computePositions()
 {	    
 	emit reportProgressMax(_nodes.numNodes()); // Signal to GUI: setting
 
-	Image base(_nodes.getGeometry().x(), _nodes.getGeometry().y());
+	BaseImage base(_nodes.getBaseWidth(), _nodes.getBaseHeight());
 	base.setAllPixelsTo(0.);
 	std::atomic<float> max_height(-INFINITY); // A variable that keeps track of the highest feature to
 	std::atomic<int> progress_atom(0);
 
 	for (size_t i = 0; i < _nodes.numNodes() and not _shouldStop; i++)
 	{
-		Node* node = _nodes.getNode(i);
-		emit report(tr("processing Mesh ") + node->getMesh()->getName(), Console::Info);
+		if (not placeNode(base, i, max_height))
+			break;
+		emit reportProgress(progress_atom++);
+	}
 
-		Image::ColorType best_z = INFINITY;
-		unsigned best_x = 0; // current best X position
-		unsigned best_y = 0; // current best Y position
-		float threshold = -INFINITY;
+	emit report(tr("max height is %1").arg(max_height), Console::Info);
+}
 
-		if (not nodeFits(node))
-		{
-			emit report(QString("mesh ") + node->getMesh()->getName() + tr(" does not fit at all."), Console::Error);
-			break;
-		}
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Puts node i at the lowest position on base, the first one in y and then x order among equally
+/// low ones. Returns false if the node does not fit, then packing stops.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool WorkerThread::placeNode(BaseImage& base, unsigned i, std::atomic<float>& max_height)
+{
+	Node* node = _nodes.getNode(i);
+	emit report(tr("processing Mesh ") + node->getName(), Console::Info);
 
-		unsigned max_y = _nodes.getGeometry().y() - node->getTop()->getHeight();
-		unsigned max_x = _nodes.getGeometry().x() - node->getTop()->getWidth();
+	Image::ColorType best_z = INFINITY;
+	unsigned best_x = 0; // current best X position
+	unsigned best_y = 0; // current best Y position
+	float threshold = -INFINITY;
 
-		bool abort = false;
-		#ifdef USE_OPENMP
-		#pragma omp parallel for collapse(2)
-		#endif
-		for (unsigned y = 0; y < max_y; y++)
+	if (not nodeFits(node))
+	{
+		emit report(QString("mesh ") + node->getName() + tr(" does not fit at all."), Console::Error);
+		return false;
+	}
+
+	unsigned max_y = _nodes.getBaseHeight() - node->getTop()->getHeight();
+	unsigned max_x = _nodes.getBaseWidth() - node->getTop()->getWidth();
+
+	std::atomic<bool> abort(false);
+	QMutex mutex;
+	TaskPool::instance().parallelFor(0, max_y, [&](size_t y)
+	{
+		for (unsigned x = 0; x < max_x and not abort; x++)
 		{
-			for (unsigned x = 0; x < max_x; x++)
+			if (_shouldStop)
 			{
-				#ifdef USE_OPENMP
-				#pragma omp flush (abort)
-				#endif
-				if (not abort)
-				{					
-					if (_shouldStop)
-					{
-						emit report(tr("aborting!"), Console::Info);
-						abort = true;
-						#ifdef USE_OPENMP
-						#pragma omp flush (abort)
-						#endif
-					}
+				emit report(tr("aborting!"), Console::Info);
+				abort = true;
+			}
 
-					const Image* bottom = node->getBottom();
-					Image::offset_info info = base.findMinZDistanceAt(x, y, node->getBottom(), threshold);
-					Image::ColorType z = bottom->at(info.x, info.y) - info.offset;
+			const Image* bottom = node->getBottom();
+			Image::offset_info info = base.findMinZDistanceAt(x, y, node->getBottom(), threshold);
+			Image::ColorType z = bottom->at(info.x, info.y) - info.offset;
 
-					if (not info.early_rejection)
-					{
-						#ifdef USE_OPENMP
-						#pragma omp critical
-						#endif
-						{
-							// axes priority pradicate. Should ideally be specified by the user.
-							if ((z < best_z) or (z == best_z and y < best_y) or (z == best_z and y == best_y and x < best_x))
-							{
-								best_z = z;
-								best_y = y;
-								best_x = x;
-								threshold = info.offset;
-								double h = z - node->getMesh()->getMin().z()
-											 + node->getMesh()->getMax().z()
-											 + node->getDilationValue();
-								if (h > max_height)
-									max_height = h;
-							}
-						}
-					}
+			if (not info.early_rejection)
+			{
+				QMutexLocker lock(&mutex);
+				// axes priority pradicate. Should ideally be specified by the user.
+				if ((z < best_z) or (z == best_z and y < best_y) or (z == best_z and y == best_y and x < best_x))
+				{
+					best_z = z;
+					best_y = y;
+					best_x = x;
+					threshold = info.offset;
+					double h = z - node->getMin().z()
+								 + node->getMax().z()
+								 + node->getDilationValue();
+					if (h > max_height)
+						max_height = h;
 				}
 			}
 		}
+	}, std::max(1u, max_y / (8 * TaskPool::instance().numThreads())));
 
-		if (max_height > _nodes.getGeometry().z())
-		{
-			emit report(tr("mesh ") + node->getMesh()->getName() + tr(" does not fit."), Console::Error);
-			break;
-		}
-		else
-		{
+	if (max_height > _nodes.getGeometry().z())
+	{
+		emit report(tr("mesh ") + node->getName() + tr(" does not fit."), Console::Error);
+		return false;
+	}
+	else
+	{
 
-			QVector3D newPos = QVector3D(best_x, best_y, best_z) - node->getMesh()->getMin() +
-					QVector3D(node->getDilationValue(), node->getDilationValue(), node->getDilationValue());
+		QVector3D newPos = node->imageToWorld(best_x, best_y, best_z);
 
-			base.insertAt(best_x, best_y, best_z, *(node->getTop()));
-			node->setPos(newPos);
+		base.insertAt(best_x, best_y, best_z, *(node->getTop()));
+		node->setPos(newPos);
 
-			emit reportProgress(progress_atom++);
-			emit nodePositionModified(i);
-		}
+		emit nodePositionModified(i);
 	}
-
-	emit report(tr("max height is %1").arg(max_height), Console::Info);
+	return true;
 }
 #elif defined USE_QTCONCURRENT
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -437,94 +610,106 @@ void WorkerThread::computePositions()
 {
 	emit reportProgressMax(_nodes.numNodes());
 
-	Image base(_nodes.getGeometry().x(), _nodes.getGeometry().y());
+	BaseImage base(_nodes.getBaseWidth(), _nodes.getBaseHeight());
 	base.setAllPixelsTo(0.);
 
 	std::atomic<float> max_height(-INFINITY); // A variable that keeps track of the highest feature to
 	std::atomic<int> progress_atom(0);
 
 	for (size_t i = 0; i < _nodes.numNodes(); i++)
-	{		
-		Node* node = _nodes.getNode(i);
-        //emit report(QString("processing Mesh \"%1\"").arg(node->getMesh()->getName()), 0);
+	{
+		if (not placeNode(base, i, max_height))
+			break;
+		emit reportProgress(progress_atom++);
+	}
+}
 
-		Image::ColorType best_z = INFINITY;
-		unsigned best_x = 0;
-		unsigned best_y = 0;
-		float threshold = -INFINITY;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Puts node i at the lowest position on base, the first one in y and then x order among equally
+/// low ones. Returns false if the node does not fit or processing was stopped.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+bool WorkerThread::placeNode(BaseImage& base, unsigned i, std::atomic<float>& max_height)
+{
+	Node* node = _nodes.getNode(i);
+	//emit report(QString("processing Mesh \"%1\"").arg(node->getName()), 0);
 
-		if (not nodeFits(node))
-		{
-			emit report(QString("mesh \"%1\" does not fit at all.").arg(node->getMesh()->getName()), Console::Error);
-			break;
-		}
+	Image::ColorType best_z = INFINITY;
+	unsigned best_x = 0;
+	unsigned best_y = 0;
+	float threshold = -INFINITY;
 
-		unsigned max_y = _nodes.getGeometry().y() - node->getTop()->getHeight();
-		unsigned max_x = _nodes.getGeometry().x() - node->getTop()->getWidth();
+	if (not nodeFits(node))
+	{
+		emit report(QString("mesh \"%1\" does not fit at all.").arg(node->getName()), Console::Error);
+		return false;
+	}
 
-		struct xyz_t { quint32 x, y; Image::ColorType z; Image::ColorType offset; bool rejected; };
+	unsigned max_y = _nodes.getBaseHeight() - node->getTop()->getHeight();
+	unsigned max_x = _nodes.getBaseWidth() - node->getTop()->getWidth();
 
-		std::function<xyz_t (quint64)> mapComputeZ =
-			[this, &base, &progress_atom, &node, &threshold](quint64 coord)
-			{
-				quint32 x = (quint32)(coord & 0xFFFFFFFFU);
-				quint32 y = (quint32)((coord >> 32) & 0xFFFFFFFFU);
-				//qDebug() << QString("%1: %2 %3").arg(coord, 0, 16).arg(x, 0, 16).arg(y, 0, 16);
-				const Image* bottom = node->getBottom();
-				Image::offset_info info = base.findMinZDistanceAt(x, y, node->getBottom(), threshold);
-				Image::ColorType z = bottom->at(info.x, info.y) - info.offset;
+	struct xyz_t { quint32 x, y; Image::ColorType z; Image::ColorType offset; bool rejected; };
 
-				//((*istart) & 0xFFFFFFFFU) << " y: " << (((*istart) >> 32) & 0xFFFFFFFFU)
-				xyz_t out = { x, y, z, info.offset, info.early_rejection };
+	std::function<xyz_t (quint64)> mapComputeZ =
+		[this, &base, &node, &threshold](quint64 coord)
+		{
+			quint32 x = (quint32)(coord & 0xFFFFFFFFU);
+			quint32 y = (quint32)((coord >> 32) & 0xFFFFFFFFU);
+			//qDebug() << QString("%1: %2 %3").arg(coord, 0, 16).arg(x, 0, 16).arg(y, 0, 16);
+			const Image* bottom = node->getBottom();
+			Image::offset_info info = base.findMinZDistanceAt(x, y, node->getBottom(), threshold);
+			Image::ColorType z = bottom->at(info.x, info.y) - info.offset;
 
-				return out;
-			};
+			//((*istart) & 0xFFFFFFFFU) << " y: " << (((*istart) >> 32) & 0xFFFFFFFFU)
+			xyz_t out = { x, y, z, info.offset, info.early_rejection };
 
-		std::function<void (int, xyz_t)> reduceBest = [&max_height, node, &best_x, &best_y, &best_z, &threshold](int a, xyz_t xyz)
+			return out;
+		};
+
+	std::function<void (int, xyz_t)> reduceBest = [&max_height, node, &best_x, &best_y, &best_z, &threshold](int a, xyz_t xyz)
+	{
+		if (not xyz.rejected)
 		{
-			if (not xyz.rejected)
+			(void)a;
+			if ((xyz.z < best_z) or ((xyz.z == best_z) and (xyz.y < best_y)) or ((xyz.z == best_z) and (xyz.y == best_y) and (xyz.x < best_x)))
 			{
-				(void)a;
-				if ((xyz.z < best_z) or ((xyz.z == best_z) and (xyz.y < best_y)) or ((xyz.z == best_z) and (xyz.y == best_y) and (xyz.x < best_x)))
-				{
-					best_z = xyz.z;
-					best_y = xyz.y;
-					best_x = xyz.x;
-					threshold = xyz.offset;
-					double h = best_z - node->getMesh()->getMin().z()
-									   + node->getMesh()->getMax().z()
-									   + node->getDilationValue();
-					if (h > max_height)
-						max_height = h;
-				}
+				best_z = xyz.z;
+				best_y = xyz.y;
+				best_x = xyz.x;
+				threshold = xyz.offset;
+				double h = best_z - node->getMin().z()
+								   + node->getMax().z()
+								   + node->getDilationValue();
+				if (h > max_height)
+					max_height = h;
 			}
-		};
+		}
+	};
 
-		DoubleRangeIterator istart(0, 0, 0, max_x, 0, max_y);
-		DoubleRangeIterator iend = istart.end();
-		_future = QtConcurrent::mappedReduced<int>(istart, iend, mapComputeZ, reduceBest, QtConcurrent::UnorderedReduce);
-		_future.waitForFinished();
-		if (_shouldStop)
-			break;
+	DoubleRangeIterator istart(0, 0, 0, max_x, 0, max_y);
+	DoubleRangeIterator iend = istart.end();
+	_future = QtConcurrent::mappedReduced<int>(istart, iend, mapComputeZ, reduceBest, QtConcurrent::UnorderedReduce);
+	_future.waitForFinished();
+	if (_shouldStop)
+		return false;
 
-		assert(best_x + node->getTop()->getWidth() <= base.getWidth());
-		assert(best_y + node->getTop()->getHeight() <= base.getHeight());
+	assert(best_x + node->getTop()->getWidth() <= base.getWidth());
+	assert(best_y + node->getTop()->getHeight() <= base.getHeight());
 
 
-		QVector3D newPos = QVector3D(best_x, best_y, best_z) - node->getMesh()->getMin() +
-				QVector3D(node->getDilationValue(), node->getDilationValue(), node->getDilationValue());
+	QVector3D newPos = node->imageToWorld(best_x, best_y, best_z);
 
-		if (max_height > _nodes.getGeometry().z())
-		{
-			emit report(tr("mesh ") + node->getMesh()->getName() + tr(" does not fit."), Console::Error);
-			break;
-		}
+	if (max_height > _nodes.getGeometry().z())
+	{
+		emit report(tr("mesh ") + node->getName() + tr(" does not fit."), Console::Error);
+		return false;
+	}
 
-		emit reportProgress(progress_atom++);
-		base.insertAt(best_x, best_y, best_z, *(node->getTop()));
+	base.insertAt(best_x, best_y, best_z, *(node->getTop()));
 
-		node->setPos(newPos);
-        emit nodePositionModified(i);
-	}
+	node->setPos(newPos);
+	emit nodePositionModified(i);
+	return true;
 }
 #endif
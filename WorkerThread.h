@@ -4,8 +4,16 @@
 #include <QFuture>
 //#include <QtConcurrentMap>
 #include <Console.h>
+#include <atomic>
 #include "NodeModel.h"
 
+#ifdef USE_TILED_BASE
+class TiledImage;
+typedef TiledImage BaseImage;
+#else
+typedef Image BaseImage;
+#endif
+
 class WorkerThread : public QThread
 {
 	Q_OBJECT
@@ -17,7 +25,8 @@ public:
 		ComputePositions,
 		SaveMeshList,
         LoadMeshList,
-        MakeNormals
+        MakeNormals,
+        LoadAndComputePositions
 	} _task;
 
     explicit        WorkerThread(QObject *parent, NodeModel &nodes);
@@ -47,6 +56,8 @@ private:
 	void	computePositions();
 	void	saveNodeList();
 	void	loadNodeList();
+	void	loadAndComputePositions();
+	bool	placeNode(BaseImage& base, unsigned i, std::atomic<float>& max_height);
 	bool	nodeFits(const Node* node) const;
 
 	QFuture<void>		_future;
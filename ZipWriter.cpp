@@ -0,0 +1,172 @@
+#include <zlib.h>
+#include <cassert>
+#include <cstring>
+#include "ZipWriter.h"
+#include "Exception.h"
+
+static const quint32	LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const quint32	DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+static const quint32	CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const quint32	END_OF_DIRECTORY_SIGNATURE = 0x06054b50;
+static const quint16	ZIP_VERSION = 20;			/// 2.0, deflate
+static const quint16	FLAG_DATA_DESCRIPTOR = 1 << 3;	/// sizes and crc follow the data
+static const quint16	FLAG_UTF8 = 1 << 11;
+static const quint16	METHOD_DEFLATE = 8;
+static const quint16	DOS_TIME = 0;				/// the entries get a fixed date, so equal layouts give equal files
+static const quint16	DOS_DATE = (1 << 5) | 1;	/// 1980-01-01
+static const quint64	ZIP32_LIMIT = 0xffffffffu;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Each piece is an independent raw deflate stream (negative window bits, no zlib header). Flushing
+/// with Z_SYNC_FLUSH ends it on a byte boundary without a final block, so the next piece can follow
+/// directly. Only the last piece of an entry sets the final block with Z_FINISH.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::Piece::compress(const char* raw, size_t size, bool last)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		THROW(IOException, QString("unable to initialize zlib"));
+
+	data.clear();
+	std::vector<char> out(deflateBound(&stream, size) + 16);
+	stream.next_in = (Bytef*)raw;
+	stream.avail_in = size;
+	stream.next_out = (Bytef*)out.data();
+	stream.avail_out = out.size();
+	int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	size_t written = out.size() - stream.avail_out;
+	deflateEnd(&stream);
+	if (result != (last ? Z_STREAM_END : Z_OK) or stream.avail_in != 0)
+		THROW(IOException, QString("zlib failed to compress %1 bytes").arg(size));
+
+	data.put(out.data(), written);
+	crc = crc32(0, (const Bytef*)raw, size);
+	rawSize = size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+ZipWriter::ZipWriter(const QString& filename) :
+	_out(filename),
+	_inFile(false)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::putLocalHeader(const Entry& entry)
+{
+	_out.putLE(LOCAL_HEADER_SIGNATURE);
+	_out.putLE(ZIP_VERSION);
+	_out.putLE((quint16)(FLAG_DATA_DESCRIPTOR | FLAG_UTF8));
+	_out.putLE(METHOD_DEFLATE);
+	_out.putLE(DOS_TIME);
+	_out.putLE(DOS_DATE);
+	_out.putLE((quint32)0); // crc and sizes are in the data descriptor
+	_out.putLE((quint32)0);
+	_out.putLE((quint32)0);
+	_out.putLE((quint16)entry.name.size());
+	_out.putLE((quint16)0); // extra field length
+	_out.put(entry.name.constData(), entry.name.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::addFile(const QString& name, const QByteArray& contents)
+{
+	Piece piece;
+	piece.compress(contents.constData(), contents.size(), true);
+	beginFile(name);
+	put(piece);
+	endFile();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::beginFile(const QString& name)
+{
+	assert(not _inFile);
+	Entry entry;
+	entry.name = name.toUtf8();
+	entry.crc = 0;
+	entry.compressedSize = 0;
+	entry.size = 0;
+	entry.offset = _out.pos();
+	if (entry.offset > ZIP32_LIMIT)
+		THROW(IOException, QString("zip archive too large at \'%1\'").arg(name));
+
+	putLocalHeader(entry);
+	_entries.push_back(entry);
+	_inFile = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::put(const Piece& piece)
+{
+	assert(_inFile);
+	Entry& entry = _entries.back();
+	entry.crc = crc32_combine(entry.crc, piece.crc, piece.rawSize);
+	entry.compressedSize += piece.data.size();
+	entry.size += piece.rawSize;
+	if (entry.size > ZIP32_LIMIT or entry.compressedSize > ZIP32_LIMIT)
+		THROW(IOException, QString("zip entry \'%1\' too large").arg(QString::fromUtf8(entry.name.constData())));
+	_out.put(piece.data);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::endFile()
+{
+	assert(_inFile);
+	const Entry& entry = _entries.back();
+	_out.putLE(DATA_DESCRIPTOR_SIGNATURE);
+	_out.putLE(entry.crc);
+	_out.putLE((quint32)entry.compressedSize);
+	_out.putLE((quint32)entry.size);
+	_inFile = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::close()
+{
+	assert(not _inFile);
+	quint64 directoryOffset = _out.pos();
+	for (const Entry& entry : _entries)
+	{
+		_out.putLE(CENTRAL_HEADER_SIGNATURE);
+		_out.putLE(ZIP_VERSION); // made by
+		_out.putLE(ZIP_VERSION); // needed to extract
+		_out.putLE((quint16)(FLAG_DATA_DESCRIPTOR | FLAG_UTF8));
+		_out.putLE(METHOD_DEFLATE);
+		_out.putLE(DOS_TIME);
+		_out.putLE(DOS_DATE);
+		_out.putLE(entry.crc);
+		_out.putLE((quint32)entry.compressedSize);
+		_out.putLE((quint32)entry.size);
+		_out.putLE((quint16)entry.name.size());
+		_out.putLE((quint16)0); // extra field length
+		_out.putLE((quint16)0); // comment length
+		_out.putLE((quint16)0); // disk number
+		_out.putLE((quint16)0); // internal attributes
+		_out.putLE((quint32)0); // external attributes
+		_out.putLE((quint32)entry.offset);
+		_out.put(entry.name.constData(), entry.name.size());
+	}
+	quint64 directorySize = _out.pos() - directoryOffset;
+	if (directoryOffset + directorySize > ZIP32_LIMIT)
+		THROW(IOException, QString("zip archive too large"));
+
+	_out.putLE(END_OF_DIRECTORY_SIGNATURE);
+	_out.putLE((quint16)0); // this disk
+	_out.putLE((quint16)0); // disk with the directory
+	_out.putLE((quint16)_entries.size());
+	_out.putLE((quint16)_entries.size());
+	_out.putLE((quint32)directorySize);
+	_out.putLE((quint32)directoryOffset);
+	_out.putLE((quint16)0); // comment length
+	_out.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void ZipWriter::discard()
+{
+	_out.discard();
+}
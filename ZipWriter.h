@@ -0,0 +1,53 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <vector>
+#include "BufferedWriter.h"
+
+/**
+ * Writes a zip archive with deflated entries, as needed for 3MF packages. An entry can be given in
+ * one piece or streamed as a sequence of Pieces. Pieces are raw deflate streams which end on a byte
+ * boundary (Z_SYNC_FLUSH), so they can be compressed on different threads and simply concatenated,
+ * their checksums are combined with crc32_combine. There is no zip64 support, entries and the
+ * archive have to stay below 4 GiB.
+ */
+class ZipWriter
+{
+public:
+
+	/// a compressed part of an entry.
+	struct Piece
+	{
+		ByteBuffer	data;		/// raw deflate output
+		quint32		crc;		/// crc32 of the uncompressed bytes
+		size_t		rawSize;	/// number of uncompressed bytes
+
+		void compress(const char* raw, size_t size, bool last); /// last finishes the deflate stream.
+	};
+
+	ZipWriter(const QString& filename);
+
+	void		addFile(const QString& name, const QByteArray& contents);
+	void		beginFile(const QString& name);
+	void		put(const Piece& piece); /// the piece of the last file has to be compressed with last set.
+	void		endFile();
+	void		close(); /// writes the central directory.
+	void		discard(); /// removes the partial archive.
+
+private:
+
+	struct Entry
+	{
+		QByteArray	name;
+		quint32		crc;
+		quint64		compressedSize;
+		quint64		size;
+		quint64		offset; /// of the local header
+	};
+
+	void		putLocalHeader(const Entry& entry);
+
+	BufferedWriter		_out;
+	std::vector<Entry>	_entries;
+	bool				_inFile;
+};
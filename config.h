@@ -9,6 +9,7 @@
 //#define
 //#define TEST_IMAGE /* draw test image instead of the logo */
 #define ENABLE_EARLY_TERMINATION
+#define USE_TILED_BASE /* base image during packing is stored in 64x64 tiles, see TiledImage */
 /*
  * 1: by biggest volume
  * 2: by biggest height
@@ -1,11 +1,17 @@
 #include "mainwindow.h"
 #include <QApplication>
 #include "util.h"
+#include "ImageKernels.h"
+#include "Mesh.h"
 
 
 int main(int argc, char** argv)
 {
 	//test_iterators();
+	#ifdef ENABLE_TESTS
+	test_image_kernels();
+	test_stl_loading();
+	#endif
 
 	QApplication app(argc, argv);
 	app.setApplicationVersion(APP_VERSION);
@@ -71,6 +71,7 @@ MainWindow::MainWindow() :
 	_conversionFactor = qvariant_cast<float>(settings.value("conversionFactor", 1.));
 	unsigned dilation = qvariant_cast<unsigned>(settings.value("dilation", 00));
 	_modelMeshFiles.setDefaultDilationValue(dilation);
+	_modelMeshFiles.setPixelSize(qvariant_cast<float>(settings.value("pixel_size", 1.)));
 
 	QGLFormat fmt;
 	fmt.setAlpha(true);
@@ -149,6 +150,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
 	settings.setValue("windowState", saveState());	
 	settings.setValue("conversionFactor", _conversionFactor);
 	settings.setValue("dilation", _modelMeshFiles.getDefaultDilationValue());
+	settings.setValue("pixel_size", _modelMeshFiles.getPixelSize());
 	QMainWindow::closeEvent(event);
 }
 
@@ -200,6 +202,10 @@ void MainWindow::createActions()
 	_actProcess->setStatusTip(tr("Starts combining the Meshes."));
 	connect(_actProcess, SIGNAL(triggered()), this, SLOT(processNodes()));
 
+	_actAddAndProcess = new QAction(QIcon(), tr("Add and p&ack meshes"), this);
+	_actAddAndProcess->setStatusTip(tr("Loads meshes and packs them with the loaded ones, the largest first while the others load."));
+	connect(_actAddAndProcess, SIGNAL(triggered()), this, SLOT(dialogAddAndProcess()));
+
 	_actClear = new QAction(QIcon(":/trolltech/styles/commonstyle/images/standardbutton-clear-32.png"), tr("&Clear"), this);
 	_actClear->setStatusTip(tr("Removes all meshes."));
 	connect(_actClear, SIGNAL(triggered()), &_modelMeshFiles, SLOT(clear()));
@@ -217,6 +223,10 @@ void MainWindow::createActions()
 	_actSetDefaultDilationValue->setStatusTip(tr("Sets the default dilation value."));
 	connect(_actSetDefaultDilationValue, SIGNAL(triggered()), this, SLOT(dialogSetDefaultDilation()));
 
+	_actSetPixelSize = new QAction(QIcon(), tr("Set &pixel size"), this);
+	_actSetPixelSize->setStatusTip(tr("Sets the edge of a z-buffer pixel in mesh units. Bigger pixels pack faster but less dense."));
+	connect(_actSetPixelSize, SIGNAL(triggered()), this, SLOT(dialogSetPixelSize()));
+
 	_actShowResults = new QAction(QIcon(":/trolltech/styles/commonstyle/images/viewdetailed-32.png"), tr("Show &results"), this);
 	_actShowResults->setStatusTip(tr("Shows results in the main window"));
 	connect(_actShowResults, SIGNAL(triggered()), this, SLOT(mainShowResults()));
@@ -266,6 +276,7 @@ void MainWindow::createMenusAndToolbars()
 	menu->insertAction(0, _actAddFile);
 	menu->insertAction(0, _actSaveResults);
 	menu->insertAction(0, _actProcess);
+	menu->insertAction(0, _actAddAndProcess);
 	menu->addSeparator();
 	menu->insertAction(0, _actExit);
 	menuBar()->addMenu(menu);
@@ -278,6 +289,7 @@ void MainWindow::createMenusAndToolbars()
 	menu->insertAction(0, _actSetBoxGeometry);
 	menu->insertAction(0, _actSetConversionFactor);
 	menu->insertAction(0, _actSetDefaultDilationValue);
+	menu->insertAction(0, _actSetPixelSize);
     menu->insertAction(0, _actToggleScaleImages);
     menu->insertAction(0, _actToggleUseLighting);
 	menuBar()->addMenu(menu);
@@ -324,13 +336,14 @@ void MainWindow::createStack()
 	//testTriangle1(&img);
 	//img.dilate(10, Image::maxValue);
 	drawIntro(&img, QVector3D(img.getWidth() / 2, img.getHeight() / 2, 0), 0, 150, 300);
-	Image* o = img.clockwizeRotate90(3);
+	img.rebuildSpans();
+	Image o = img.clockwizeRotate90(3);
 	//Image* o = new Image(img);
 	//drawIntro(&img, QVector3D(img.getWidth() / 2, img.getHeight() / 2, 0), 0.2, 50, 300);
 	//drawIntro(&img, QVector3D(img.getWidth() / 2, img.getHeight() / 2, 0), 0.4, 50, 300);
 
 	QFont font("times", 20);
-	QPixmap pixmap = QPixmap::fromImage(o->toQImage(),  Qt::ThresholdDither);
+	QPixmap pixmap = QPixmap::fromImage(o.toQImage(),  Qt::ThresholdDither);
 	QPainter painter(&pixmap);
 	painter.setFont(font);
 	painter.setPen(Qt::red);
@@ -401,7 +414,7 @@ void MainWindow::removeCurrentNode()
 		_viewMeshFiles->clearSelection();
 		_stack->setCurrentIndex(VIEW_RESULTS);
 		unsigned idx = _currMeshIndex.row();
-		_console->addInfo(tr("removing node \"%1\"").arg(_modelMeshFiles.getNode(idx)->getMesh()->getName()), Console::Info);
+		_console->addInfo(tr("removing node \"%1\"").arg(_modelMeshFiles.getNode(idx)->getName()), Console::Info);
 		_modelMeshFiles.removeRows(idx, 1, QModelIndex());
 	}
 }
@@ -485,6 +498,20 @@ void MainWindow::dialogSetDefaultDilation()
 	}
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MainWindow::dialogSetPixelSize()
+{
+	QString msg = tr("Setting pixel size ");
+	bool ok;
+	double value = QInputDialog::getDouble(this, msg, tr("pixel size in mesh units"), _modelMeshFiles.getPixelSize(),
+												 0.001, 1000, 4, &ok);
+	if (ok)
+	{
+		_modelMeshFiles.setPixelSize(value);
+		_console->addInfo(msg + QString::number(value));
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 static void unrollListFiles(QString filename, QStringList& out)
 {
@@ -505,24 +532,25 @@ static void unrollListFiles(QString filename, QStringList& out)
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-void MainWindow::dialogAddMesh()
+QStringList MainWindow::askMeshFiles()
 {
 	QFileDialog dialog(this,
 		  /* caption = */ tr("Save results as"),
 		  /* directory = */ "",
 		  "OFF meshes (*.off *.OFF);;"
+		  "STL meshes (*.stl *.STL);;"
+		  "PLY meshes (*.ply *.PLY);;"
+		  "OBJ meshes (*.obj *.OBJ);;"
+		  "Compressed meshes (*.gz *.GZ *.zst *.ZST);;"
 		  "TXT mesh list(*.txt *.TXT);;"
-		  "All supported files (*.off *.txt)");
+		  "All supported files (*.off *.OFF *.stl *.STL *.ply *.PLY *.obj *.OBJ *.gz *.GZ *.zst *.ZST *.txt *.TXT)");
 
 	dialog.setFileMode(QFileDialog::ExistingFiles);
+	QStringList out;
 	if (not dialog.exec())
-		return;
+		return out;
 
 	QStringList filenames = dialog.selectedFiles();
-	if (filenames.isEmpty())
-		return;
-
-	QStringList out;
 	for(long i = 0; i < filenames.size(); ++i)
 	{
 		if (filenames[i].endsWith(".txt") or filenames[i].endsWith(".TXT"))
@@ -530,11 +558,36 @@ void MainWindow::dialogAddMesh()
 		else
 			out.append(filenames[i]);
 	}
+	return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MainWindow::dialogAddMesh()
+{
+	QStringList out = askMeshFiles();
+	if (out.isEmpty())
+		return;
 
 	_console->addInfo(tr("loading a list of meshes."));
 	startWorker(WorkerThread::LoadMeshList, QVariant(out));
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Loads meshes and packs them together with the loaded ones in one go, packing starts with the
+/// largest parts while the smaller ones are still loading.
+///
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+void MainWindow::dialogAddAndProcess()
+{
+	QStringList out = askMeshFiles();
+	if (out.isEmpty())
+		return;
+
+	_console->addInfo(tr("loading and processing a list of meshes."));
+	startWorker(WorkerThread::LoadAndComputePositions, QVariant(out));
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 void MainWindow::startWorker(WorkerThread::Task task, QVariant arg)
 {
@@ -542,8 +595,10 @@ void MainWindow::startWorker(WorkerThread::Task task, QVariant arg)
 	_actMeshRemove->setEnabled(false);
 	_actMeshScale->setEnabled(false);
 	_actProcess->setEnabled(false);
+	_actAddAndProcess->setEnabled(false);
 	_actSaveResults->setEnabled(false);
 	_actSetBoxGeometry->setEnabled(false);
+	_actSetPixelSize->setEnabled(false);
 	_actClear->setEnabled(false);
 	_actStop->setEnabled(true);	
     _actToggleUseLighting->setEnabled(false);
@@ -570,7 +625,9 @@ void MainWindow::dialogSaveResults()
 													QDir::currentPath(),
 													"TXT files (*.txt *.TXT);;"
 													"STL Files(*.stl *.STL);;"
-													"OFF Files(*.off *.OFF)",
+													"OFF Files(*.off *.OFF);;"
+													"PLY Files(*.ply *.PLY);;"
+													"3MF Files(*.3mf *.3MF)",
 													&selectedFilter);
 	if (filename.isEmpty())
 		return;
@@ -583,9 +640,9 @@ void MainWindow::dialogSaveResults()
 	if (fileInfo.suffix().isEmpty())	
 		filename = filename + '.' + selectedFilter.toLower();
 
-	if (selectedFilter.at(0) == 'o' or selectedFilter.at(0) == 's') // .off or .stl
+	if (selectedFilter.at(0) == 'o' or selectedFilter.at(0) == 's' or selectedFilter.at(0) == 'p' or selectedFilter.at(0) == '3') // .off, .stl, .ply or .3mf
 	{		
-		_console->addInfo(tr("saving results to an OFF mesh \"%1\"").arg(filename));
+		_console->addInfo(tr("saving results to a mesh \"%1\"").arg(filename));
 		startWorker(WorkerThread::SaveMeshList, filename);
 	}
 	else if (selectedFilter.at(0) == 't') // text of line with format filename,x,y,z
@@ -603,7 +660,7 @@ void MainWindow::dialogSaveResults()
 		for (unsigned i = 0; i < _modelMeshFiles.numNodes(); i++)
 		{
 			Node* node = _modelMeshFiles.getNode(i);
-            out << node->getMesh()->getFilename() << ';'
+            out << node->getFilename() << ';'
 				<< node->getPos().x() << ';' << node->getPos().y() << ';' << node->getPos().z() << '\n';
 		}
 		file.close();
@@ -625,8 +682,8 @@ void MainWindow::processNodes()
 		// sanity checks.
 		for (unsigned i = 0; i < _modelMeshFiles.numNodes(); i++)
 		{
-			const Mesh* mesh = _modelMeshFiles.getNode(i)->getMesh();
-			QVector3D meshGeometry = mesh->getMax() - mesh->getMin();
+			const Node* node = _modelMeshFiles.getNode(i);
+			QVector3D meshGeometry = node->getGeometry();
 
 			if (	meshGeometry.x() > boxGeometry.x() or
 					meshGeometry.y() > boxGeometry.y() or
@@ -634,7 +691,7 @@ void MainWindow::processNodes()
 			{
 
 				_console->addInfo(tr("aborted: mesh \"%1\" is too big! it's geometry is %2 while the packing Box geometry is %3.")
-								  .arg(mesh->getName()).arg(toString(meshGeometry)).arg(toString(boxGeometry)), Console::Error);
+								  .arg(node->getName()).arg(toString(meshGeometry)).arg(toString(boxGeometry)), Console::Error);
 				return;
 			}
 		}
@@ -656,8 +713,10 @@ void MainWindow::processNodesDone()
 	_actMeshRemove->setEnabled(true);
 	_actMeshScale->setEnabled(true);
 	_actProcess->setEnabled(true);
+	_actAddAndProcess->setEnabled(true);
 	_actSaveResults->setEnabled(true);
 	_actSetBoxGeometry->setEnabled(true);
+	_actSetPixelSize->setEnabled(true);
 	_actClear->setEnabled(true);
 	_actStop->setEnabled(false);
     _actToggleUseLighting->setEnabled(true);
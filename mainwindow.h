@@ -37,8 +37,10 @@ public slots:
 
 	void dialogSetBoxGeometry();
 	void dialogAddMesh();
+	void dialogAddAndProcess();
 	void dialogSetConversionFactor();
 	void dialogSetDefaultDilation();
+	void dialogSetPixelSize();
 	void dialogSaveResults();
 	void addMeshByName(const char* name) { _modelMeshFiles.addMesh(name); }
     void processNodes();    
@@ -68,6 +70,7 @@ private:
 	QAction*		_actExit;
 	QAction*		_actAddFile;
 	QAction*        _actProcess;
+	QAction*		_actAddAndProcess;
 	QAction*        _actClear;
 	QAction*		_actSetBoxGeometry;
 	QAction*		_actShowResults;
@@ -75,6 +78,7 @@ private:
 	QAction*		_actSaveResults;
 	QAction*		_actSetConversionFactor;
 	QAction*		_actSetDefaultDilationValue;
+	QAction*		_actSetPixelSize;
 
 	QAction*		_actToggleScaleImages;
 	QAction*		_actToggleUseLighting;
@@ -95,6 +99,7 @@ private:
 	void createStack();
 
     void startWorker(WorkerThread::Task task, QVariant arg = QVariant());
+	QStringList askMeshFiles(); /// file dialog, list files are unrolled. Empty if cancelled.
 
 private slots:
 
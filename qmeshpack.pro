@@ -4,8 +4,19 @@ DEFINES += APP_VERSION=\\\"$$VERSION\\\"
 QT += opengl
 CONFIG += gui qt thread exceptions
 CONFIG(release, debug|release): DEFINES += NDEBUG
-QMAKE_CXXFLAGS = -std=c++11 -march=core2 -fopenmp
+QMAKE_CXXFLAGS = -std=c++17 -march=core2 -fopenmp
 QMAKE_LFLAGS += -fopenmp
+LIBS += -lz
+packagesExist(libzstd) {
+    DEFINES += HAVE_ZSTD
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+}
+packagesExist(liburing) {
+    DEFINES += HAVE_LIBURING
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liburing
+}
 SOURCES += main.cpp \
     mainwindow.cpp \
     Exception.cpp \
@@ -13,10 +24,25 @@ SOURCES += main.cpp \
     vectorinputdialog.cpp \
     GLView.cpp \
     Node.cpp \
+    HeightmapCache.cpp \
     ModelView.cpp \
     WorkerThread.cpp \
     Mesh.cpp \
+    MeshStl.cpp \
+    MeshPly.cpp \
+    MeshObj.cpp \
+    MeshSimplifier.cpp \
+    MeshInput.cpp \
+    Compression.cpp \
+    FileReader.cpp \
+    TaskPool.cpp \
     Image.cpp \
+    TiledImage.cpp \
+    ImageKernels.cpp \
+    BufferPool.cpp \
+    BufferedWriter.cpp \
+    MeshExporter.cpp \
+    ZipWriter.cpp \
     NodeModel.cpp \
     Console.cpp
 HEADERS += mainwindow.h \
@@ -25,11 +51,24 @@ HEADERS += mainwindow.h \
     vectorinputdialog.h \
     GLView.h \
     Node.h \
+    HeightmapCache.h \
     ModelView.h \
     config.h \
     WorkerThread.h \
     Mesh.h \
+    MeshSimplifier.h \
+    MeshInput.h \
+    Compression.h \
+    FileReader.h \
+    TaskPool.h \
     Image.h \
+    TiledImage.h \
+    ImageKernels.h \
+    BufferPool.h \
+    BufferedWriter.h \
+    MeshExporter.h \
+    ZipWriter.h \
+    TextParser.h \
     NodeModel.h \
     Console.h
 RESOURCES += \
@@ -126,8 +126,15 @@ private:
 
 #include <iterator>
 #include <cassert>
-struct DoubleRangeIterator : public  std::iterator<std::bidirectional_iterator_tag, quint64>
+struct DoubleRangeIterator
 {
+	// std::iterator is deprecated since C++17, the traits are spelled out instead.
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef quint64 value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef quint64* pointer;
+	typedef quint64& reference;
+
 	quint64 _x;
 	quint64 _y;
 	quint32 _min_x, _max_x, _min_y, _max_y;